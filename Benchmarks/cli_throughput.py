@@ -0,0 +1,195 @@
+#!/usr/bin/env python3
+# End-to-end throughput of the MD5 and FinalSHA256 command line tools.
+# David Gallagher.
+#
+# Generates synthetic corpora (one huge file, many tiny files, a mix of sizes) on
+# tmpfs and on disk, then times the tools' file hashing with every input engine
+# (--engine stdio|read|mmap|direct|uring), with the page cache warm and cold, next to
+# the system md5sum/sha256sum when they are installed.
+#
+# Each run records wall time and the CPU time of the child processes (user + sys).
+# What is left over, wall - cpu, is time the tool spent blocked, which for these
+# single threaded tools is almost all I/O wait (plus process start up, which is
+# what dominates the tiny file corpus). A run that is mostly CPU wants a
+# faster kernel, a run that is mostly wait wants a better input engine or storage.
+#
+# Cold runs evict the corpus with posix_fadvise(DONTNEED) before every pass, which
+# needs no privileges; pages of tmpfs can't be evicted, so tmpfs is only run warm.
+#
+#   python3 cli_throughput.py --md5 ../MD5/build/MD5 --sha ../SHA256/FinalSHA256/build/FinalSHA256
+#   python3 cli_throughput.py ... --scale full --json results.json
+
+import argparse
+import json
+import os
+import random
+import resource
+import shutil
+import subprocess
+import sys
+import time
+
+ENGINES = ["stdio", "read", "mmap", "direct", "uring"]
+
+# name: (huge file bytes, number of tiny files, number of mixed files)
+SCALES = {
+    "smoke": (16 << 20, 200, 40),
+    "small": (256 << 20, 10000, 500),
+    "full": (4 << 30, 1000000, 20000),
+}
+
+
+def make_corpus(root, scale):
+    """Create the three corpora under root (reused if already there)."""
+    huge, ntiny, nmixed = SCALES[scale]
+    corpora = {}
+    rng = random.Random(1321)
+
+    path = os.path.join(root, "huge")
+    os.makedirs(path, exist_ok=True)
+    name = os.path.join(path, "huge.bin")
+    if not os.path.exists(name) or os.path.getsize(name) != huge:
+        with open(name, "wb") as f:
+            block = os.urandom(1 << 20)
+            for _ in range(huge >> 20):
+                f.write(block)
+    corpora["huge"] = [name]
+
+    for kind, count in (("tiny", ntiny), ("mixed", nmixed)):
+        path = os.path.join(root, kind)
+        os.makedirs(path, exist_ok=True)
+        files = []
+        for i in range(count):
+            name = os.path.join(path, "%07d" % i)
+            if kind == "tiny":
+                size = rng.randint(0, 256)
+            else:
+                # Log-uniform from 1 byte to 64 MiB.
+                size = int(2 ** rng.uniform(0, 26))
+            if not os.path.exists(name) or os.path.getsize(name) != size:
+                with open(name, "wb") as f:
+                    f.write(os.urandom(size))
+            files.append(name)
+        corpora[kind] = files
+    return corpora
+
+
+def evict(files):
+    """Drop the files' pages from the page cache."""
+    for name in files:
+        fd = os.open(name, os.O_RDONLY)
+        try:
+            os.fsync(fd)
+        except OSError:
+            pass
+        os.posix_fadvise(fd, 0, 0, os.POSIX_FADV_DONTNEED)
+        os.close(fd)
+
+
+def warm(files):
+    for name in files:
+        with open(name, "rb") as f:
+            while f.read(1 << 20):
+                pass
+
+
+def run(argvs):
+    """Run each command in turn; returns (wall, user, sys) seconds for all of them."""
+    before = resource.getrusage(resource.RUSAGE_CHILDREN)
+    start = time.perf_counter()
+    for argv in argvs:
+        subprocess.run(argv, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL, check=False)
+    wall = time.perf_counter() - start
+    after = resource.getrusage(resource.RUSAGE_CHILDREN)
+    return wall, after.ru_utime - before.ru_utime, after.ru_stime - before.ru_stime
+
+
+def commands(tool, binary, engine, files):
+    if tool == "md5":
+        return [[binary, "--engine", engine, "--file", f] for f in files]
+    if tool == "sha256":
+        return [[binary, "--engine", engine, f] for f in files]
+    # md5sum / sha256sum take every file at once, in batches to stay under ARG_MAX.
+    return [[binary] + files[i:i + 1000] for i in range(0, len(files), 1000)]
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__)
+    ap.add_argument("--md5", help="path to the MD5 binary")
+    ap.add_argument("--sha", help="path to the FinalSHA256 binary")
+    ap.add_argument("--tmpfs", default="/dev/shm/toa-clibench", help="corpus directory on tmpfs")
+    ap.add_argument("--disk", default="clibench-data", help="corpus directory on disk")
+    ap.add_argument("--scale", choices=sorted(SCALES), default="small")
+    ap.add_argument("--engines", default=",".join(ENGINES))
+    ap.add_argument("--repeat", type=int, default=3, help="passes per configuration, the fastest is kept")
+    ap.add_argument("--json", help="also write the results to this file")
+    ap.add_argument("--keep", action="store_true", help="keep the corpora afterwards")
+    args = ap.parse_args()
+
+    tools = []
+    if args.md5:
+        tools.append(("md5", args.md5, args.engines.split(",")))
+    if args.sha:
+        tools.append(("sha256", args.sha, args.engines.split(",")))
+    for name in ("md5sum", "sha256sum"):
+        if shutil.which(name):
+            tools.append((name, shutil.which(name), ["system"]))
+    if not args.md5 and not args.sha:
+        ap.error("give --md5 and/or --sha")
+
+    results = []
+    print("%-8s %-6s %-5s %-10s %-7s %9s %9s %9s %9s" %
+          ("corpus", "where", "cache", "tool", "engine", "MB/s", "wall s", "cpu s", "wait s"))
+    for where, root in (("tmpfs", args.tmpfs), ("disk", args.disk)):
+        if not os.path.isdir(os.path.dirname(os.path.abspath(root))):
+            print("skipping %s: %s does not exist" % (where, os.path.dirname(os.path.abspath(root))), file=sys.stderr)
+            continue
+        # Only what this run creates is removed afterwards: root may be a directory
+        # of the user's, and corpora kept by an earlier --keep run stay.
+        made = [d for d in [root] + [os.path.join(root, k) for k in ("huge", "tiny", "mixed")]
+                if not os.path.exists(d)]
+        corpora = make_corpus(root, args.scale)
+        for corpus, files in corpora.items():
+            nbytes = sum(os.path.getsize(f) for f in files)
+            for cache in ("warm", "cold") if where == "disk" else ("warm",):
+                for tool, binary, engines in tools:
+                    for engine in engines:
+                        best = None
+                        for _ in range(args.repeat):
+                            if cache == "cold":
+                                evict(files)
+                            else:
+                                warm(files)
+                            r = run(commands(tool, binary, engine, files))
+                            if best is None or r[0] < best[0]:
+                                best = r
+                        wall, user, sys_ = best
+                        row = {
+                            "corpus": corpus, "where": where, "cache": cache, "tool": tool,
+                            "engine": engine, "files": len(files), "bytes": nbytes,
+                            "wall_s": wall, "user_s": user, "sys_s": sys_,
+                            "io_wait_s": max(0.0, wall - user - sys_),
+                            "mb_per_sec": nbytes / wall / 1e6 if wall > 0 else 0.0,
+                        }
+                        results.append(row)
+                        print("%-8s %-6s %-5s %-10s %-7s %9.1f %9.3f %9.3f %9.3f" %
+                              (corpus, where, cache, tool, engine, row["mb_per_sec"], wall,
+                               user + sys_, row["io_wait_s"]))
+                        sys.stdout.flush()
+        if not args.keep:
+            for d in made[::-1]:
+                if d == root:
+                    try:
+                        os.rmdir(root)
+                    except OSError:
+                        pass
+                else:
+                    shutil.rmtree(d, ignore_errors=True)
+
+    if args.json:
+        with open(args.json, "w") as f:
+            json.dump({"scale": args.scale, "results": results}, f, indent=1)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,254 @@
+// --engine afalg and auto: hash in the kernel through an AF_ALG socket.
+// David Gallagher.
+//
+// Linux offers its crypto API to user space as sockets: bind one to "hash" and
+// "md5", accept an operation socket from it, write the message and read the
+// digest back. The message doesn't have to pass through this process at all: a
+// pipe on stdin is spliced straight into the socket, and a file is spliced into a
+// pipe and from there into the socket, so the kernel hashes the page cache. Where
+// the kernel has a faster driver than our nexthash (an accelerator, or a CPU
+// extension the build doesn't target) this wins; with the generic software
+// drivers it is still a useful cross-check.
+//
+// --engine auto times both on AFALG_TUNE bytes in memory, once per process, and
+// picks the kernel only if the digests agree and it is faster by AFALG_MARGIN.
+// Where AF_ALG is missing (other systems, kernels without CRYPTO_USER_API_HASH,
+// sandboxes that refuse the socket family) both engines read the file as read does.
+// Needs Common/input.c.
+
+#ifndef COMMON_AFALG_C
+#define COMMON_AFALG_C
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "ticks.c"
+
+#define AFALG_CHUNK   (1 << 20)   // bytes per splice, and the pipe size asked for
+#define AFALG_TUNE    (8 << 20)   // bytes each side hashes when tuning
+#define AFALG_MARGIN  1.10        // how much faster the kernel must be to be picked
+
+// The tool's own hash of a buffer, to tune and check against.
+typedef void (*AFALG_HASH)(const uint8_t *data, size_t n, uint8_t *digest);
+
+#ifdef __linux__
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <linux/if_alg.h>
+
+#ifndef AF_ALG
+#define AF_ALG 38
+#endif
+
+/**
+ * Open an operation socket for a kernel hash.
+ * @param alg - the kernel's name for it, "md5" or "sha256"
+ * @return the socket, or -1 if AF_ALG or the algorithm is unavailable
+ */
+static int afalg_open(const char *alg){
+    struct sockaddr_alg sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.salg_family = AF_ALG;
+    memcpy(sa.salg_type, "hash", 5);
+    strncpy((char *) sa.salg_name, alg, sizeof(sa.salg_name) - 1);
+    int tfm = socket(AF_ALG, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (tfm < 0) { return -1; }
+    int op = bind(tfm, (struct sockaddr *) &sa, sizeof(sa)) == 0 ? accept(tfm, NULL, 0) : -1;
+    // The operation socket keeps the transform alive.
+    close(tfm);
+    return op;
+}
+
+/**
+ * End the message with an empty write without MSG_MORE, then read the digest.
+ * The socket can take another message afterwards.
+ * @return 1 on success
+ */
+static int afalg_final(int op, uint8_t *digest, size_t dlen){
+    if (send(op, NULL, 0, 0) < 0) { return 0; }
+    return read(op, digest, dlen) == (ssize_t) dlen;
+}
+
+/**
+ * Write part of the message.
+ * @return 1 on success
+ */
+static int afalg_send(int op, const uint8_t *data, size_t n){
+    while (n > 0){
+        ssize_t s = send(op, data, n, MSG_MORE);
+        if (s < 0 && errno == EINTR) { continue; }
+        if (s <= 0) { return 0; }
+        data += s; n -= (size_t) s;
+    }
+    return 1;
+}
+
+/**
+ * The fallback for inputs that can't be spliced: read and send.
+ */
+static int afalg_copy(int in, int op){
+    uint8_t *buf = malloc(AFALG_CHUNK);
+    ssize_t n;
+    if (!buf) { return 0; }
+    for (;;){
+        n = read(in, buf, AFALG_CHUNK);
+        if (n < 0 && errno == EINTR) { continue; }
+        if (n <= 0 || !afalg_send(op, buf, (size_t) n)) { break; }
+    }
+    free(buf);
+    return n == 0;
+}
+
+/**
+ * Splice a pipe into the socket.
+ */
+static int afalg_splice_pipe(int in, int op){
+    int first = 1;
+    for (;;){
+        ssize_t n = splice(in, NULL, op, NULL, AFALG_CHUNK, SPLICE_F_MORE);
+        if (n < 0 && errno == EINTR) { continue; }
+        // A kernel that can't splice to the socket: nothing has been taken yet.
+        if (n < 0 && errno == EINVAL && first) { return afalg_copy(in, op); }
+        if (n <= 0) { return n == 0; }
+        first = 0;
+    }
+}
+
+/**
+ * Splice a file into a pipe and the pipe into the socket.
+ */
+static int afalg_splice_file(int in, int op){
+    int p[2];
+    int ok = 1, first = 1;
+    if (pipe(p) != 0) { return afalg_copy(in, op); }
+    fcntl(p[1], F_SETPIPE_SZ, AFALG_CHUNK);
+    while (ok){
+        ssize_t n = splice(in, NULL, p[1], NULL, AFALG_CHUNK, SPLICE_F_MORE);
+        if (n < 0 && errno == EINTR) { continue; }
+        if (n < 0 && errno == EINVAL && first){
+            // The file system can't splice.
+            close(p[0]); close(p[1]);
+            return afalg_copy(in, op);
+        }
+        if (n <= 0) { ok = n == 0; break; }
+        first = 0;
+        while (n > 0){
+            ssize_t s = splice(p[0], NULL, op, NULL, (size_t) n, SPLICE_F_MORE);
+            if (s < 0 && errno == EINTR) { continue; }
+            if (s <= 0) { ok = 0; break; }
+            n -= s;
+        }
+    }
+    close(p[0]);
+    close(p[1]);
+    return ok;
+}
+
+/**
+ * Can the kernel hash with alg at all?
+ * @param alg
+ * @return 1 if an operation socket opens
+ */
+int afalg_available(const char *alg){
+    int op = afalg_open(alg);
+    if (op < 0) { return 0; }
+    close(op);
+    return 1;
+}
+
+/**
+ * Hash a file or stdin ("-") in the kernel.
+ * @param alg
+ * @param path
+ * @param digest - receives dlen bytes
+ * @param dlen
+ * @return 1 with the digest; 0 if AF_ALG can't do it, before anything was read,
+ * so the caller can read the file itself; -1 if reading failed part way
+ */
+int afalg_path(const char *alg, const char *path, uint8_t *digest, size_t dlen){
+    struct stat st;
+    int ok;
+    int op = afalg_open(alg);
+    if (op < 0) { return 0; }
+    int in = input_is_stdin(path) ? STDIN_FILENO : open(path, O_RDONLY);
+    if (in < 0 || fstat(in, &st) != 0){
+        if (in > STDIN_FILENO) { close(in); }
+        close(op);
+        return 0;
+    }
+    if (S_ISFIFO(st.st_mode)) { ok = afalg_splice_pipe(in, op); }
+    else if (S_ISREG(st.st_mode)) { ok = afalg_splice_file(in, op); }
+    else { ok = afalg_copy(in, op); }
+    ok = ok && afalg_final(op, digest, dlen);
+    if (in != STDIN_FILENO) { close(in); }
+    close(op);
+    return ok ? 1 : -1;
+}
+
+/**
+ * Is the kernel's hash faster than ours? Both hash the same AFALG_TUNE bytes, once
+ * to warm up and once timed, and a kernel digest that differs from ours rules the
+ * kernel out for good.
+ * @param alg
+ * @param hash - the tool's hash of a buffer
+ * @param dlen
+ * @return 1 if the kernel agrees and is faster by AFALG_MARGIN
+ */
+int afalg_tune(const char *alg, AFALG_HASH hash, size_t dlen){
+    uint8_t ours[64], theirs[64];
+    int op = afalg_open(alg);
+    if (op < 0) { return 0; }
+    uint8_t *buf = malloc(AFALG_TUNE);
+    if (!buf) { close(op); return 0; }
+    uint64_t s = 0x2545f4914f6cdd1dULL;
+    for (size_t i = 0; i + 8 <= AFALG_TUNE; i += 8){
+        s ^= s >> 12; s ^= s << 25; s ^= s >> 27;
+        uint64_t x = s * 0x2545f4914f6cdd1dULL;
+        memcpy(buf + i, &x, 8);
+    }
+
+    hash(buf, AFALG_TUNE, ours);
+    double t0 = ticks_seconds();
+    hash(buf, AFALG_TUNE, ours);
+    double inproc = ticks_seconds() - t0;
+
+    int ok = afalg_send(op, buf, AFALG_TUNE) && afalg_final(op, theirs, dlen);
+    t0 = ticks_seconds();
+    ok = ok && afalg_send(op, buf, AFALG_TUNE) && afalg_final(op, theirs, dlen);
+    double kernel = ticks_seconds() - t0;
+    close(op);
+    free(buf);
+
+    if (ok && memcmp(ours, theirs, dlen) != 0){
+        fprintf(stderr, "Warning: the kernel's %s disagrees with ours, not using it.\n", alg);
+        return 0;
+    }
+    return ok && inproc > kernel * AFALG_MARGIN;
+}
+
+#else
+
+int afalg_available(const char *alg){
+    (void) alg;
+    return 0;
+}
+
+int afalg_path(const char *alg, const char *path, uint8_t *digest, size_t dlen){
+    (void) alg; (void) path; (void) digest; (void) dlen;
+    return 0;
+}
+
+int afalg_tune(const char *alg, AFALG_HASH hash, size_t dlen){
+    (void) alg; (void) hash; (void) dlen;
+    return 0;
+}
+
+#endif
+
+#endif
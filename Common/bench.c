@@ -0,0 +1,178 @@
+// Microbenchmark harness for the hash kernels.
+// David Gallagher.
+//
+// Each tool registers its kernels as callbacks that hash a batch of equal sized
+// messages. For every (kernel, message size) pair the harness warms up, then takes
+// a number of samples of many repetitions each and reports cycles/byte (minimum,
+// median, mean, standard deviation) and hashes/sec as JSON.
+// Cycles come from rdtsc on x86, which counts reference cycles at the TSC rate, not
+// the current core clock; elsewhere the timer is nanoseconds and "timer" says so
+// (see ticks.c).
+// The process is pinned to the CPU it started on so samples are not split between cores.
+
+#ifndef COMMON_BENCH_C
+#define COMMON_BENCH_C
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <inttypes.h>
+
+#include "ticks.c"
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#define BENCH_SAMPLES      11
+#define BENCH_MINSAMPLES   3
+#define BENCH_SAMPLEBYTES  (1ULL << 20)   // aim for this much hashing per sample
+#define BENCH_WARMUP       2              // untimed samples before measuring
+
+// Hash nmsg messages of len bytes each; message i starts at data + i * len.
+typedef void (*BENCH_FN)(void *arg, const uint8_t *data, size_t len, size_t nmsg);
+
+typedef struct {
+    const char *name;
+    BENCH_FN fn;
+    void *arg;
+    size_t nmsg;    // messages per call, e.g. the number of SIMD lanes
+    size_t minlen;  // smallest message the kernel accepts
+    size_t maxlen;  // largest message the kernel accepts, 0 for no limit
+} BENCH_KERNEL;
+
+// Message sizes in the sweep, 0 B to 1 GiB. Sizes above --bench's limit are skipped.
+static const uint64_t BENCH_SIZES[] = {
+        0, 32, 55, 56, 64, 256, 1024, 4096, 16384, 65536,
+        1ULL << 20, 16ULL << 20, 256ULL << 20, 1ULL << 30};
+
+/**
+ * Pin the process to the CPU it is running on.
+ * @return the CPU number, or -1 if pinning is not available
+ */
+int bench_pin(void){
+#ifdef __linux__
+    int cpu = sched_getcpu();
+    if (cpu < 0) { return -1; }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) != 0) { return -1; }
+    return cpu;
+#else
+    return -1;
+#endif
+}
+
+static int bench_cmp(const void *a, const void *b){
+    double x = *(const double *) a, y = *(const double *) b;
+    return x < y ? -1 : x > y;
+}
+
+/**
+ * Benchmark one kernel at one message size and write a JSON object.
+ * @param out
+ * @param k
+ * @param data - at least len * k->nmsg bytes
+ * @param len
+ * @param first - 1 for the first result, which has no leading comma
+ */
+static void bench_one(FILE *out, const BENCH_KERNEL *k, const uint8_t *data, size_t len, int first){
+    uint64_t batch = (uint64_t) len * k->nmsg;
+    // Empty messages still cost a padding block, count them as 64 bytes for sizing.
+    uint64_t reps = BENCH_SAMPLEBYTES / (batch ? batch : 64 * k->nmsg);
+    int samples = batch >= (64ULL << 20) ? BENCH_MINSAMPLES : BENCH_SAMPLES;
+    double cpb[BENCH_SAMPLES], cpm[BENCH_SAMPLES], secs[BENCH_SAMPLES];
+    if (reps == 0) { reps = 1; }
+
+    for (int s = -BENCH_WARMUP; s < samples; s++){
+        double t0 = ticks_seconds();
+        uint64_t c0 = ticks_now();
+        for (uint64_t r = 0; r < reps; r++){ k->fn(k->arg, data, len, k->nmsg); }
+        uint64_t c1 = ticks_now();
+        double t1 = ticks_seconds();
+        if (s < 0) { continue; }
+        cpm[s] = (double) (c1 - c0) / (double) (reps * k->nmsg);
+        cpb[s] = batch ? (double) (c1 - c0) / (double) (reps * batch) : 0.0;
+        secs[s] = (t1 - t0) / (double) reps;
+    }
+
+    double mean = 0, var = 0;
+    for (int s = 0; s < samples; s++){ mean += cpb[s]; }
+    mean /= samples;
+    for (int s = 0; s < samples; s++){ var += (cpb[s] - mean) * (cpb[s] - mean); }
+    double sd = samples > 1 ? sqrt(var / (samples - 1)) : 0.0;
+    qsort(cpb, samples, sizeof(double), bench_cmp);
+    qsort(cpm, samples, sizeof(double), bench_cmp);
+    qsort(secs, samples, sizeof(double), bench_cmp);
+    double best = secs[0] > 0 ? secs[0] : 1e-12;
+
+    fprintf(out, "%s\n    {\"kernel\": \"%s\", \"bytes\": %zu, \"messages\": %zu, \"samples\": %d, \"reps\": %" PRIu64 ", "
+                 "\"cycles_per_hash_median\": %.1f, \"cpb_min\": %.4f, \"cpb_median\": %.4f, \"cpb_mean\": %.4f, "
+                 "\"cpb_stddev\": %.4f, \"hashes_per_sec\": %.0f, \"mb_per_sec\": %.2f}",
+            first ? "" : ",", k->name, len, k->nmsg, samples, reps,
+            cpm[samples / 2], cpb[0], cpb[samples / 2], mean, sd,
+            (double) k->nmsg / best, (double) batch / best / 1e6);
+    fflush(out);
+}
+
+/**
+ * Run every kernel over the size sweep and print one JSON document.
+ * @param out
+ * @param tool - name recorded in the document
+ * @param kernels
+ * @param nkernels
+ * @param maxbytes - largest message size to try
+ * @return 1 on success, 0 if the test data could not be allocated
+ */
+int bench_run(FILE *out, const char *tool, const BENCH_KERNEL *kernels, int nkernels, uint64_t maxbytes){
+    size_t maxnmsg = 1, need = 0;
+    int cpu = bench_pin();
+    int first = 1;
+
+    for (int i = 0; i < nkernels; i++){ if (kernels[i].nmsg > maxnmsg) { maxnmsg = kernels[i].nmsg; } }
+    for (size_t s = 0; s < sizeof(BENCH_SIZES) / sizeof(BENCH_SIZES[0]); s++){
+        if (BENCH_SIZES[s] <= maxbytes && BENCH_SIZES[s] * maxnmsg > need) { need = BENCH_SIZES[s] * maxnmsg; }
+    }
+
+    // Pseudo-random data; the kernels' timing does not depend on it.
+    uint8_t *data = malloc(need ? need : 1);
+    if (!data) { printf("Error: could not allocate %zu bytes of test data.\n", need); return 0; }
+    uint64_t x = 0x9e3779b97f4a7c15ULL;
+    for (size_t i = 0; i < need; i++){ x ^= x << 13; x ^= x >> 7; x ^= x << 17; data[i] = (uint8_t) x; }
+
+    fprintf(out, "{\"tool\": \"%s\", \"timer\": \"%s\", \"cpu\": %d, \"results\": [", tool, TICKS_UNIT, cpu);
+    for (int i = 0; i < nkernels; i++){
+        const BENCH_KERNEL *k = &kernels[i];
+        for (size_t s = 0; s < sizeof(BENCH_SIZES) / sizeof(BENCH_SIZES[0]); s++){
+            uint64_t len = BENCH_SIZES[s];
+            if (len > maxbytes || len < k->minlen || (k->maxlen && len > k->maxlen)) { continue; }
+            if (len * k->nmsg > need) { continue; }
+            bench_one(out, k, data, (size_t) len, first);
+            first = 0;
+        }
+    }
+    fprintf(out, "\n]}\n");
+    free(data);
+    return 1;
+}
+
+/**
+ * Parse a size such as 4096, 64K, 16M or 1G.
+ * @param s
+ * @return bytes
+ */
+uint64_t bench_parse_size(const char *s){
+    char *end;
+    uint64_t n = strtoull(s, &end, 10);
+    if (*end == 'K' || *end == 'k') { n <<= 10; }
+    else if (*end == 'M' || *end == 'm') { n <<= 20; }
+    else if (*end == 'G' || *end == 'g') { n <<= 30; }
+    return n;
+}
+
+#endif
@@ -0,0 +1,26 @@
+// Constant time comparison for authentication tags.
+// David Gallagher.
+
+#ifndef COMMON_CONSTTIME_C
+#define COMMON_CONSTTIME_C
+
+#include <stddef.h>
+#include <inttypes.h>
+
+/**
+ * Compare two byte strings without an early exit, so the running time does not
+ * reveal how many leading bytes of a forged tag were right.
+ * @param a
+ * @param b
+ * @param n
+ * @return 1 if equal, 0 otherwise
+ */
+int consttime_equal(const uint8_t *a, const uint8_t *b, size_t n){
+    volatile uint8_t diff = 0;
+    for (size_t i = 0; i < n; i++){
+        diff |= a[i] ^ b[i];
+    }
+    return diff == 0;
+}
+
+#endif
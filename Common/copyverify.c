@@ -0,0 +1,292 @@
+// --copy: copy files, hashing the source on the way and verifying the copy.
+// David Gallagher.
+//
+// A backup that copies a file and then hashes both ends reads the data three times.
+// Here each chunk read from the source is hashed and written from the same buffer,
+// so the source is read once. The destination is then fsynced, dropped from the
+// page cache, and read back with O_DIRECT (the direct engine of Common/input.c),
+// so the second digest comes from the media rather than from the pages just
+// written. Where O_DIRECT is refused (tmpfs, some network file systems) the
+// re-read falls back to the read engine and the report says so.
+//
+// Files are copied by a pool of workers that take the next file from an atomic
+// counter, as fuzz.c does. Each worker holds its engine's buffers (INPUT_DEPTH
+// chunks for uring, one otherwise), and the pool is cut down to fit them under
+// COPYVERIFY_INFLIGHT however many files there are. Results are printed in the
+// order the files were given.
+//
+// The holes of a sparse source (handed over from input_zeros) are hashed but not
+// written: the copy seeks past them and is truncated to length at the end, so it
+// is sparse too, and the read-back walks the same holes.
+// Needs Common/input.c.
+
+#ifndef COMMON_COPYVERIFY_C
+#define COMMON_COPYVERIFY_C
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#define COPYVERIFY_INFLIGHT  (64ULL << 20)   // chunk buffers in use at once, across workers
+#define COPYVERIFY_CTXWORDS  64              // room for a tool's streaming context
+
+// How a tool hashes a stream.
+typedef struct {
+    size_t dlen;
+    void (*init)(void *ctx);
+    void (*update)(void *ctx, const uint8_t *data, size_t n);
+    void (*final)(void *ctx, uint8_t *digest);
+} COPYVERIFY_OPS;
+
+enum {COPY_OK, COPY_ESRC, COPY_EDST, COPY_ESAME, COPY_EVERIFY, COPY_MISMATCH};
+
+static const char *COPYVERIFY_ERRORS[] = {
+        "OK", "could not read the source", "could not write the destination",
+        "source and destination are the same file", "could not read the copy back",
+        "the copy does not match the source"};
+
+#ifndef _WIN32
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+typedef struct {
+    const char *src;
+    char *dst;
+    int status;
+    int direct;         // the copy was read back with O_DIRECT
+    int done;
+    uint8_t digest[64];
+} COPYVERIFY_FILE;
+
+typedef struct {
+    const COPYVERIFY_OPS *ops;
+    INPUT_ENGINE engine;
+    COPYVERIFY_FILE *files;
+    size_t n;
+    size_t next;            // next file to copy, taken atomically
+    size_t printed;         // files reported so far, under lock
+    size_t failed;
+    pthread_mutex_t lock;
+} COPYVERIFY_RUN;
+
+/**
+ * Write all of buf.
+ * @return 1 on success, 0 on a write error
+ */
+static int copyverify_write(int fd, const uint8_t *buf, size_t n){
+    while (n > 0){
+        ssize_t w = write(fd, buf, n);
+        if (w < 0 && errno == EINTR) { continue; }
+        if (w <= 0) { return 0; }
+        buf += w; n -= (size_t) w;
+    }
+    return 1;
+}
+
+static int copyverify_cmp(const void *a, const void *b){
+    return strcmp(*(char *const *) a, *(char *const *) b);
+}
+
+/**
+ * Would two of the copies land on the same path (a/x and b/x into one directory)?
+ * Their workers would write the file at once, so like cp the run is refused.
+ * @param files
+ * @param n
+ * @return the first such path, or NULL; points into files
+ */
+static const char *copyverify_duplicate(const COPYVERIFY_FILE *files, size_t n){
+    const char *dup = NULL;
+    char **dsts = malloc(n * sizeof(char *));
+    if (!dsts){
+        for (size_t i = 0; i < n; i++){
+            for (size_t j = i + 1; j < n; j++){ if (strcmp(files[i].dst, files[j].dst) == 0) { return files[i].dst; } }
+        }
+        return NULL;
+    }
+    for (size_t i = 0; i < n; i++){ dsts[i] = files[i].dst; }
+    qsort(dsts, n, sizeof(char *), copyverify_cmp);
+    for (size_t i = 1; i < n && !dup; i++){
+        if (strcmp(dsts[i - 1], dsts[i]) == 0) { dup = dsts[i]; }
+    }
+    free(dsts);
+    return dup;
+}
+
+/**
+ * Copy one file, hashing what is written, then read the copy back and hash that.
+ * @param r
+ * @param f
+ * @return COPY_OK or what went wrong
+ */
+static int copyverify_one(COPYVERIFY_RUN *r, COPYVERIFY_FILE *f){
+    const COPYVERIFY_OPS *ops = r->ops;
+    uint64_t ctx[COPYVERIFY_CTXWORDS];
+    uint8_t check[64];
+    struct stat sst, dst;
+    INPUT in;
+    const uint8_t *data;
+    long n;
+
+    if (stat(f->src, &sst) != 0) { return COPY_ESRC; }
+    if (stat(f->dst, &dst) == 0 && dst.st_dev == sst.st_dev && dst.st_ino == sst.st_ino) { return COPY_ESAME; }
+
+    // stdio would add a copy of every chunk; any other engine hands its buffer over.
+    if (!input_open(&in, f->src, r->engine == ENGINE_STDIO ? ENGINE_READ : r->engine)){
+        input_close(&in);
+        return COPY_ESRC;
+    }
+    int out = open(f->dst, O_WRONLY | O_CREAT | O_TRUNC, sst.st_mode & 07777);
+    if (out < 0) { input_close(&in); return COPY_EDST; }
+
+    ops->init(ctx);
+    int ok = 1;
+    int hole = 0;           // the copy ends in a hole that was only seeked over
+    uint64_t pos = 0;
+    while ((n = input_next(&in, &data)) > 0){
+        ops->update(ctx, data, (size_t) n);
+        pos += (uint64_t) n;
+        // A destination that can't seek gets the zeros written out.
+        hole = data == input_zeros && lseek(out, n, SEEK_CUR) >= 0;
+        if (!hole && !copyverify_write(out, data, (size_t) n)) { ok = 0; break; }
+    }
+    input_close(&in);
+    if (n < 0) { close(out); return COPY_ESRC; }
+    if (ok && hole) { ok = ftruncate(out, (off_t) pos) == 0; }
+    // The copy must be on the media before reading it back means anything, and its
+    // now clean pages are dropped so a fallback re-read has to fetch them too.
+    if (!ok || fsync(out) != 0) { close(out); return COPY_EDST; }
+#ifdef POSIX_FADV_DONTNEED
+    posix_fadvise(out, 0, 0, POSIX_FADV_DONTNEED);
+#endif
+    if (close(out) != 0) { return COPY_EDST; }
+    ops->final(ctx, f->digest);
+
+    if (!input_open(&in, f->dst, ENGINE_DIRECT)) { input_close(&in); return COPY_EVERIFY; }
+    f->direct = in.engine == ENGINE_DIRECT;
+    ops->init(ctx);
+    while ((n = input_next(&in, &data)) > 0){ ops->update(ctx, data, (size_t) n); }
+    input_close(&in);
+    if (n < 0) { return COPY_EVERIFY; }
+    ops->final(ctx, check);
+    return memcmp(check, f->digest, ops->dlen) == 0 ? COPY_OK : COPY_MISMATCH;
+}
+
+/**
+ * Print the results that are ready, in order. Call with r->lock held.
+ * @param r
+ */
+static void copyverify_report(COPYVERIFY_RUN *r){
+    for (; r->printed < r->n && r->files[r->printed].done; r->printed++){
+        COPYVERIFY_FILE *f = &r->files[r->printed];
+        if (f->status != COPY_OK){
+            printf("%s: FAILED, %s\n", f->dst, COPYVERIFY_ERRORS[f->status]);
+            continue;
+        }
+        for (size_t i = 0; i < r->ops->dlen; i++){ printf("%02" PRIx8, f->digest[i]); }
+        printf("  %s%s\n", f->dst, f->direct ? "" : " (verified through the page cache, O_DIRECT refused)");
+    }
+    fflush(stdout);
+}
+
+static void *copyverify_worker(void *arg){
+    COPYVERIFY_RUN *r = arg;
+    for (;;){
+        size_t i = __atomic_fetch_add(&r->next, 1, __ATOMIC_RELAXED);
+        if (i >= r->n) { return NULL; }
+        COPYVERIFY_FILE *f = &r->files[i];
+        f->status = copyverify_one(r, f);
+        pthread_mutex_lock(&r->lock);
+        f->done = 1;
+        if (f->status != COPY_OK) { r->failed++; }
+        copyverify_report(r);
+        pthread_mutex_unlock(&r->lock);
+    }
+}
+
+/**
+ * Copy files and verify the copies, like cp: "src dst", or "src... dir".
+ * Prints "digest  dst" per verified copy and "dst: FAILED, why" otherwise.
+ * @param paths - the sources, then the destination
+ * @param n - number of paths, at least 2
+ * @param engine - how the sources are read
+ * @param ops
+ * @param nworkers - 0 for one per online CPU
+ * @return 1 if every copy was verified, 0 otherwise
+ */
+int copyverify_run(char **paths, int n, INPUT_ENGINE engine, const COPYVERIFY_OPS *ops, int nworkers){
+    COPYVERIFY_RUN r;
+    struct stat st;
+    const char *dest = paths[n - 1];
+    int todir = stat(dest, &st) == 0 && S_ISDIR(st.st_mode);
+
+    if (n > 2 && !todir) { fprintf(stderr, "Error: copying several files needs a directory, not %s.\n", dest); return 0; }
+    memset(&r, 0, sizeof(r));
+    r.ops = ops;
+    r.engine = engine;
+    r.n = (size_t) n - 1;
+    r.files = calloc(r.n, sizeof(*r.files));
+    if (!r.files) { return 0; }
+    for (size_t i = 0; i < r.n; i++){
+        r.files[i].src = paths[i];
+        if (todir){
+            const char *base = strrchr(paths[i], '/');
+            base = base ? base + 1 : paths[i];
+            size_t len = strlen(dest) + strlen(base) + 2;
+            r.files[i].dst = malloc(len);
+            if (r.files[i].dst) { snprintf(r.files[i].dst, len, "%s/%s", dest, base); }
+        } else {
+            r.files[i].dst = strdup(dest);
+        }
+        if (!r.files[i].dst){
+            for (size_t j = 0; j < i; j++){ free(r.files[j].dst); }
+            free(r.files);
+            return 0;
+        }
+    }
+    const char *dup = copyverify_duplicate(r.files, r.n);
+    if (dup){
+        fprintf(stderr, "Error: more than one source would be copied to %s.\n", dup);
+        for (size_t i = 0; i < r.n; i++){ free(r.files[i].dst); }
+        free(r.files);
+        return 0;
+    }
+
+    if (nworkers <= 0) { nworkers = (int) sysconf(_SC_NPROCESSORS_ONLN); }
+    // The read-back's one chunk comes after the source's buffers are freed.
+    size_t each = input_buffered(engine);
+    if (nworkers > (int) (COPYVERIFY_INFLIGHT / each)) { nworkers = (int) (COPYVERIFY_INFLIGHT / each); }
+    if ((size_t) nworkers > r.n) { nworkers = (int) r.n; }
+    if (nworkers < 1) { nworkers = 1; }
+
+    pthread_mutex_init(&r.lock, NULL);
+    pthread_t *threads = malloc((size_t) nworkers * sizeof(pthread_t));
+    int started = 0;
+    for (int i = 1; threads && i < nworkers; i++){
+        if (pthread_create(&threads[started], NULL, copyverify_worker, &r) == 0) { started++; }
+    }
+    copyverify_worker(&r);
+    for (int i = 0; i < started; i++){ pthread_join(threads[i], NULL); }
+    free(threads);
+    pthread_mutex_destroy(&r.lock);
+
+    for (size_t i = 0; i < r.n; i++){ free(r.files[i].dst); }
+    free(r.files);
+    return r.failed == 0;
+}
+
+#else
+
+int copyverify_run(char **paths, int n, INPUT_ENGINE engine, const COPYVERIFY_OPS *ops, int nworkers){
+    (void) paths; (void) n; (void) engine; (void) ops; (void) nworkers;
+    fprintf(stderr, "Error: --copy needs POSIX file descriptors and threads.\n");
+    return 0;
+}
+
+#endif
+
+#endif
@@ -0,0 +1,543 @@
+// --serve: a long-running hashing daemon on a Unix domain socket.
+// David Gallagher.
+//
+// Services that hash many small payloads pay for a process start and argv parsing
+// per digest through the CLI; the daemon pays them once. A client connects and
+// writes requests back to back without waiting for answers, and reads the
+// responses, matched by tag, in whatever order they finish. All integers are
+// big endian, as in --records lp32.
+//
+//   request   16 bytes: algorithm (DIGESTALGO code, 1 byte), flags (1 byte, bit 0: an
+//             fd came with this header), 2 zero bytes, tag (4 bytes), length (8 bytes),
+//             then length bytes of data unless an fd came with it
+//   response  8 bytes: status (1 byte, DAEMON_OK...), digest length (1 byte), 2 zero
+//             bytes, tag (4 bytes), then the digest
+//
+// An fd is passed with SCM_RIGHTS in the same sendmsg as its header, and is hashed
+// from offset 0 to its end with pread (read for a pipe); the client's offset is
+// left alone. Data above DAEMON_MAXINLINE must come as an fd.
+//
+// Each connection has a reader thread that parses requests and queues them by size
+// class: up to DAEMON_SMALL bytes, up to DAEMON_MEDIUM, and the rest. Worker 0 only
+// takes small requests and worker 1 small and medium ones, so a request of a few
+// bytes is never stuck behind a multi-GB file however many of those are queued.
+// Workers take the smallest class first, and a worker on the small queue takes up
+// to DAEMON_BATCH inline requests for the same algorithm at once, which the tool
+// hashes through its lanes.
+//
+// Workers never write to a socket. A response is appended to its connection's
+// output buffer, and each connection has a writer thread that sends what has built
+// up. A client that pipelines requests without reading the responses can fill its
+// socket, but that only blocks its own writer. Once DAEMON_OUTMAX bytes of its
+// responses are waiting, its reader stops taking requests until some have gone.
+
+#ifndef COMMON_DAEMON_C
+#define COMMON_DAEMON_C
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "digestcache.c"
+#include "records.c"
+
+#define DAEMON_HEADER     16
+#define DAEMON_REPLY      8
+#define DAEMON_BATCH      64                // inline requests hashed in one call of the tool's mem
+#define DAEMON_MAXINLINE  (64ULL << 20)     // larger data must be sent as an fd
+#define DAEMON_INFLIGHT   (256ULL << 20)    // inline bytes one connection may have queued
+#define DAEMON_SMALL      (64ULL << 10)
+#define DAEMON_MEDIUM     (16ULL << 20)
+#define DAEMON_CLASSES    3
+#define DAEMON_RBUF       (64 << 10)
+#define DAEMON_MAXFDS     16                // fds received ahead of their headers
+#define DAEMON_FDCHUNK    (1 << 20)         // read size for fd requests
+#define DAEMON_OUTMAX     (1 << 20)         // unsent response bytes before a reader holds back
+
+enum {DAEMON_OK = 0, DAEMON_EALGO = 1, DAEMON_ETOOBIG = 2, DAEMON_EREAD = 3, DAEMON_ENOFD = 4};
+
+// What a tool can hash.
+typedef struct {
+    const char *names;      // for the start-up message
+    // Digest length of algo, 0 if the tool doesn't have it.
+    size_t (*dlen)(DIGESTALGO algo);
+    // Hash n messages in memory, at most DAEMON_BATCH.
+    void (*mem)(DIGESTALGO algo, const RECORD *recs, size_t n, uint8_t *digests);
+    // Hash fd from offset 0 to its end, e.g. with daemon_fd_next. Returns 1 on success.
+    int (*fd)(DIGESTALGO algo, int fd, uint8_t *digest);
+} DAEMON_OPS;
+
+#ifndef _WIN32
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+typedef struct {
+    int sock;
+    int refs;                   // the reader, the writer and each queued request
+    pthread_mutex_t lock;
+    pthread_cond_t room;        // inflight or the output backlog went down
+    pthread_cond_t writable;    // a response was queued, or the last one was
+    uint64_t inflight;
+    uint64_t pending;           // requests not answered yet
+    int eof;                    // the reader has stopped
+    int dead;                   // a response could not be sent
+    // Responses waiting for the writer.
+    uint8_t *out;
+    size_t outlen, outcap;
+    // The reader's own.
+    uint8_t rbuf[DAEMON_RBUF];
+    size_t rpos, rlen;
+    int fds[DAEMON_MAXFDS];
+    int nfds;
+} DAEMON_CONN;
+
+typedef struct DAEMON_REQ {
+    DAEMON_CONN *conn;
+    DIGESTALGO algo;
+    uint32_t tag;
+    uint8_t *data;              // inline data, or NULL
+    size_t len;
+    int fd;                     // or -1
+    uint8_t status;
+    uint8_t digest[64];
+    struct DAEMON_REQ *next;
+} DAEMON_REQ;
+
+typedef struct {
+    const DAEMON_OPS *ops;
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    DAEMON_REQ *head[DAEMON_CLASSES];
+    DAEMON_REQ *last[DAEMON_CLASSES];
+} DAEMON;
+
+typedef struct {
+    DAEMON *d;
+    int ceiling;                // largest class this worker takes
+} DAEMON_WORKER;
+
+/**
+ * Read the next piece of an fd, for the tools' fd callbacks: pread from *off, or
+ * read if the fd can't seek.
+ * @param fd
+ * @param buf
+ * @param cap
+ * @param off - advanced by what was read
+ * @return bytes read, 0 at the end, -1 on an error
+ */
+long daemon_fd_next(int fd, uint8_t *buf, size_t cap, uint64_t *off){
+    ssize_t n;
+    do { n = pread(fd, buf, cap, (off_t) *off); } while (n < 0 && errno == EINTR);
+    if (n < 0 && errno == ESPIPE){
+        do { n = read(fd, buf, cap); } while (n < 0 && errno == EINTR);
+    }
+    if (n > 0) { *off += (uint64_t) n; }
+    return (long) n;
+}
+
+static void daemon_conn_release(DAEMON_CONN *c){
+    if (__atomic_sub_fetch(&c->refs, 1, __ATOMIC_ACQ_REL) > 0) { return; }
+    close(c->sock);
+    free(c->out);
+    pthread_cond_destroy(&c->writable);
+    pthread_cond_destroy(&c->room);
+    pthread_mutex_destroy(&c->lock);
+    free(c);
+}
+
+/**
+ * Queue a request's response for the connection's writer and let the request go.
+ * Never waits on the socket.
+ * @param r
+ * @param dlen - digest length, ignored unless r->status is DAEMON_OK
+ */
+static void daemon_reply(DAEMON_REQ *r, size_t dlen){
+    DAEMON_CONN *c = r->conn;
+
+    if (r->status != DAEMON_OK) { dlen = 0; }
+    pthread_mutex_lock(&c->lock);
+    size_t need = c->outlen + DAEMON_REPLY + dlen;
+    if (!c->dead && need > c->outcap){
+        size_t cap = c->outcap ? 2 * c->outcap : 4096;
+        while (cap < need) { cap *= 2; }
+        uint8_t *p = realloc(c->out, cap);
+        if (p) { c->out = p; c->outcap = cap; } else { c->dead = 1; }
+    }
+    if (!c->dead){
+        uint8_t *out = c->out + c->outlen;
+        out[0] = r->status;
+        out[1] = (uint8_t) dlen;
+        out[2] = out[3] = 0;
+        for (int i = 0; i < 4; i++){ out[4 + i] = (uint8_t) (r->tag >> (24 - 8 * i)); }
+        memcpy(out + DAEMON_REPLY, r->digest, dlen);
+        c->outlen = need;
+    }
+    c->pending--;
+    if (r->data) { c->inflight -= r->len; }
+    pthread_cond_signal(&c->room);
+    pthread_cond_signal(&c->writable);
+    pthread_mutex_unlock(&c->lock);
+
+    free(r->data);
+    if (r->fd >= 0) { close(r->fd); }
+    daemon_conn_release(c);
+    free(r);
+}
+
+/**
+ * A connection's writer: send the responses as they build up, swapping buffers so
+ * the workers go on queueing while a batch is on its way. Leaves once the reader
+ * has stopped and every request has been answered, or the client has gone.
+ */
+static void *daemon_writer(void *arg){
+    DAEMON_CONN *c = (DAEMON_CONN *) arg;
+    uint8_t *buf = NULL;
+    size_t cap = 0;
+
+    pthread_mutex_lock(&c->lock);
+    for (;;){
+        while (!c->dead && c->outlen == 0 && !(c->eof && c->pending == 0)) { pthread_cond_wait(&c->writable, &c->lock); }
+        if (c->dead || c->outlen == 0) { break; }
+        uint8_t *full = c->out;
+        size_t n = c->outlen, fullcap = c->outcap;
+        c->out = buf;
+        c->outcap = cap;
+        c->outlen = 0;
+        buf = full;
+        cap = fullcap;
+        pthread_cond_signal(&c->room);
+        pthread_mutex_unlock(&c->lock);
+
+        size_t done = 0;
+        while (done < n){
+            ssize_t k = send(c->sock, buf + done, n - done, MSG_NOSIGNAL);
+            if (k < 0 && errno == EINTR) { continue; }
+            if (k <= 0) { break; }
+            done += (size_t) k;
+        }
+        pthread_mutex_lock(&c->lock);
+        if (done < n) { c->dead = 1; pthread_cond_signal(&c->room); }
+    }
+    pthread_mutex_unlock(&c->lock);
+    free(buf);
+    daemon_conn_release(c);
+    return NULL;
+}
+
+// Take from the recvmsg path, queueing any fds that came along.
+static ssize_t daemon_recv(DAEMON_CONN *c, void *buf, size_t n){
+    union { struct cmsghdr align; char b[CMSG_SPACE(sizeof(int) * DAEMON_MAXFDS)]; } ctl;
+    struct iovec iov;
+    struct msghdr msg;
+    ssize_t got;
+
+    iov.iov_base = buf;
+    iov.iov_len = n;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctl.b;
+    msg.msg_controllen = sizeof(ctl.b);
+    do { got = recvmsg(c->sock, &msg, MSG_CMSG_CLOEXEC); } while (got < 0 && errno == EINTR);
+    if (got < 0) { return got; }
+    for (struct cmsghdr *h = CMSG_FIRSTHDR(&msg); h; h = CMSG_NXTHDR(&msg, h)){
+        if (h->cmsg_level != SOL_SOCKET || h->cmsg_type != SCM_RIGHTS) { continue; }
+        size_t nfd = (h->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (size_t i = 0; i < nfd; i++){
+            int fd;
+            memcpy(&fd, CMSG_DATA(h) + i * sizeof(int), sizeof(int));
+            if (c->nfds < DAEMON_MAXFDS) { c->fds[c->nfds++] = fd; } else { close(fd); }
+        }
+    }
+    return got;
+}
+
+/**
+ * Read exactly n bytes from the connection, through its buffer.
+ * @param c
+ * @param dst - NULL to skip them
+ * @param n
+ * @return 1, or 0 at the end of the stream or on an error
+ */
+static int daemon_read(DAEMON_CONN *c, uint8_t *dst, uint64_t n){
+    while (n > 0){
+        if (c->rpos == c->rlen){
+            // A large read goes straight to its destination.
+            if (dst && n >= DAEMON_RBUF){
+                ssize_t got = daemon_recv(c, dst, n > (1u << 30) ? (1u << 30) : (size_t) n);
+                if (got <= 0) { return 0; }
+                dst += got;
+                n -= (uint64_t) got;
+                continue;
+            }
+            ssize_t got = daemon_recv(c, c->rbuf, DAEMON_RBUF);
+            if (got <= 0) { return 0; }
+            c->rpos = 0;
+            c->rlen = (size_t) got;
+        }
+        size_t take = c->rlen - c->rpos < n ? c->rlen - c->rpos : (size_t) n;
+        if (dst) { memcpy(dst, c->rbuf + c->rpos, take); dst += take; }
+        c->rpos += take;
+        n -= take;
+    }
+    return 1;
+}
+
+static int daemon_class(uint64_t size){
+    return size <= DAEMON_SMALL ? 0 : size <= DAEMON_MEDIUM ? 1 : 2;
+}
+
+static void daemon_queue(DAEMON *d, DAEMON_REQ *r, uint64_t size){
+    int k = daemon_class(size);
+    r->next = NULL;
+    pthread_mutex_lock(&d->lock);
+    if (d->last[k]) { d->last[k]->next = r; } else { d->head[k] = r; }
+    d->last[k] = r;
+    pthread_cond_broadcast(&d->ready);
+    pthread_mutex_unlock(&d->lock);
+}
+
+typedef struct {
+    DAEMON *d;
+    DAEMON_CONN *c;
+} DAEMON_READER;
+
+static void *daemon_reader(void *arg){
+    DAEMON *d = ((DAEMON_READER *) arg)->d;
+    DAEMON_CONN *c = ((DAEMON_READER *) arg)->c;
+    uint8_t h[DAEMON_HEADER];
+    free(arg);
+
+    for (;;){
+        // Hold back while this client leaves its responses unread.
+        pthread_mutex_lock(&c->lock);
+        while (!c->dead && c->outlen >= DAEMON_OUTMAX) { pthread_cond_wait(&c->room, &c->lock); }
+        int dead = c->dead;
+        pthread_mutex_unlock(&c->lock);
+        if (dead || !daemon_read(c, h, DAEMON_HEADER)) { break; }
+
+        DAEMON_REQ *r = calloc(1, sizeof(DAEMON_REQ));
+        uint64_t len = 0, size;
+        if (!r) { break; }
+        for (int i = 0; i < 8; i++){ len = len << 8 | h[8 + i]; }
+        r->conn = c;
+        r->algo = (DIGESTALGO) h[0];
+        r->tag = (uint32_t) h[4] << 24 | (uint32_t) h[5] << 16 | (uint32_t) h[6] << 8 | h[7];
+        r->fd = -1;
+        size = len;
+        __atomic_add_fetch(&c->refs, 1, __ATOMIC_RELAXED);
+        pthread_mutex_lock(&c->lock);
+        c->pending++;
+        pthread_mutex_unlock(&c->lock);
+
+        if (h[1] & 1){
+            if (c->nfds == 0) {
+                r->status = DAEMON_ENOFD;
+            } else {
+                struct stat st;
+                r->fd = c->fds[0];
+                memmove(c->fds, c->fds + 1, (size_t) --c->nfds * sizeof(int));
+                // Pipes and the like count as large: their size is unknown.
+                size = fstat(r->fd, &st) == 0 && S_ISREG(st.st_mode) ? (uint64_t) st.st_size : UINT64_MAX;
+            }
+        } else if (len > DAEMON_MAXINLINE) {
+            r->status = DAEMON_ETOOBIG;
+            if (!daemon_read(c, NULL, len)) { daemon_reply(r, 0); break; }
+        } else {
+            // Hold back while this connection already has its share queued.
+            pthread_mutex_lock(&c->lock);
+            while (c->inflight && c->inflight + len > DAEMON_INFLIGHT) { pthread_cond_wait(&c->room, &c->lock); }
+            c->inflight += len;
+            pthread_mutex_unlock(&c->lock);
+            r->len = (size_t) len;
+            r->data = malloc(len ? (size_t) len : 1);
+            if (!r->data || !daemon_read(c, r->data, len)){
+                if (!r->data) { pthread_mutex_lock(&c->lock); c->inflight -= len; pthread_mutex_unlock(&c->lock); }
+                r->status = DAEMON_EREAD;
+                daemon_reply(r, 0);
+                break;
+            }
+        }
+        if (r->status == DAEMON_OK && d->ops->dlen(r->algo) == 0) { r->status = DAEMON_EALGO; }
+        if (r->status != DAEMON_OK) { daemon_reply(r, 0); }
+        else { daemon_queue(d, r, size); }
+    }
+    for (int i = 0; i < c->nfds; i++){ close(c->fds[i]); }
+    c->nfds = 0;
+    pthread_mutex_lock(&c->lock);
+    c->eof = 1;
+    pthread_cond_signal(&c->writable);
+    pthread_mutex_unlock(&c->lock);
+    daemon_conn_release(c);
+    return NULL;
+}
+
+/**
+ * Take the next work: one request, or a batch of small inline ones for one algorithm.
+ * @param d
+ * @param ceiling - largest class to look at
+ * @param batch - receives the requests
+ * @return how many
+ */
+static int daemon_take(DAEMON *d, int ceiling, DAEMON_REQ **batch){
+    int n = 0;
+
+    pthread_mutex_lock(&d->lock);
+    for (;;){
+        for (int k = 0; k <= ceiling && n == 0; k++){
+            DAEMON_REQ *r = d->head[k];
+            if (!r) { continue; }
+            d->head[k] = r->next;
+            if (!d->head[k]) { d->last[k] = NULL; }
+            batch[n++] = r;
+            if (k == 0 && r->data){
+                // Gather more small inline requests for the same algorithm.
+                DAEMON_REQ **link = &d->head[0], *kept = NULL;
+                while (*link && n < DAEMON_BATCH){
+                    if ((*link)->data && (*link)->algo == r->algo) { batch[n++] = *link; *link = (*link)->next; }
+                    else { kept = *link; link = &kept->next; }
+                }
+                // Taking the tail leaves the last one skipped as the tail.
+                if (!*link) { d->last[0] = kept; }
+            }
+        }
+        if (n) { break; }
+        pthread_cond_wait(&d->ready, &d->lock);
+    }
+    pthread_mutex_unlock(&d->lock);
+    return n;
+}
+
+static void *daemon_worker(void *arg){
+    DAEMON_WORKER *w = (DAEMON_WORKER *) arg;
+    const DAEMON_OPS *ops = w->d->ops;
+    DAEMON_REQ *batch[DAEMON_BATCH];
+    RECORD recs[DAEMON_BATCH];
+    uint8_t digests[DAEMON_BATCH * 64];
+
+    for (;;){
+        int n = daemon_take(w->d, w->ceiling, batch);
+        size_t dlen = ops->dlen(batch[0]->algo);
+        if (batch[0]->fd >= 0){
+            if (!ops->fd(batch[0]->algo, batch[0]->fd, batch[0]->digest)) { batch[0]->status = DAEMON_EREAD; }
+        } else {
+            for (int i = 0; i < n; i++){ recs[i].data = batch[i]->data; recs[i].len = batch[i]->len; }
+            ops->mem(batch[0]->algo, recs, (size_t) n, digests);
+            for (int i = 0; i < n; i++){ memcpy(batch[i]->digest, digests + (size_t) i * dlen, dlen); }
+        }
+        for (int i = 0; i < n; i++){ daemon_reply(batch[i], dlen); }
+    }
+    return NULL;
+}
+
+/**
+ * Serve hash requests on a Unix socket until the process is killed.
+ * @param path - the socket; a stale socket there is replaced
+ * @param ops - what the tool can hash
+ * @param nworkers - 0 for one per online CPU; never fewer than DAEMON_CLASSES
+ * @return 0 if the socket or the workers could not be set up
+ */
+int daemon_serve(const char *path, const DAEMON_OPS *ops, int nworkers){
+    static DAEMON d;
+    struct sockaddr_un addr;
+    struct stat st;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) { fprintf(stderr, "Error: socket path %s is too long.\n", path); return 0; }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, path, strlen(path) + 1);
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode)) { unlink(path); }
+
+    int ls = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (ls < 0 || bind(ls, (struct sockaddr *) &addr, sizeof(addr)) != 0 || listen(ls, 128) != 0){
+        fprintf(stderr, "Error: could not listen on %s: %s\n", path, strerror(errno));
+        if (ls >= 0) { close(ls); }
+        return 0;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    d.ops = ops;
+    pthread_mutex_init(&d.lock, NULL);
+    pthread_cond_init(&d.ready, NULL);
+    if (nworkers <= 0) { nworkers = (int) sysconf(_SC_NPROCESSORS_ONLN); }
+    if (nworkers < DAEMON_CLASSES) { nworkers = DAEMON_CLASSES; }
+    DAEMON_WORKER *workers = calloc((size_t) nworkers, sizeof(DAEMON_WORKER));
+    int started = 0;
+    for (int i = 0; workers && i < nworkers; i++){
+        pthread_t t;
+        workers[i].d = &d;
+        workers[i].ceiling = i < DAEMON_CLASSES - 1 ? i : DAEMON_CLASSES - 1;
+        if (pthread_create(&t, NULL, daemon_worker, &workers[i]) == 0) { pthread_detach(t); started++; }
+        else if (i < DAEMON_CLASSES) { break; }
+    }
+    if (started < DAEMON_CLASSES){
+        fprintf(stderr, "Error: could not start the workers.\n");
+        close(ls);
+        return 0;
+    }
+    fprintf(stderr, "Serving %s on %s with %d workers.\n", ops->names, path, started);
+
+    for (;;){
+        int s = accept4(ls, NULL, NULL, SOCK_CLOEXEC);
+        if (s < 0){
+            if (errno == EINTR || errno == ECONNABORTED || errno == EMFILE || errno == ENFILE) { continue; }
+            fprintf(stderr, "Error: accept failed: %s\n", strerror(errno));
+            close(ls);
+            return 0;
+        }
+        DAEMON_CONN *c = calloc(1, sizeof(DAEMON_CONN));
+        DAEMON_READER *ra = malloc(sizeof(DAEMON_READER));
+        pthread_t t;
+        if (!c || !ra) { free(c); free(ra); close(s); continue; }
+        c->sock = s;
+        c->refs = 2;
+        pthread_mutex_init(&c->lock, NULL);
+        pthread_cond_init(&c->room, NULL);
+        pthread_cond_init(&c->writable, NULL);
+        ra->d = &d;
+        ra->c = c;
+        if (pthread_create(&t, NULL, daemon_writer, c) != 0){
+            free(ra);
+            daemon_conn_release(c);
+            daemon_conn_release(c);
+            continue;
+        }
+        pthread_detach(t);
+        if (pthread_create(&t, NULL, daemon_reader, ra) != 0){
+            // The writer leaves once it sees the reader has stopped.
+            free(ra);
+            pthread_mutex_lock(&c->lock);
+            c->eof = 1;
+            pthread_cond_signal(&c->writable);
+            pthread_mutex_unlock(&c->lock);
+            daemon_conn_release(c);
+            continue;
+        }
+        pthread_detach(t);
+    }
+}
+
+#else
+
+long daemon_fd_next(int fd, uint8_t *buf, size_t cap, uint64_t *off){
+    (void) fd; (void) buf; (void) cap; (void) off;
+    return -1;
+}
+
+int daemon_serve(const char *path, const DAEMON_OPS *ops, int nworkers){
+    (void) path; (void) ops; (void) nworkers;
+    fprintf(stderr, "Error: --serve needs Unix domain sockets.\n");
+    return 0;
+}
+
+#endif
+
+#endif
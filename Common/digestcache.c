@@ -0,0 +1,331 @@
+// Persistent digest cache.
+// David Gallagher.
+//
+// An on-disk open addressing hash table, mapped into memory, that remembers the
+// digest of a file against its (device, inode, size, mtime, ctime). A tool that
+// finds a matching entry can print the digest without opening the file at all.
+//
+// Readers never lock: every slot carries a sequence number which is odd while the
+// slot is being written (a seqlock), so a reader copies the slot and retries the
+// probe if the sequence moved underneath it. Writers serialise with flock() on
+// the cache file, which also works between separate processes.
+// The file is in host byte order and is not meant to be shared between machines.
+
+#ifndef COMMON_DIGESTCACHE_C
+#define COMMON_DIGESTCACHE_C
+
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#define DIGESTCACHE_MAGIC      0x31304344414f54ULL   // "TOADC01"
+#define DIGESTCACHE_HEADERSIZE 4096
+#define DIGESTCACHE_MINSLOTS   65536
+#define DIGESTCACHE_PROBES     16
+#define DIGESTCACHE_MAXDIGEST  64
+
+// Digest algorithm stored in a slot. Never renumber, the values are on disk.
+typedef enum {ALGO_NONE = 0, ALGO_MD5 = 1, ALGO_SHA256 = 2,
+              ALGO_SHA512 = 3, ALGO_SHA384 = 4, ALGO_SHA512_256 = 5} DIGESTALGO;
+
+// Identity of a file as far as the cache is concerned.
+typedef struct {
+    uint64_t dev;
+    uint64_t ino;
+    uint64_t size;
+    int64_t mtime_ns;
+    int64_t ctime_ns;
+} DIGESTKEY;
+
+// One cache entry, 128 bytes. seq == 0 means the slot has never been used.
+typedef struct {
+    uint64_t seq;
+    DIGESTKEY key;
+    uint32_t algo;
+    uint32_t digestlen;
+    uint8_t digest[DIGESTCACHE_MAXDIGEST];
+    uint8_t reserved[8];
+} DIGESTSLOT;
+
+// First page of the cache file.
+typedef struct {
+    uint64_t magic;
+    uint64_t nslots;
+    uint64_t count;
+    uint64_t retired;   // set once compaction has replaced this file
+} DIGESTHEADER;
+
+typedef struct {
+    int fd;
+    size_t mapsize;
+    DIGESTHEADER *hdr;
+    DIGESTSLOT *slots;
+} DIGESTCACHE;
+
+#ifndef _WIN32
+
+// splitmix64 finaliser, spreads (dev, ino) over the table.
+static uint64_t digestcache_hash(const DIGESTKEY *k, uint32_t algo){
+    uint64_t x = k->ino ^ (k->dev << 32) ^ (k->dev >> 32) ^ ((uint64_t) algo << 56);
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+static int digestcache_samekey(const DIGESTKEY *a, const DIGESTKEY *b){
+    return a->dev == b->dev && a->ino == b->ino && a->size == b->size
+           && a->mtime_ns == b->mtime_ns && a->ctime_ns == b->ctime_ns;
+}
+
+/**
+ * Fill in the cache key from a stat structure.
+ * @param st
+ * @param k
+ */
+void digestcache_key_from_stat(const struct stat *st, DIGESTKEY *k){
+    memset(k, 0, sizeof(*k));
+    k->dev = (uint64_t) st->st_dev;
+    k->ino = (uint64_t) st->st_ino;
+    k->size = (uint64_t) st->st_size;
+    k->mtime_ns = (int64_t) st->st_mtim.tv_sec * 1000000000LL + st->st_mtim.tv_nsec;
+    k->ctime_ns = (int64_t) st->st_ctim.tv_sec * 1000000000LL + st->st_ctim.tv_nsec;
+}
+
+/**
+ * stat() a path and build its cache key. Only regular files are cacheable, never stdin.
+ * @param path
+ * @param k
+ * @return 1 on success, 0 otherwise
+ */
+int digestcache_key(const char *path, DIGESTKEY *k){
+    struct stat st;
+    // "-" is stdin, which has no stable identity.
+    if (strcmp(path, "-") == 0 || stat(path, &st) != 0 || !S_ISREG(st.st_mode)) { return 0; }
+    digestcache_key_from_stat(&st, k);
+    return 1;
+}
+
+/**
+ * Map an existing cache file, or create an empty one of nslots entries.
+ * @param c
+ * @param path
+ * @param nslots - size for a new file, must be a power of two
+ * @return 1 on success, 0 otherwise
+ */
+static int digestcache_map(DIGESTCACHE *c, const char *path, uint64_t nslots){
+    memset(c, 0, sizeof(*c));
+    c->fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (c->fd < 0) { return 0; }
+
+    // Initialise a new file while holding the writer lock, so two tools started
+    // at the same time cannot both write the header.
+    flock(c->fd, LOCK_EX);
+    struct stat st;
+    if (fstat(c->fd, &st) != 0) { goto fail; }
+    if (st.st_size == 0) {
+        DIGESTHEADER h = { DIGESTCACHE_MAGIC, nslots, 0, 0 };
+        if (ftruncate(c->fd, DIGESTCACHE_HEADERSIZE + nslots * sizeof(DIGESTSLOT)) != 0) { goto fail; }
+        if (pwrite(c->fd, &h, sizeof(h), 0) != (ssize_t) sizeof(h)) { goto fail; }
+        st.st_size = DIGESTCACHE_HEADERSIZE + nslots * sizeof(DIGESTSLOT);
+    }
+    flock(c->fd, LOCK_UN);
+
+    DIGESTHEADER h;
+    if (pread(c->fd, &h, sizeof(h), 0) != (ssize_t) sizeof(h) || h.magic != DIGESTCACHE_MAGIC
+        || (h.nslots & (h.nslots - 1)) != 0
+        || (uint64_t) st.st_size != DIGESTCACHE_HEADERSIZE + h.nslots * sizeof(DIGESTSLOT)) {
+        printf("Error: %s is not a digest cache.\n", path);
+        close(c->fd);
+        return 0;
+    }
+
+    c->mapsize = (size_t) st.st_size;
+    void *p = mmap(NULL, c->mapsize, PROT_READ | PROT_WRITE, MAP_SHARED, c->fd, 0);
+    if (p == MAP_FAILED) { close(c->fd); return 0; }
+    c->hdr = (DIGESTHEADER *) p;
+    c->slots = (DIGESTSLOT *) ((uint8_t *) p + DIGESTCACHE_HEADERSIZE);
+    return 1;
+
+fail:
+    flock(c->fd, LOCK_UN);
+    close(c->fd);
+    return 0;
+}
+
+/**
+ * Open (creating if needed) the cache at path.
+ * @param c
+ * @param path
+ * @return 1 on success, 0 otherwise
+ */
+int digestcache_open(DIGESTCACHE *c, const char *path){
+    return digestcache_map(c, path, DIGESTCACHE_MINSLOTS);
+}
+
+/**
+ * Unmap and close the cache.
+ * @param c
+ */
+void digestcache_close(DIGESTCACHE *c){
+    if (c->hdr) { munmap(c->hdr, c->mapsize); }
+    if (c->fd >= 0) { close(c->fd); }
+    memset(c, 0, sizeof(*c));
+    c->fd = -1;
+}
+
+/**
+ * Take a consistent copy of a slot without locking.
+ * @param s
+ * @param out
+ * @return the sequence number of the copy, 0 for an empty slot, 1 if the slot is being written
+ */
+static uint64_t digestcache_read_slot(const DIGESTSLOT *s, DIGESTSLOT *out){
+    for (;;) {
+        uint64_t seq1 = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE);
+        if (seq1 == 0) { return 0; }
+        if (seq1 & 1) { return 1; }
+        memcpy(out, s, sizeof(*out));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&s->seq, __ATOMIC_RELAXED) == seq1) { return seq1; }
+    }
+}
+
+/**
+ * Lock-free lookup of a digest.
+ * @param c
+ * @param k
+ * @param algo
+ * @param digest - receives the digest on a hit
+ * @param len - expected digest length in bytes
+ * @return 1 on a hit, 0 on a miss
+ */
+int digestcache_lookup(DIGESTCACHE *c, const DIGESTKEY *k, DIGESTALGO algo, uint8_t *digest, uint32_t len){
+    uint64_t mask = c->hdr->nslots - 1;
+    uint64_t h = digestcache_hash(k, algo);
+    DIGESTSLOT copy;
+
+    for (int i = 0; i < DIGESTCACHE_PROBES; i++) {
+        uint64_t seq = digestcache_read_slot(&c->slots[(h + i) & mask], &copy);
+        if (seq == 0) { return 0; }
+        if (seq == 1) { continue; }
+        if (copy.algo == (uint32_t) algo && copy.digestlen == len && digestcache_samekey(&copy.key, k)) {
+            memcpy(digest, copy.digest, len);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Record a digest. An older entry for the same file and algorithm is replaced.
+ * @param c
+ * @param k
+ * @param algo
+ * @param digest
+ * @param len
+ * @return 1 if stored, 0 if the probe window is full (compact the cache) or it has been retired
+ */
+int digestcache_insert(DIGESTCACHE *c, const DIGESTKEY *k, DIGESTALGO algo, const uint8_t *digest, uint32_t len){
+    if (len > DIGESTCACHE_MAXDIGEST) { return 0; }
+
+    flock(c->fd, LOCK_EX);
+    if (__atomic_load_n(&c->hdr->retired, __ATOMIC_ACQUIRE)) { flock(c->fd, LOCK_UN); return 0; }
+
+    uint64_t mask = c->hdr->nslots - 1;
+    uint64_t h = digestcache_hash(k, algo);
+    DIGESTSLOT *target = NULL;
+
+    // Prefer the slot already holding this file, else the first free one.
+    for (int i = 0; i < DIGESTCACHE_PROBES; i++) {
+        DIGESTSLOT *s = &c->slots[(h + i) & mask];
+        if (s->seq == 0) {
+            if (!target) { target = s; }
+            break;
+        }
+        if (s->algo == (uint32_t) algo && s->key.dev == k->dev && s->key.ino == k->ino) {
+            target = s;
+            break;
+        }
+    }
+    if (!target) { flock(c->fd, LOCK_UN); return 0; }
+
+    uint64_t seq = target->seq;
+    if (seq == 0) { __atomic_add_fetch(&c->hdr->count, 1, __ATOMIC_RELAXED); }
+    __atomic_store_n(&target->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    target->key = *k;
+    target->algo = (uint32_t) algo;
+    target->digestlen = len;
+    memset(target->digest, 0, sizeof(target->digest));
+    memcpy(target->digest, digest, len);
+    __atomic_store_n(&target->seq, seq + 2, __ATOMIC_RELEASE);
+
+    flock(c->fd, LOCK_UN);
+    return 1;
+}
+
+/**
+ * Rebuild the cache at path into a fresh table sized for its live entries,
+ * shortening probe chains and making room for more files. Concurrent readers keep
+ * using the old mapping; concurrent writers notice it is retired and stop writing.
+ * @param path
+ * @return 1 on success, 0 otherwise
+ */
+int digestcache_compact(const char *path){
+    DIGESTCACHE old;
+    if (!digestcache_map(&old, path, DIGESTCACHE_MINSLOTS)) { return 0; }
+    flock(old.fd, LOCK_EX);
+
+    uint64_t nslots = DIGESTCACHE_MINSLOTS;
+    while (nslots < old.hdr->count * 4) { nslots <<= 1; }
+
+    char tmppath[4096];
+    snprintf(tmppath, sizeof(tmppath), "%s.compact", path);
+    unlink(tmppath);
+    DIGESTCACHE fresh;
+    if (!digestcache_map(&fresh, tmppath, nslots)) { flock(old.fd, LOCK_UN); digestcache_close(&old); return 0; }
+
+    uint64_t kept = 0, dropped = 0;
+    for (uint64_t i = 0; i < old.hdr->nslots; i++) {
+        DIGESTSLOT *s = &old.slots[i];
+        if (s->seq == 0) { continue; }
+        if (digestcache_insert(&fresh, &s->key, (DIGESTALGO) s->algo, s->digest, s->digestlen)) { kept++; }
+        else { dropped++; }
+    }
+    msync(fresh.hdr, fresh.mapsize, MS_SYNC);
+
+    int ok = rename(tmppath, path) == 0;
+    if (ok) { __atomic_store_n(&old.hdr->retired, 1, __ATOMIC_RELEASE); }
+    printf("Compacted %s: %" PRIu64 " entries kept, %" PRIu64 " dropped, %" PRIu64 " slots.\n",
+           path, kept, dropped, nslots);
+
+    digestcache_close(&fresh);
+    flock(old.fd, LOCK_UN);
+    digestcache_close(&old);
+    return ok;
+}
+
+#else
+
+// No mmap/flock on Windows: the cache is a no-op and every lookup misses.
+int digestcache_key(const char *path, DIGESTKEY *k){ (void) path; (void) k; return 0; }
+int digestcache_open(DIGESTCACHE *c, const char *path){ (void) c; (void) path; return 0; }
+void digestcache_close(DIGESTCACHE *c){ (void) c; }
+int digestcache_lookup(DIGESTCACHE *c, const DIGESTKEY *k, DIGESTALGO algo, uint8_t *digest, uint32_t len){
+    (void) c; (void) k; (void) algo; (void) digest; (void) len; return 0; }
+int digestcache_insert(DIGESTCACHE *c, const DIGESTKEY *k, DIGESTALGO algo, const uint8_t *digest, uint32_t len){
+    (void) c; (void) k; (void) algo; (void) digest; (void) len; return 0; }
+int digestcache_compact(const char *path){ (void) path; return 0; }
+
+#endif
+
+#endif
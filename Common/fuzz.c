@@ -0,0 +1,246 @@
+// Differential fuzzing harness for the hash kernels.
+// David Gallagher.
+//
+// Each tool supplies one check callback that hashes a message with every kernel
+// and input engine it has and compares each result against its reference: the
+// plain block-at-a-time nexthash over a message padded in memory. The harness
+// decides which messages to try:
+//
+// - every length from 0 to FUZZ_EXHAUSTIVE bytes, which is several blocks of either
+//   block size, at each of FUZZ_OFFSETS alignments of the data pointer, so every
+//   padding boundary (55/56/63/64 bytes for 64 byte blocks, 111/112/127/128 for 128
+//   byte blocks) is covered at every alignment;
+// - random lengths, log-uniform up to the size given on the command line (up to
+//   GiB), at random offsets.
+//
+// Messages are slices of one shared pseudo-random buffer, so a GiB case costs no
+// more memory than the buffer itself. Past the exhaustive lengths the buffer has
+// runs of zeros, which fuzz_tempfile leaves as holes, so larger file cases are
+// sparse and the engines' extent walk is checked too. Cases are handed out to
+// worker threads with an atomic counter, as pbkdf2.c does. Each case carries a
+// seed the callback uses for its own choices (where to split update calls, what
+// to batch it with), so a failure prints everything needed to replay it.
+
+#ifndef COMMON_FUZZ_C
+#define COMMON_FUZZ_C
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#ifndef _WIN32
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#define FUZZ_EXHAUSTIVE  1100               // every length up to here, > 8 blocks of 128 bytes
+#define FUZZ_OFFSETS     8                  // data pointer alignments tried for each of them
+#define FUZZ_FILEMAX     (64ULL << 20)      // only cases up to this size are written to a file
+#define FUZZ_MAXREPORT   20                 // mismatches printed in full
+#define FUZZ_ZEROSTART   (256 << 10)        // first run of zeros in the buffer, clear of the exhaustive cases
+#define FUZZ_ZEROEVERY   (1 << 20)          // a run every this many bytes after it
+#define FUZZ_ZEROLEN     (192 << 10)        // bytes per run
+#define FUZZ_HOLEBLOCK   4096               // zero blocks this size and aligned are left as holes
+
+typedef struct {
+    const uint8_t *data;
+    size_t len;
+    size_t offset;      // of data within the shared buffer, for the report
+    uint64_t seed;
+    int files;          // 1 if the input engines should be checked too
+} FUZZ_CASE;
+
+// Check every kernel on one case. Returns the number of comparisons made, or -1
+// after writing what disagreed into why.
+typedef int (*FUZZ_FN)(void *arg, const FUZZ_CASE *c, char *why, size_t whylen);
+
+typedef struct {
+    FUZZ_FN fn;
+    void *arg;
+    const uint8_t *buf;
+    uint64_t bufsize;
+    uint64_t maxbytes;
+    uint64_t nexhaustive;
+    uint64_t ncases;
+    uint64_t next;
+    uint64_t checks;
+    uint64_t failures;
+} FUZZ_RUN;
+
+/**
+ * xorshift64*, for lengths, offsets and split points.
+ * @param s - state, never 0
+ * @return the next value
+ */
+static inline uint64_t fuzz_rand(uint64_t *s){
+    *s ^= *s >> 12; *s ^= *s << 25; *s ^= *s >> 27;
+    return *s * 0x2545f4914f6cdd1dULL;
+}
+
+/**
+ * The i-th case of a run.
+ * @param r
+ * @param i
+ * @param c
+ */
+static void fuzz_case(const FUZZ_RUN *r, uint64_t i, FUZZ_CASE *c){
+    uint64_t s = 0x9e3779b97f4a7c15ULL ^ (i * 0xbf58476d1ce4e5b9ULL);
+    fuzz_rand(&s);
+    c->seed = fuzz_rand(&s) | 1;
+    if (i < r->nexhaustive){
+        c->len = (size_t) (i / FUZZ_OFFSETS);
+        // Slide along the buffer too, so the same length doesn't always see the same bytes.
+        c->offset = (size_t) (i % FUZZ_OFFSETS) + 64 * (size_t) (fuzz_rand(&s) % 1024);
+        // The engines read from a file, where only the length matters.
+        c->files = i % FUZZ_OFFSETS == 0 && (c->len < 260 || c->len % 64 <= 1 || c->len % 64 >= 55);
+    } else {
+        // Log-uniform: a random bit length, then a random length with that many bits.
+        int bits = 0;
+        while (bits < 64 && (r->maxbytes >> bits) > 0) { bits++; }
+        int b = (int) (fuzz_rand(&s) % (uint64_t) (bits + 1));
+        uint64_t len = b == 0 ? 0 : (fuzz_rand(&s) & ((b == 64 ? 0 : (1ULL << b)) - 1)) | (1ULL << (b - 1));
+        if (len > r->maxbytes) { len = r->maxbytes; }
+        c->len = (size_t) len;
+        c->offset = (size_t) (fuzz_rand(&s) % (r->bufsize - len + 1 > 4096 ? 4096 : r->bufsize - len + 1));
+        c->files = len <= FUZZ_FILEMAX;
+    }
+    c->data = r->buf + c->offset;
+}
+
+static void *fuzz_worker(void *arg){
+    FUZZ_RUN *r = (FUZZ_RUN *) arg;
+    char why[512];
+    FUZZ_CASE c;
+
+    for (;;){
+        uint64_t i = __atomic_fetch_add(&r->next, 1, __ATOMIC_RELAXED);
+        if (i >= r->ncases) { break; }
+        fuzz_case(r, i, &c);
+        why[0] = '\0';
+        int n = r->fn(r->arg, &c, why, sizeof(why));
+        if (n < 0){
+            uint64_t f = __atomic_fetch_add(&r->failures, 1, __ATOMIC_RELAXED);
+            if (f < FUZZ_MAXREPORT){
+                printf("MISMATCH case %" PRIu64 ": length %zu, offset %zu, seed %016" PRIx64 ": %s\n",
+                       i, c.len, c.offset, c.seed, why);
+                fflush(stdout);
+            }
+        } else {
+            __atomic_fetch_add(&r->checks, (uint64_t) n, __ATOMIC_RELAXED);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Write a message to a new temporary file, for the input engines.
+ * @param data
+ * @param len
+ * @param path - receives the name; the caller removes it
+ * @param pathlen
+ * @return 1 on success
+ */
+int fuzz_tempfile(const uint8_t *data, size_t len, char *path, size_t pathlen){
+#ifndef _WIN32
+    const char *dir = getenv("TMPDIR");
+    snprintf(path, pathlen, "%s/toafuzz.XXXXXX", dir && dir[0] ? dir : "/tmp");
+    int fd = mkstemp(path);
+    if (fd < 0) { return 0; }
+    static const uint8_t zero[FUZZ_HOLEBLOCK];
+    size_t done = 0;
+    while (done < len){
+        // Aligned zero blocks are skipped over, and ftruncate gives the file its length.
+        if (len - done >= FUZZ_HOLEBLOCK && memcmp(data + done, zero, FUZZ_HOLEBLOCK) == 0){
+            done += FUZZ_HOLEBLOCK;
+            continue;
+        }
+        size_t want = FUZZ_HOLEBLOCK;
+        while (done + want + FUZZ_HOLEBLOCK <= len && memcmp(data + done + want, zero, FUZZ_HOLEBLOCK) != 0){
+            want += FUZZ_HOLEBLOCK;
+        }
+        if (want > len - done) { want = len - done; }
+        ssize_t n = pwrite(fd, data + done, want, (off_t) done);
+        if (n <= 0) { close(fd); unlink(path); return 0; }
+        done += (size_t) n;
+    }
+    if (ftruncate(fd, (off_t) len) != 0) { close(fd); unlink(path); return 0; }
+    close(fd);
+    return 1;
+#else
+    (void) data; (void) len; (void) path; (void) pathlen;
+    return 0;
+#endif
+}
+
+/**
+ * Compare a digest against a published one and print the result.
+ * @param name
+ * @param digest
+ * @param n
+ * @param hex - expected digest, lower case
+ * @return 1 if they match
+ */
+int fuzz_kat(const char *name, const uint8_t *digest, size_t n, const char *hex){
+    char got[129];
+    for (size_t i = 0; i < n && i < 64; i++){ snprintf(got + 2 * i, 3, "%02" PRIx8, digest[i]); }
+    got[2 * (n < 64 ? n : 64)] = '\0';
+    int ok = strcmp(got, hex) == 0;
+    printf("%-40s %s\n", name, ok ? "ok" : "FAILED");
+    if (!ok) { printf("    expected %s\n    got      %s\n", hex, got); }
+    return ok;
+}
+
+/**
+ * Run the exhaustive lengths and nrandom random ones through fn on nthreads threads.
+ * @param tool - name for the report
+ * @param fn
+ * @param arg
+ * @param maxbytes - largest random length
+ * @param nrandom
+ * @param nthreads - 0 for one per online CPU
+ * @return the number of mismatches, or -1 if the data could not be allocated
+ */
+int64_t fuzz_run(const char *tool, FUZZ_FN fn, void *arg, uint64_t maxbytes, uint64_t nrandom, int nthreads){
+    FUZZ_RUN r;
+    memset(&r, 0, sizeof(r));
+    r.fn = fn;
+    r.arg = arg;
+    r.maxbytes = maxbytes;
+    r.bufsize = (maxbytes > FUZZ_EXHAUSTIVE + 64 * 1024 ? maxbytes : FUZZ_EXHAUSTIVE + 64 * 1024) + 4096;
+    r.nexhaustive = (uint64_t) (FUZZ_EXHAUSTIVE + 1) * FUZZ_OFFSETS;
+    r.ncases = r.nexhaustive + nrandom;
+
+    uint8_t *buf = malloc(r.bufsize);
+    if (!buf) { printf("Error: could not allocate %" PRIu64 " bytes of test data.\n", r.bufsize); return -1; }
+    uint64_t s = 0x2545f4914f6cdd1dULL;
+    for (uint64_t i = 0; i + 8 <= r.bufsize; i += 8){ uint64_t x = fuzz_rand(&s); memcpy(buf + i, &x, 8); }
+    for (uint64_t i = FUZZ_ZEROSTART; i < r.bufsize; i += FUZZ_ZEROEVERY){
+        memset(buf + i, 0, r.bufsize - i < FUZZ_ZEROLEN ? (size_t) (r.bufsize - i) : FUZZ_ZEROLEN);
+    }
+    r.buf = buf;
+
+#ifndef _WIN32
+    if (nthreads <= 0) { nthreads = (int) sysconf(_SC_NPROCESSORS_ONLN); }
+    if (nthreads < 1) { nthreads = 1; }
+    printf("%s: %" PRIu64 " cases (lengths 0..%d at %d alignments, %" PRIu64 " random up to %" PRIu64 " bytes) on %d threads\n",
+           tool, r.ncases, FUZZ_EXHAUSTIVE, FUZZ_OFFSETS, nrandom, maxbytes, nthreads);
+    fflush(stdout);
+    pthread_t *threads = malloc((size_t) nthreads * sizeof(pthread_t));
+    int started = 0;
+    for (int i = 1; i < nthreads; i++){
+        if (pthread_create(&threads[started], NULL, fuzz_worker, &r) == 0) { started++; }
+    }
+    fuzz_worker(&r);
+    for (int i = 0; i < started; i++){ pthread_join(threads[i], NULL); }
+    free(threads);
+#else
+    (void) nthreads;
+    fuzz_worker(&r);
+#endif
+
+    printf("%s: %" PRIu64 " comparisons, %" PRIu64 " mismatches\n", tool, r.checks, r.failures);
+    free(buf);
+    return (int64_t) r.failures;
+}
+
+#endif
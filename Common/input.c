@@ -0,0 +1,622 @@
+// Input engines: the different ways a tool can get a file's bytes.
+// David Gallagher.
+//
+// Every engine hands the file over in chunks through input_next(), so the hashing
+// loop is the same whichever is used:
+//  stdio  - fread into a buffer (what the tools always did)
+//  read   - read(2) into a buffer, no stdio copy
+//  mmap   - the file mapped read-only, chunks point into the mapping
+//  direct - O_DIRECT reads into an aligned buffer, bypassing the page cache
+//  uring  - io_uring reads, several chunks in flight ahead of the hash
+// The tools also take afalg and auto, which let the kernel hash the file
+// (Common/afalg.c); opened here they read. direct and uring are Linux only.
+// An engine the file or system can't support (O_DIRECT on tmpfs, io_uring
+// blocked by a seccomp policy) falls back to read, and in->engine says what
+// was actually used. The path "-" is standard input; a pipe or terminal there
+// is always read.
+//
+// A sparse file (a VM image, say) is walked by extent with SEEK_DATA/SEEK_HOLE:
+// data extents are read or mapped as usual, and holes are handed over from one
+// small zero buffer that stays in cache, so only the allocated bytes are read and
+// the digest is unchanged. read, direct and mmap do this; uring reads a sparse
+// file with read, and stdio callers can ask input_sparse() to do the same.
+//
+// Under --scan (Common/stream.c) read and mmap drop each chunk from the page cache
+// once it has been hashed, sparing pages that were cached before the scan got
+// to them, so a long scan leaves other processes' cached files alone.
+
+#ifndef COMMON_INPUT_C
+#define COMMON_INPUT_C
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "stream.c"
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+
+#define INPUT_CHUNK   (1 << 20)   // bytes handed over per input_next
+#define INPUT_ALIGN   4096        // O_DIRECT buffer, offset and length alignment
+#define INPUT_DEPTH   4           // io_uring reads kept in flight
+#define INPUT_ZEROS   (16 << 10)  // hole bytes handed over per input_next, L1 sized
+#define INPUT_SCAN_BACK (8 << 20)  // --scan drops this much behind each chunk again
+
+// Shared by every INPUT for the holes of sparse files; never written.
+static uint8_t input_zeros[INPUT_ZEROS];
+
+typedef enum {ENGINE_STDIO, ENGINE_READ, ENGINE_MMAP, ENGINE_DIRECT, ENGINE_URING, ENGINE_AFALG, ENGINE_AUTO} INPUT_ENGINE;
+
+static const char *INPUT_ENGINE_NAMES[] = {"stdio", "read", "mmap", "direct", "uring", "afalg", "auto"};
+
+#ifdef __linux__
+// The rings shared with the kernel, set up with raw system calls so no library is needed.
+typedef struct {
+    int fd;
+    void *sq_ring, *cq_ring;
+    size_t sq_len, cq_len;
+    struct io_uring_sqe *sqes;
+    size_t sqes_len;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_cqe *cqes;
+} INPUT_URING;
+#endif
+
+typedef struct {
+    INPUT_ENGINE engine;
+    FILE *f;
+    int fd;
+    uint64_t size;
+    uint8_t *buf;          // stdio, read and direct
+    uint8_t *map;          // mmap
+    uint64_t pos;          // next byte to hand over
+    int sparse;            // walk the file by extent
+    int hole;              // pos is in a hole that ends at extent
+    uint64_t extent;       // end of the data extent or hole pos is in
+    int scan;              // drop chunks from the page cache behind us
+    uint8_t *cached;       // a bit per page, set if it was cached before the scan
+    uint64_t pendoff;      // the chunk handed over last, dropped on the next call
+    size_t pendlen;
+#ifdef __linux__
+    INPUT_URING ring;
+    uint8_t *slotbuf[INPUT_DEPTH];
+    uint64_t slotoff[INPUT_DEPTH];
+    uint32_t slotwant[INPUT_DEPTH];
+    uint32_t slotgot[INPUT_DEPTH];
+    int slotbusy[INPUT_DEPTH];     // 0 free, 1 in flight, 2 complete
+    uint64_t submitted;            // offset of the next read to submit
+    int handed;                    // slot handed out by the last input_next, or -1
+#endif
+} INPUT;
+
+/**
+ * Look up an engine by name.
+ * @param name
+ * @param e
+ * @return 1 if known, 0 otherwise
+ */
+int input_engine_parse(const char *name, INPUT_ENGINE *e){
+    for (int i = 0; i < (int) (sizeof(INPUT_ENGINE_NAMES) / sizeof(INPUT_ENGINE_NAMES[0])); i++){
+        if (strcmp(name, INPUT_ENGINE_NAMES[i]) == 0) { *e = (INPUT_ENGINE) i; return 1; }
+    }
+    return 0;
+}
+
+/**
+ * Buffer memory an INPUT opened with engine holds at once, for callers that run
+ * several and keep to a budget.
+ * @param engine
+ * @return bytes: INPUT_DEPTH chunks for uring, one chunk otherwise
+ */
+size_t input_buffered(INPUT_ENGINE engine){
+    return engine == ENGINE_URING ? (size_t) INPUT_DEPTH * INPUT_CHUNK : (size_t) INPUT_CHUNK;
+}
+
+#ifdef __linux__
+static int input_uring_setup(INPUT_URING *r, unsigned entries){
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    memset(r, 0, sizeof(*r));
+    r->fd = (int) syscall(__NR_io_uring_setup, entries, &p);
+    if (r->fd < 0) { return 0; }
+
+    r->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    r->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    r->sq_ring = mmap(NULL, r->sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+    r->cq_ring = mmap(NULL, r->cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+    r->sqes = mmap(NULL, r->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+    if (r->sq_ring == MAP_FAILED || r->cq_ring == MAP_FAILED || (void *) r->sqes == MAP_FAILED) {
+        if (r->sq_ring != MAP_FAILED) { munmap(r->sq_ring, r->sq_len); }
+        if (r->cq_ring != MAP_FAILED) { munmap(r->cq_ring, r->cq_len); }
+        if ((void *) r->sqes != MAP_FAILED) { munmap(r->sqes, r->sqes_len); }
+        close(r->fd);
+        return 0;
+    }
+
+    uint8_t *sq = r->sq_ring, *cq = r->cq_ring;
+    r->sq_head = (unsigned *) (sq + p.sq_off.head);
+    r->sq_tail = (unsigned *) (sq + p.sq_off.tail);
+    r->sq_mask = (unsigned *) (sq + p.sq_off.ring_mask);
+    r->sq_array = (unsigned *) (sq + p.sq_off.array);
+    r->cq_head = (unsigned *) (cq + p.cq_off.head);
+    r->cq_tail = (unsigned *) (cq + p.cq_off.tail);
+    r->cq_mask = (unsigned *) (cq + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe *) (cq + p.cq_off.cqes);
+    return 1;
+}
+
+static void input_uring_teardown(INPUT_URING *r){
+    munmap(r->sqes, r->sqes_len);
+    munmap(r->cq_ring, r->cq_len);
+    munmap(r->sq_ring, r->sq_len);
+    close(r->fd);
+}
+
+// Queue a read of slot s (its missing bytes) and tell the kernel.
+static int input_uring_submit(INPUT *in, int s){
+    INPUT_URING *r = &in->ring;
+    unsigned tail = *r->sq_tail, idx = tail & *r->sq_mask;
+    struct io_uring_sqe *sqe = &r->sqes[idx];
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = in->fd;
+    sqe->addr = (uint64_t) (uintptr_t) (in->slotbuf[s] + in->slotgot[s]);
+    sqe->len = in->slotwant[s] - in->slotgot[s];
+    sqe->off = in->slotoff[s] + in->slotgot[s];
+    sqe->user_data = (uint64_t) s;
+    r->sq_array[idx] = idx;
+    __atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    in->slotbusy[s] = 1;
+    return syscall(__NR_io_uring_enter, r->fd, 1, 0, 0, NULL, 0) == 1;
+}
+
+// Start reads into every free slot until the end of the file.
+static int input_uring_fill(INPUT *in){
+    for (int s = 0; s < INPUT_DEPTH && in->submitted < in->size; s++){
+        if (in->slotbusy[s] != 0 || s == in->handed) { continue; }
+        uint64_t left = in->size - in->submitted;
+        in->slotoff[s] = in->submitted;
+        in->slotwant[s] = left < INPUT_CHUNK ? (uint32_t) left : INPUT_CHUNK;
+        in->slotgot[s] = 0;
+        in->submitted += in->slotwant[s];
+        if (!input_uring_submit(in, s)) { return 0; }
+    }
+    return 1;
+}
+
+// Wait for and reap completions until slot s holds all of its bytes.
+static int input_uring_wait(INPUT *in, int s){
+    INPUT_URING *r = &in->ring;
+    while (in->slotbusy[s] != 2){
+        unsigned head = *r->cq_head;
+        if (head == __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE)){
+            if (syscall(__NR_io_uring_enter, r->fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0) { return 0; }
+            continue;
+        }
+        struct io_uring_cqe *cqe = &r->cqes[head & *r->cq_mask];
+        int c = (int) cqe->user_data;
+        int res = cqe->res;
+        __atomic_store_n(r->cq_head, head + 1, __ATOMIC_RELEASE);
+        if (res < 0) { return 0; }
+        in->slotgot[c] += (uint32_t) res;
+        if (res == 0 || in->slotgot[c] == in->slotwant[c]) {
+            // A zero read means the file shrank; hand over what there is.
+            in->slotwant[c] = in->slotgot[c];
+            in->slotbusy[c] = 2;
+        } else if (!input_uring_submit(in, c)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+#endif
+
+/**
+ * Does a path name standard input?
+ * @param path
+ * @return 1 for "-", 0 otherwise
+ */
+int input_is_stdin(const char *path){
+    return strcmp(path, "-") == 0;
+}
+
+/**
+ * fopen a file for binary reading, or hand back stdin for "-".
+ * @param path
+ * @return FILE* or NULL; close it with input_fclose
+ */
+FILE *input_fopen(const char *path){
+    if (!input_is_stdin(path)) { return fopen(path, "rb"); }
+#ifdef _WIN32
+    _setmode(_fileno(stdin), _O_BINARY);
+#endif
+    return stdin;
+}
+
+/**
+ * Close a FILE* from input_fopen, leaving stdin open.
+ * @param f
+ */
+void input_fclose(FILE *f){
+    if (f && f != stdin) { fclose(f); }
+}
+
+/**
+ * Does a regular file have holes? Only then is walking it by extent worthwhile.
+ * @param fd
+ * @param size
+ * @return 1 if SEEK_HOLE finds a hole before the end of the file
+ */
+static int input_fd_sparse(int fd, uint64_t size){
+#if defined(SEEK_HOLE) && !defined(_WIN32)
+    off_t h = lseek(fd, 0, SEEK_HOLE);
+    lseek(fd, 0, SEEK_SET);
+    return size > 0 && h >= 0 && (uint64_t) h < size;
+#else
+    (void) fd; (void) size;
+    return 0;
+#endif
+}
+
+/**
+ * Is a path a sparse regular file? For callers that read with stdio, which can't
+ * skip holes, to switch to an engine that can.
+ * @param path
+ * @return 1 if it has holes
+ */
+int input_sparse(const char *path){
+#if defined(SEEK_HOLE) && !defined(_WIN32)
+    struct stat st;
+    int sparse = 0;
+    if (input_is_stdin(path)) { return 0; }
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) { return 0; }
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) { sparse = input_fd_sparse(fd, (uint64_t) st.st_size); }
+    close(fd);
+    return sparse;
+#else
+    (void) path;
+    return 0;
+#endif
+}
+
+#if defined(SEEK_HOLE) && !defined(_WIN32)
+/**
+ * Find the extent that in->pos is in: a hole up to the next data, or data up to
+ * the next hole. Past the last data the rest of the file is a hole.
+ * @param in
+ */
+static void input_extent(INPUT *in){
+    off_t d = lseek(in->fd, (off_t) in->pos, SEEK_DATA);
+    if (d < 0 || (uint64_t) d >= in->size){
+        in->hole = 1;
+        in->extent = in->size;
+    } else if ((uint64_t) d > in->pos){
+        in->hole = 1;
+        in->extent = (uint64_t) d;
+    } else {
+        off_t h = lseek(in->fd, (off_t) in->pos, SEEK_HOLE);
+        in->hole = 0;
+        in->extent = h < 0 || (uint64_t) h > in->size ? in->size : (uint64_t) h;
+    }
+}
+
+/**
+ * input_next for a sparse file: holes from input_zeros, data from the mapping or
+ * pread into the engine's buffer.
+ */
+static long input_next_sparse(INPUT *in, const uint8_t **data){
+    if (in->pos >= in->size) { return 0; }
+    if (in->pos >= in->extent) { input_extent(in); }
+    uint64_t left = in->extent - in->pos;
+    if (in->hole){
+        size_t n = left < INPUT_ZEROS ? (size_t) left : INPUT_ZEROS;
+        *data = input_zeros;
+        in->pos += n;
+        return (long) n;
+    }
+    size_t want = left < INPUT_CHUNK ? (size_t) left : INPUT_CHUNK;
+    if (in->engine == ENGINE_MMAP){
+        *data = in->map + in->pos;
+        in->pos += want;
+        return (long) want;
+    }
+    // Extents start and end on file system blocks, so O_DIRECT alignment holds;
+    // the last one ends with the file, and is asked for up to the next block.
+    size_t ask = want;
+    if (in->engine == ENGINE_DIRECT) { ask = (want + INPUT_ALIGN - 1) / INPUT_ALIGN * INPUT_ALIGN; }
+    size_t got = 0;
+    while (got < want){
+        ssize_t n = pread(in->fd, in->buf + got, ask - got, (off_t) (in->pos + got));
+        if (n < 0) { return -1; }
+        if (n == 0) { in->size = in->pos + got; break; }
+        got += (size_t) n;
+        if (in->engine == ENGINE_DIRECT && got % INPUT_ALIGN != 0) { break; }
+    }
+    if (got > want) { got = want; }
+    *data = in->buf;
+    in->pos += got;
+    return (long) got;
+}
+#endif
+
+#ifndef _WIN32
+/**
+ * Note which pages of the file are cached before the scan starts; they belong to
+ * someone else and are left alone. It has to be done up front, as readahead
+ * caches pages ahead of the chunk being read. The file is mapped only to ask
+ * mincore, never touched through the mapping. Without the bitmap every page the
+ * scan reads is dropped.
+ * @param in
+ */
+static void input_scan_snapshot(INPUT *in){
+    uint64_t pages = (in->size + INPUT_ALIGN - 1) / INPUT_ALIGN;
+    unsigned char *vec = malloc(INPUT_CHUNK / INPUT_ALIGN);
+    uint8_t *map = in->map;
+    int ok = vec != NULL && sysconf(_SC_PAGESIZE) == INPUT_ALIGN;
+    if (ok && !map){
+        map = mmap(NULL, in->size, PROT_READ, MAP_SHARED, in->fd, 0);
+        ok = map != MAP_FAILED;
+    }
+    in->cached = ok ? calloc((size_t) ((pages + 7) / 8), 1) : NULL;
+    for (uint64_t off = 0; in->cached && off < in->size; off += INPUT_CHUNK){
+        size_t len = in->size - off < INPUT_CHUNK ? (size_t) (in->size - off) : INPUT_CHUNK;
+        if (mincore(map + off, len, vec) != 0) { free(in->cached); in->cached = NULL; break; }
+        for (size_t p = 0; p < (len + INPUT_ALIGN - 1) / INPUT_ALIGN; p++){
+            uint64_t page = off / INPUT_ALIGN + p;
+            if (vec[p] & 1) { in->cached[page / 8] |= (uint8_t) (1u << (page % 8)); }
+        }
+    }
+    if (ok && map != in->map) { munmap(map, in->size); }
+    free(vec);
+}
+
+/**
+ * Drop the chunk handed over last: unmap it, and evict the pages this scan
+ * brought into the page cache.
+ * @param in
+ */
+static void input_scan_release(INPUT *in){
+    if (in->pendlen == 0) { return; }
+    if (in->map && in->pendoff % INPUT_ALIGN == 0) { madvise(in->map + in->pendoff, in->pendlen, MADV_DONTNEED); }
+#ifdef POSIX_FADV_DONTNEED
+    // Runs of pages this scan brought in; those cached before it stay. The page
+    // cache holds large folios, which are only dropped when a range covers all of
+    // one, so each range reaches back over the folios that straddled the last.
+    uint64_t first = (in->pendoff > INPUT_SCAN_BACK ? in->pendoff - INPUT_SCAN_BACK : 0) / INPUT_ALIGN;
+    uint64_t end = (in->pendoff + in->pendlen + INPUT_ALIGN - 1) / INPUT_ALIGN;
+    for (uint64_t p = first; p < end;){
+        if (in->cached && in->cached[p / 8] & (1u << (p % 8))) { p++; continue; }
+        uint64_t q = p;
+        while (q < end && !(in->cached && in->cached[q / 8] & (1u << (q % 8)))) { q++; }
+        posix_fadvise(in->fd, (off_t) (p * INPUT_ALIGN), (off_t) ((q - p) * INPUT_ALIGN), POSIX_FADV_DONTNEED);
+        p = q;
+    }
+#endif
+    in->pendlen = 0;
+}
+#endif
+
+/**
+ * Open a file for reading with the given engine.
+ * @param in
+ * @param path
+ * @param engine
+ * @return 1 on success, 0 if the file can't be opened
+ */
+int input_open(INPUT *in, const char *path, INPUT_ENGINE engine){
+    if (engine == ENGINE_AFALG || engine == ENGINE_AUTO) { engine = ENGINE_READ; }
+    memset(in, 0, sizeof(*in));
+    in->fd = -1;
+    in->engine = engine;
+#ifdef __linux__
+    in->handed = -1;
+#endif
+
+    if (engine == ENGINE_STDIO){
+        in->f = input_fopen(path);
+        in->buf = malloc(INPUT_CHUNK);
+        return in->f && in->buf;
+    }
+
+#ifdef _WIN32
+    // Only stdio is available on Windows.
+    in->engine = ENGINE_STDIO;
+    return input_open(in, path, ENGINE_STDIO);
+#else
+    int flags = O_RDONLY;
+#ifdef O_DIRECT
+    if (engine == ENGINE_DIRECT) { flags |= O_DIRECT; }
+#endif
+    int fromstdin = input_is_stdin(path);
+    // stdin keeps its own flags, so O_DIRECT is not available on it.
+    if (fromstdin && engine == ENGINE_DIRECT) { in->engine = ENGINE_READ; }
+    in->fd = fromstdin ? dup(STDIN_FILENO) : open(path, flags);
+    if (in->fd < 0 && engine == ENGINE_DIRECT && !fromstdin){
+        // tmpfs and some other file systems refuse O_DIRECT.
+        in->engine = ENGINE_READ;
+        in->fd = open(path, O_RDONLY);
+    }
+    if (in->fd < 0) { return 0; }
+
+    struct stat st;
+    if (fstat(in->fd, &st) != 0) { close(in->fd); in->fd = -1; return 0; }
+    in->size = (uint64_t) st.st_size;
+    // mmap and uring address the file from offset 0; stdin might be a pipe, or a
+    // file already partly read, so anything else reads from where it is.
+    if (fromstdin && (!S_ISREG(st.st_mode) || lseek(in->fd, 0, SEEK_CUR) != 0)) { in->engine = ENGINE_READ; }
+    // Only files read from their start are walked by extent, and uring has no
+    // extent walk of its own, so a sparse file is read instead.
+    if (S_ISREG(st.st_mode) && (!fromstdin || lseek(in->fd, 0, SEEK_CUR) == 0)){
+        in->sparse = input_fd_sparse(in->fd, in->size);
+        if (in->sparse && in->engine == ENGINE_URING) { in->engine = ENGINE_READ; }
+    }
+    // uring's reads run ahead of what has been hashed, so a scan reads with read
+    // instead; direct never fills the page cache and has nothing to drop.
+    if (stream_scan && S_ISREG(st.st_mode) && in->size > 0 && (!fromstdin || lseek(in->fd, 0, SEEK_CUR) == 0)){
+        if (in->engine == ENGINE_URING) { in->engine = ENGINE_READ; }
+        in->scan = in->engine != ENGINE_DIRECT;
+#if defined(POSIX_FADV_SEQUENTIAL) && defined(POSIX_FADV_NOREUSE)
+        if (in->scan) { posix_fadvise(in->fd, 0, 0, POSIX_FADV_SEQUENTIAL); posix_fadvise(in->fd, 0, 0, POSIX_FADV_NOREUSE); }
+#endif
+    }
+
+    if (in->scan) { input_scan_snapshot(in); }
+
+    if (in->engine == ENGINE_MMAP){
+        if (in->size == 0 || !S_ISREG(st.st_mode)) { in->engine = ENGINE_READ; }
+        else {
+            in->map = mmap(NULL, in->size, PROT_READ, MAP_PRIVATE, in->fd, 0);
+            if (in->map == MAP_FAILED) { in->map = NULL; in->engine = ENGINE_READ; }
+            else { madvise(in->map, in->size, MADV_SEQUENTIAL); return 1; }
+        }
+    }
+
+#ifdef __linux__
+    if (in->engine == ENGINE_URING){
+        int ok = S_ISREG(st.st_mode) && input_uring_setup(&in->ring, INPUT_DEPTH);
+        for (int s = 0; ok && s < INPUT_DEPTH; s++){
+            in->slotbuf[s] = malloc(INPUT_CHUNK);
+            ok = in->slotbuf[s] != NULL;
+        }
+        if (ok) { return 1; }
+        for (int s = 0; s < INPUT_DEPTH; s++){ free(in->slotbuf[s]); in->slotbuf[s] = NULL; }
+        if (in->ring.sq_ring) { input_uring_teardown(&in->ring); }
+        in->engine = ENGINE_READ;
+    }
+#else
+    if (in->engine == ENGINE_URING || in->engine == ENGINE_DIRECT) { in->engine = ENGINE_READ; }
+#endif
+
+    if (posix_memalign((void **) &in->buf, INPUT_ALIGN, INPUT_CHUNK) != 0){
+        in->buf = NULL;
+        close(in->fd);
+        in->fd = -1;
+        return 0;
+    }
+    return 1;
+#endif
+}
+
+/**
+ * The next chunk from whichever engine is in use.
+ */
+static long input_next_engine(INPUT *in, const uint8_t **data){
+    if (in->engine == ENGINE_STDIO){
+        size_t n = fread(in->buf, 1, INPUT_CHUNK, in->f);
+        *data = in->buf;
+        return n == 0 && ferror(in->f) ? -1 : (long) n;
+    }
+#ifndef _WIN32
+#ifdef SEEK_HOLE
+    if (in->sparse) { return input_next_sparse(in, data); }
+#endif
+    if (in->engine == ENGINE_MMAP){
+        uint64_t left = in->size - in->pos;
+        size_t n = left < INPUT_CHUNK ? (size_t) left : INPUT_CHUNK;
+        *data = in->map + in->pos;
+        in->pos += n;
+        return (long) n;
+    }
+#ifdef __linux__
+    if (in->engine == ENGINE_URING){
+        // The chunk handed out last time is done with, its slot can be reused.
+        if (in->handed >= 0) { in->slotbusy[in->handed] = 0; in->handed = -1; }
+        if (in->pos >= in->size) { return 0; }
+        if (!input_uring_fill(in)) { return -1; }
+        for (int s = 0; s < INPUT_DEPTH; s++){
+            if (in->slotbusy[s] == 0 || in->slotoff[s] != in->pos) { continue; }
+            if (!input_uring_wait(in, s)) { return -1; }
+            in->handed = s;
+            in->pos += in->slotwant[s];
+            if (in->slotwant[s] == 0) { in->pos = in->size; }
+            *data = in->slotbuf[s];
+            return (long) in->slotwant[s];
+        }
+        return -1;
+    }
+#endif
+    // read and direct. O_DIRECT lengths stay multiples of INPUT_ALIGN, the
+    // final short read at the end of the file is allowed.
+    size_t got = 0;
+    while (got < INPUT_CHUNK){
+        ssize_t n = read(in->fd, in->buf + got, INPUT_CHUNK - got);
+        if (n < 0) { return -1; }
+        if (n == 0) { break; }
+        got += (size_t) n;
+        if (in->engine == ENGINE_DIRECT && got % INPUT_ALIGN != 0) { break; }
+    }
+    *data = in->buf;
+    in->pos += got;
+    return (long) got;
+#else
+    return -1;
+#endif
+}
+
+/**
+ * Get the next chunk of the file.
+ * @param in
+ * @param data - receives a pointer to the bytes, valid until the next call
+ * @return the number of bytes, 0 at the end of the file, -1 on a read error
+ */
+long input_next(INPUT *in, const uint8_t **data){
+#ifndef _WIN32
+    if (in->scan){
+        // The chunk handed over last has been hashed by now.
+        input_scan_release(in);
+        uint64_t off = in->pos;
+        long n = input_next_engine(in, data);
+        // Holes come from input_zeros and have nothing to drop.
+        if (n > 0 && *data != input_zeros){
+            in->pendoff = off;
+            in->pendlen = (size_t) n;
+        }
+        return n;
+    }
+#endif
+    return input_next_engine(in, data);
+}
+
+/**
+ * Close the file and free the engine's buffers.
+ * @param in
+ */
+void input_close(INPUT *in){
+    input_fclose(in->f);
+#ifndef _WIN32
+    if (in->scan) { input_scan_release(in); }
+    free(in->cached);
+    if (in->map) { munmap(in->map, in->size); }
+#ifdef __linux__
+    if (in->engine == ENGINE_URING){
+        // Drain reads still in flight before their buffers go away.
+        for (int s = 0; s < INPUT_DEPTH; s++){ if (in->slotbusy[s] == 1) { input_uring_wait(in, s); } }
+        for (int s = 0; s < INPUT_DEPTH; s++){ free(in->slotbuf[s]); }
+        input_uring_teardown(&in->ring);
+    }
+#endif
+    if (in->fd >= 0) { close(in->fd); }
+#endif
+    free(in->buf);
+    memset(in, 0, sizeof(*in));
+    in->fd = -1;
+}
+
+#endif
@@ -0,0 +1,18 @@
+/**
+ * struct iovec for the scatter-gather updates (md5_update_iov, sha256_update_iov).
+ * POSIX has it in <sys/uio.h>; Windows gets the same two fields.
+ */
+#ifndef COMMON_IOVEC_C
+#define COMMON_IOVEC_C
+
+#ifdef _WIN32
+#include <stddef.h>
+struct iovec {
+    void *iov_base;
+    size_t iov_len;
+};
+#else
+#include <sys/uio.h>
+#endif
+
+#endif
@@ -0,0 +1,430 @@
+// Job manager: lane-level batching across independent callers.
+// David Gallagher.
+//
+// The multi-buffer kernels compress a block in each of up to JOBMGR_MAXLANES lanes
+// per call and only pay off when the lanes are full. md5_mb_hash and sha256_mb_hash
+// fill them from a batch the caller already has; a job manager fills them from
+// jobs submitted one at a time, from any thread, as isa-l_crypto's managers do.
+//
+// A manager thread owns the lanes. Submitted jobs wait in buckets by length (the
+// bit length of their block count). A free lane takes the job whose length is
+// closest to what the busy lanes have left, so lanes tend to finish together; with
+// every lane free it takes from the fullest bucket. The lanes then run until the
+// first of them finishes, which is refilled at once.
+//
+// While lanes are empty the manager waits for more jobs rather than compressing
+// with lanes idle, but only until the oldest job in the lanes has waited deadline
+// nanoseconds. Then the partial lanes run JOBMGR_SLICE blocks at a time, so new
+// jobs can still join. A job left in a bucket past the deadline jumps the length
+// rule. A caller in jobmgr_wait or jobmgr_flush cancels the wait.
+//
+// The algorithm comes in as a JOBMGR_OPS: its lane kernel, state size, IV and byte
+// order. Padding, gathering message words and the digest bytes are done here, for
+// any 64 byte block Merkle-Damgard hash with 32 bit words.
+
+#ifndef COMMON_JOBMGR_C
+#define COMMON_JOBMGR_C
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#ifndef _WIN32
+#include <pthread.h>
+#include <time.h>
+#endif
+
+#include "stats.c"
+
+#define JOBMGR_MAXLANES  8
+#define JOBMGR_CLASSES   64          // length buckets, one per bit length of the block count
+#define JOBMGR_SLICE     16          // blocks run at a time while lanes are partly empty
+#define JOBMGR_DEADLINE  50000       // default latency deadline, ns
+
+typedef struct JOBMGR_JOB JOBMGR_JOB;
+
+// Called on the manager's thread once the digest is in the job. The manager
+// doesn't touch the job after the callback returns, so the callback may free it.
+typedef void (*JOBMGR_CB)(JOBMGR_JOB *job);
+
+struct JOBMGR_JOB {
+    const uint8_t *data;
+    size_t len;
+    JOBMGR_CB cb;
+    void *user;
+    uint8_t digest[32];
+    // The manager's own.
+    JOBMGR_JOB *next;
+    uint64_t submitted;     // ns
+};
+
+typedef struct {
+    const char *name;
+    int lanes;              // at most JOBMGR_MAXLANES
+    int statewords;         // at most 8
+    int bigendian;          // words, length and digest big endian (SHA-256), else little (MD5)
+    const uint32_t *iv;
+    // Compress a block in every lane of mask; M is M[16][lanes], H is H[lanes][statewords].
+    void (*compress)(uint32_t *M, uint32_t *H, unsigned mask);
+} JOBMGR_OPS;
+
+typedef struct {
+    JOBMGR_JOB *job;
+    size_t whole;
+    size_t next;
+    size_t nblocks;
+    uint8_t tail[128];
+} JOBMGR_LANE;
+
+typedef struct {
+    const JOBMGR_OPS *ops;
+    uint64_t deadline;
+    JOBMGR_JOB *head[JOBMGR_CLASSES];
+    JOBMGR_JOB *last[JOBMGR_CLASSES];
+    int count[JOBMGR_CLASSES];
+    int pending;            // in the buckets
+    int outstanding;        // submitted and not yet called back
+    int urgent;             // callers waiting
+    int stop;
+    // The manager thread's own.
+    JOBMGR_LANE lane[JOBMGR_MAXLANES];
+    unsigned mask;
+    uint32_t M[16 * JOBMGR_MAXLANES];
+    uint32_t H[8 * JOBMGR_MAXLANES];
+    uint64_t calls;         // kernel calls
+    uint64_t laneblocks;    // blocks they compressed; laneblocks / (calls * lanes) is the fill
+#ifndef _WIN32
+    pthread_mutex_t lock;
+    pthread_cond_t work;    // jobs submitted, a caller waiting, or stop
+    pthread_cond_t done;    // callbacks returned
+    pthread_t thread;
+#endif
+} JOBMGR;
+
+static uint64_t jobmgr_now(void){
+#ifndef _WIN32
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+#else
+    return 0;
+#endif
+}
+
+static size_t jobmgr_nblocks(size_t len){
+    return len / 64 + (len % 64 < 56 ? 1 : 2);
+}
+
+static int jobmgr_class(size_t nblocks){
+    int c = 0;
+    while (nblocks >>= 1) { c++; }
+    return c;
+}
+
+static void jobmgr_lane_start(JOBMGR *m, int l, JOBMGR_JOB *job){
+    const JOBMGR_OPS *ops = m->ops;
+    JOBMGR_LANE *lane = &m->lane[l];
+    size_t rem = job->len % 64;
+    uint64_t numbits = 8ULL * job->len;
+
+    lane->job = job;
+    lane->whole = job->len / 64;
+    lane->next = 0;
+    lane->nblocks = jobmgr_nblocks(job->len);
+
+    size_t end = 64 * (lane->nblocks - lane->whole);
+    if (rem) { memcpy(lane->tail, job->data + 64 * lane->whole, rem); }
+    lane->tail[rem] = 0x80;
+    memset(lane->tail + rem + 1, 0, end - rem - 1);
+    for (int i = 0; i < 8; i++){
+        lane->tail[ops->bigendian ? end - 1 - i : end - 8 + i] = (uint8_t) (numbits >> (8 * i));
+    }
+    memcpy(m->H + l * ops->statewords, ops->iv, ops->statewords * sizeof(uint32_t));
+    m->mask |= 1u << l;
+}
+
+// Fewest blocks any busy lane has left, 0 with none busy.
+static size_t jobmgr_minleft(const JOBMGR *m){
+    size_t least = 0;
+    for (int l = 0; l < m->ops->lanes; l++){
+        if (!(m->mask & (1u << l))) { continue; }
+        size_t left = m->lane[l].nblocks - m->lane[l].next;
+        if (least == 0 || left < least) { least = left; }
+    }
+    return least;
+}
+
+/**
+ * Take a job for a free lane from the buckets; called with the lock held.
+ * @param m
+ * @param now
+ * @param want - blocks the busy lanes have left, 0 if none are busy
+ * @return the job, or NULL if there are none
+ */
+static JOBMGR_JOB *jobmgr_take(JOBMGR *m, uint64_t now, size_t want){
+    int c = -1;
+
+    if (m->pending == 0) { return NULL; }
+    // Overdue first, oldest first.
+    for (int i = 0; i < JOBMGR_CLASSES; i++){
+        if (m->head[i] && now - m->head[i]->submitted >= m->deadline
+            && (c < 0 || m->head[i]->submitted < m->head[c]->submitted)) { c = i; }
+    }
+    if (c < 0 && want == 0){
+        for (int i = 0; i < JOBMGR_CLASSES; i++){
+            if (m->count[i] && (c < 0 || m->count[i] > m->count[c])) { c = i; }
+        }
+    }
+    if (c < 0){
+        // Nearest bucket to what the busy lanes have left, the longer side first.
+        int target = jobmgr_class(want);
+        for (int d = 0; c < 0 && d < JOBMGR_CLASSES; d++){
+            if (target + d < JOBMGR_CLASSES && m->head[target + d]) { c = target + d; }
+            else if (target - d >= 0 && m->head[target - d]) { c = target - d; }
+        }
+    }
+    JOBMGR_JOB *job = m->head[c];
+    m->head[c] = job->next;
+    if (!m->head[c]) { m->last[c] = NULL; }
+    m->count[c]--;
+    m->pending--;
+    return job;
+}
+
+/**
+ * Run the busy lanes for up to steps blocks and finish the jobs that end.
+ * @param m
+ * @param steps - at most the fewest blocks any busy lane has left
+ * @param finished - receives the finished jobs, digests filled in
+ * @return how many finished
+ */
+static int jobmgr_run(JOBMGR *m, size_t steps, JOBMGR_JOB **finished){
+    const JOBMGR_OPS *ops = m->ops;
+    int nfinished = 0, n = 0;
+    STATS_TIMER(t);
+
+    for (size_t s = 0; s < steps; s++){
+        for (int l = 0; l < ops->lanes; l++){
+            if (!(m->mask & (1u << l))) { continue; }
+            JOBMGR_LANE *lane = &m->lane[l];
+            const uint8_t *p = lane->next < lane->whole
+                               ? lane->job->data + 64 * lane->next
+                               : lane->tail + 64 * (lane->next - lane->whole);
+            for (int i = 0; i < 16; i++, p += 4){
+                m->M[i * ops->lanes + l] = ops->bigendian
+                        ? (uint32_t) p[0] << 24 | (uint32_t) p[1] << 16 | (uint32_t) p[2] << 8 | p[3]
+                        : (uint32_t) p[3] << 24 | (uint32_t) p[2] << 16 | (uint32_t) p[1] << 8 | p[0];
+            }
+            n++;
+        }
+        ops->compress(m->M, m->H, m->mask);
+        m->calls++;
+
+        for (int l = 0; l < ops->lanes; l++){
+            if (!(m->mask & (1u << l)) || ++m->lane[l].next < m->lane[l].nblocks) { continue; }
+            JOBMGR_JOB *job = m->lane[l].job;
+            const uint32_t *H = m->H + l * ops->statewords;
+            for (int i = 0; i < ops->statewords; i++){
+                for (int b = 0; b < 4; b++){
+                    job->digest[4 * i + b] = (uint8_t) (H[i] >> (ops->bigendian ? 24 - 8 * b : 8 * b));
+                }
+            }
+            finished[nfinished++] = job;
+            m->mask &= ~(1u << l);
+        }
+    }
+    m->laneblocks += (uint64_t) n;
+    STATS_HASH(t, (uint64_t) n);
+    return nfinished;
+}
+
+/**
+ * A callback for jobs whose user points at an int counting the caller's
+ * unfinished jobs: it counts down, for jobmgr_wait to watch.
+ * @param job
+ */
+void jobmgr_countdown(JOBMGR_JOB *job){
+    __atomic_sub_fetch((int *) job->user, 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Share of lane slots that held a block, over the manager's life so far.
+ * @param m
+ * @return 0 to 1
+ */
+double jobmgr_fill(const JOBMGR *m){
+    return m->calls ? (double) m->laneblocks / ((double) m->calls * m->ops->lanes) : 0.0;
+}
+
+#ifndef _WIN32
+
+static void *jobmgr_thread(void *arg){
+    JOBMGR *m = (JOBMGR *) arg;
+    const JOBMGR_OPS *ops = m->ops;
+    unsigned full = (1u << ops->lanes) - 1;
+    JOBMGR_JOB *finished[JOBMGR_MAXLANES];
+
+    pthread_mutex_lock(&m->lock);
+    for (;;){
+        uint64_t now = jobmgr_now();
+        for (int l = 0; l < ops->lanes && m->pending; l++){
+            if (!(m->mask & (1u << l))) { jobmgr_lane_start(m, l, jobmgr_take(m, now, jobmgr_minleft(m))); }
+        }
+        if (m->mask == 0){
+            if (m->stop) { break; }
+            pthread_cond_wait(&m->work, &m->lock);
+            continue;
+        }
+        size_t steps = jobmgr_minleft(m);
+        if (m->mask != full){
+            // Hold partial lanes for more jobs until the oldest one in them is due.
+            uint64_t due = UINT64_MAX;
+            for (int l = 0; l < ops->lanes; l++){
+                if ((m->mask & (1u << l)) && m->lane[l].job->submitted + m->deadline < due) {
+                    due = m->lane[l].job->submitted + m->deadline;
+                }
+            }
+            if (!m->urgent && !m->stop && now < due){
+                struct timespec ts;
+                ts.tv_sec = (time_t) (due / 1000000000ULL);
+                ts.tv_nsec = (long) (due % 1000000000ULL);
+                pthread_cond_timedwait(&m->work, &m->lock, &ts);
+                continue;
+            }
+            if (steps > JOBMGR_SLICE) { steps = JOBMGR_SLICE; }
+        }
+        pthread_mutex_unlock(&m->lock);
+
+        int nfinished = jobmgr_run(m, steps, finished);
+        for (int i = 0; i < nfinished; i++){ finished[i]->cb(finished[i]); }
+
+        pthread_mutex_lock(&m->lock);
+        if (nfinished){
+            m->outstanding -= nfinished;
+            pthread_cond_broadcast(&m->done);
+        }
+    }
+    pthread_mutex_unlock(&m->lock);
+    return NULL;
+}
+
+/**
+ * Start a manager.
+ * @param m
+ * @param ops - the algorithm
+ * @param deadline - ns a job may wait for its lanes to fill, 0 for JOBMGR_DEADLINE
+ * @return 1 on success
+ */
+int jobmgr_init(JOBMGR *m, const JOBMGR_OPS *ops, uint64_t deadline){
+    pthread_condattr_t attr;
+
+    memset(m, 0, sizeof(*m));
+    m->ops = ops;
+    m->deadline = deadline ? deadline : JOBMGR_DEADLINE;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_mutex_init(&m->lock, NULL);
+    pthread_cond_init(&m->work, &attr);
+    pthread_cond_init(&m->done, NULL);
+    pthread_condattr_destroy(&attr);
+    if (pthread_create(&m->thread, NULL, jobmgr_thread, m) != 0){
+        pthread_cond_destroy(&m->done);
+        pthread_cond_destroy(&m->work);
+        pthread_mutex_destroy(&m->lock);
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * Queue a job; its callback runs on the manager's thread once it is hashed.
+ * Safe from any thread. The data must stay put until then.
+ * @param m
+ * @param job - data, len, cb and user filled in
+ */
+void jobmgr_submit(JOBMGR *m, JOBMGR_JOB *job){
+    int c = jobmgr_class(jobmgr_nblocks(job->len));
+
+    job->next = NULL;
+    pthread_mutex_lock(&m->lock);
+    job->submitted = jobmgr_now();
+    if (m->last[c]) { m->last[c]->next = job; } else { m->head[c] = job; }
+    m->last[c] = job;
+    m->count[c]++;
+    m->pending++;
+    m->outstanding++;
+    pthread_cond_signal(&m->work);
+    pthread_mutex_unlock(&m->lock);
+}
+
+/**
+ * Block until *left reaches 0, running partial lanes meanwhile instead of waiting
+ * out the deadline. left is counted down by the callbacks, e.g. jobmgr_countdown.
+ * @param m
+ * @param left
+ */
+void jobmgr_wait(JOBMGR *m, const int *left){
+    pthread_mutex_lock(&m->lock);
+    m->urgent++;
+    pthread_cond_signal(&m->work);
+    while (__atomic_load_n(left, __ATOMIC_ACQUIRE) > 0) { pthread_cond_wait(&m->done, &m->lock); }
+    m->urgent--;
+    pthread_mutex_unlock(&m->lock);
+}
+
+/**
+ * Block until every job submitted so far, by any thread, has been called back.
+ * @param m
+ */
+void jobmgr_flush(JOBMGR *m){
+    jobmgr_wait(m, &m->outstanding);
+}
+
+/**
+ * Finish every outstanding job and stop the manager.
+ * @param m
+ */
+void jobmgr_destroy(JOBMGR *m){
+    pthread_mutex_lock(&m->lock);
+    m->stop = 1;
+    pthread_cond_signal(&m->work);
+    pthread_mutex_unlock(&m->lock);
+    pthread_join(m->thread, NULL);
+    pthread_cond_destroy(&m->done);
+    pthread_cond_destroy(&m->work);
+    pthread_mutex_destroy(&m->lock);
+}
+
+#else
+
+// No manager thread: each job is hashed alone, in lane 0, as it is submitted.
+
+int jobmgr_init(JOBMGR *m, const JOBMGR_OPS *ops, uint64_t deadline){
+    memset(m, 0, sizeof(*m));
+    m->ops = ops;
+    m->deadline = deadline;
+    return 1;
+}
+
+void jobmgr_submit(JOBMGR *m, JOBMGR_JOB *job){
+    JOBMGR_JOB *finished[JOBMGR_MAXLANES];
+    jobmgr_lane_start(m, 0, job);
+    jobmgr_run(m, m->lane[0].nblocks, finished);
+    job->cb(job);
+}
+
+void jobmgr_wait(JOBMGR *m, const int *left){
+    (void) m; (void) left;
+}
+
+void jobmgr_flush(JOBMGR *m){
+    (void) m;
+}
+
+void jobmgr_destroy(JOBMGR *m){
+    (void) m;
+}
+
+#endif
+
+#endif
@@ -0,0 +1,37 @@
+/**
+ * Flags represent the states that the block reader may encounter while padding:
+ * READ   - Still reading file
+ * PAD0   - (Not enough space to complete the padding in the current block but the 1 bit has been appended already)
+ * FINISH - Padding is complete.
+ * MD5 and SHA-256 pad the same way, so both share this definition.
+ * numzerobytes_block is the padding rule the SHA block reader and the Padding tool share.
+ */
+#ifndef COMMON_PADFLAG_C
+#define COMMON_PADFLAG_C
+
+#include <stdint.h>
+
+typedef enum {READ, PAD0, FINISH} PADFLAG;
+
+/**
+ * The number of zero bytes between the 1 bit and the length field.
+ * @param nobits The number of message bits read so far; padding starts at nobits mod blockbits.
+ * @param blockbits The block size in bits (512 for MD5 and SHA-256, 1024 for SHA-384/512).
+ * @param lenbits The size of the length field (64 for MD5 and SHA-256, 128 for SHA-384/512).
+ * @return Zero bytes to add, running into one more block if the current one has no room.
+ */
+uint64_t numzerobytes_block(uint64_t nobits, uint64_t blockbits, uint64_t lenbits) {
+    uint64_t result = blockbits - (nobits % blockbits);
+
+    // If there's not enough room in the last block to perform the padding, add another block.
+    if (result < lenbits + 1) {
+        result += blockbits;
+    }
+
+    // Make space for the 8 bits and the length bits which have to be included in the padding
+    result -= 8 + lenbits;
+
+    return (result / 8ULL);
+}
+
+#endif
@@ -0,0 +1,159 @@
+// Hardware performance counters for --perf.
+// David Gallagher.
+//
+// One perf_event_open group per thread, led by cycles, counting only the calling
+// thread: instructions, L1D read misses, last level cache misses and branch misses
+// ride along and are read together with a single read() of the leader, so every
+// snapshot is consistent. Kernel time is counted too where perf_event_paranoid
+// allows it, otherwise the counters fall back to user space only (which paranoid
+// level 2, the common default, still permits).
+//
+// A counter the CPU or hypervisor doesn't offer is left out; if cycles itself
+// can't be opened there are no counters at all and perfctr_open says why.
+
+#ifndef COMMON_PERFCTR_C
+#define COMMON_PERFCTR_C
+
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+#define PERFCTR_N 5
+
+static const char *const PERFCTR_NAMES[PERFCTR_N] = {
+        "cycles", "instructions", "L1D misses", "LLC misses", "branch misses"};
+
+typedef struct {
+    int fd[PERFCTR_N];      // -1 for a counter that could not be opened
+    uint64_t id[PERFCTR_N];
+    int useronly;           // 1 if kernel time is excluded
+} PERFCTR;
+
+#ifdef __linux__
+
+#include <errno.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+static void perfctr_attr(struct perf_event_attr *attr, int i, int useronly){
+    memset(attr, 0, sizeof(*attr));
+    attr->size = sizeof(*attr);
+    attr->type = PERF_TYPE_HARDWARE;
+    switch (i){
+        case 0: attr->config = PERF_COUNT_HW_CPU_CYCLES; break;
+        case 1: attr->config = PERF_COUNT_HW_INSTRUCTIONS; break;
+        case 2:
+            attr->type = PERF_TYPE_HW_CACHE;
+            attr->config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                           | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            break;
+        case 3: attr->config = PERF_COUNT_HW_CACHE_MISSES; break;
+        default: attr->config = PERF_COUNT_HW_BRANCH_MISSES; break;
+    }
+    attr->read_format = PERF_FORMAT_GROUP | PERF_FORMAT_ID;
+    attr->disabled = i == 0;    // the group starts when the leader is enabled
+    attr->exclude_kernel = useronly;
+    attr->exclude_hv = 1;
+}
+
+static int perfctr_syscall(struct perf_event_attr *attr, int group){
+    return (int) syscall(SYS_perf_event_open, attr, 0, -1, group, 0);
+}
+
+/**
+ * Open and start the counters for the calling thread.
+ * @param p
+ * @param why - on failure, receives the reason
+ * @param whylen
+ * @return 1 if at least cycles are counting, 0 if not
+ */
+int perfctr_open(PERFCTR *p, char *why, size_t whylen){
+    struct perf_event_attr attr;
+
+    for (int i = 0; i < PERFCTR_N; i++){ p->fd[i] = -1; p->id[i] = 0; }
+    p->useronly = 0;
+    perfctr_attr(&attr, 0, 0);
+    p->fd[0] = perfctr_syscall(&attr, -1);
+    if (p->fd[0] < 0 && (errno == EACCES || errno == EPERM)){
+        p->useronly = 1;
+        perfctr_attr(&attr, 0, 1);
+        p->fd[0] = perfctr_syscall(&attr, -1);
+    }
+    if (p->fd[0] < 0){
+        int e = errno;
+        int paranoid = -99;
+        FILE *f = fopen("/proc/sys/kernel/perf_event_paranoid", "r");
+        if (f) { if (fscanf(f, "%d", &paranoid) != 1) { paranoid = -99; } fclose(f); }
+        if (e == ENOENT || e == EOPNOTSUPP) {
+            snprintf(why, whylen, "this CPU or hypervisor exposes no hardware counters (%s)", strerror(e));
+        } else if (e == EACCES || e == EPERM) {
+            snprintf(why, whylen, "perf is restricted (perf_event_paranoid is %d, or a seccomp filter denies it)", paranoid);
+        } else {
+            snprintf(why, whylen, "perf_event_open failed: %s", strerror(e));
+        }
+        return 0;
+    }
+    ioctl(p->fd[0], PERF_EVENT_IOC_ID, &p->id[0]);
+    for (int i = 1; i < PERFCTR_N; i++){
+        perfctr_attr(&attr, i, p->useronly);
+        p->fd[i] = perfctr_syscall(&attr, p->fd[0]);
+        if (p->fd[i] >= 0) { ioctl(p->fd[i], PERF_EVENT_IOC_ID, &p->id[i]); }
+    }
+    ioctl(p->fd[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(p->fd[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    return 1;
+}
+
+/**
+ * Read every counter of the group at once.
+ * @param p
+ * @param v - receives the running totals; a missing counter reads 0
+ * @return 1 on success
+ */
+int perfctr_read(const PERFCTR *p, uint64_t *v){
+    struct { uint64_t nr; struct { uint64_t value, id; } c[PERFCTR_N]; } buf;
+
+    for (int i = 0; i < PERFCTR_N; i++){ v[i] = 0; }
+    if (p->fd[0] < 0 || read(p->fd[0], &buf, sizeof(buf)) < (ssize_t) sizeof(uint64_t)) { return 0; }
+    for (uint64_t j = 0; j < buf.nr && j < PERFCTR_N; j++){
+        for (int i = 0; i < PERFCTR_N; i++){
+            if (p->fd[i] >= 0 && p->id[i] == buf.c[j].id) { v[i] = buf.c[j].value; }
+        }
+    }
+    return 1;
+}
+
+/**
+ * @param p
+ */
+void perfctr_close(PERFCTR *p){
+    for (int i = PERFCTR_N - 1; i >= 0; i--){
+        if (p->fd[i] >= 0) { close(p->fd[i]); }
+        p->fd[i] = -1;
+    }
+}
+
+#else
+
+int perfctr_open(PERFCTR *p, char *why, size_t whylen){
+    for (int i = 0; i < PERFCTR_N; i++){ p->fd[i] = -1; }
+    p->useronly = 0;
+    snprintf(why, whylen, "perf_event_open is Linux only");
+    return 0;
+}
+
+int perfctr_read(const PERFCTR *p, uint64_t *v){
+    (void) p;
+    for (int i = 0; i < PERFCTR_N; i++){ v[i] = 0; }
+    return 0;
+}
+
+void perfctr_close(PERFCTR *p){
+    (void) p;
+}
+
+#endif
+
+#endif
@@ -0,0 +1,35 @@
+// Read a whole stream into memory.
+// David Gallagher.
+
+#ifndef COMMON_READALL_C
+#define COMMON_READALL_C
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+/**
+ * Read everything left in a file into a malloc'd buffer.
+ * @param f
+ * @param len - receives the number of bytes read
+ * @return the buffer (caller frees), or NULL if memory ran out
+ */
+uint8_t *read_all(FILE *f, size_t *len){
+    size_t cap = 65536, n = 0, got;
+    uint8_t *buf = malloc(cap);
+    if (!buf) { return NULL; }
+
+    while ((got = fread(buf + n, 1, cap - n, f)) > 0){
+        n += got;
+        if (n == cap){
+            uint8_t *bigger = realloc(buf, cap * 2);
+            if (!bigger) { free(buf); return NULL; }
+            buf = bigger;
+            cap *= 2;
+        }
+    }
+    *len = n;
+    return buf;
+}
+
+#endif
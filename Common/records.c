@@ -0,0 +1,164 @@
+// Record mode: one digest per record of a stream.
+// David Gallagher.
+//
+// Records are newline terminated lines (the newline is not hashed; a last line
+// without one is still a record) or length prefixed, a 4 byte big endian length
+// followed by that many bytes. The input is read in large chunks and records are
+// hashed where they lie in the buffer, RECORDS_BATCH at a time, by a callback that
+// puts them through the tool's multi-buffer lanes. Digests go out as hex lines or
+// as raw bytes, through an output buffer written with one fwrite per RECORDS_OUTBUF.
+
+#ifndef COMMON_RECORDS_C
+#define COMMON_RECORDS_C
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "stats.c"
+
+#define RECORDS_CHUNK   (4 << 20)   // bytes read at a time, and the initial buffer size
+#define RECORDS_BATCH   4096        // records hashed per callback
+#define RECORDS_OUTBUF  (1 << 20)
+
+typedef enum {RECORDS_LINES, RECORDS_LP32} RECORDS_FORMAT;
+
+typedef struct {
+    const uint8_t *data;
+    size_t len;
+} RECORD;
+
+// Hash n records, leaving record i's digest at digests + i * digest length.
+typedef void (*RECORDS_HASH)(void *arg, const RECORD *recs, size_t n, uint8_t *digests);
+
+/**
+ * Parse a record format name.
+ * @param name - "lines" or "lp32"
+ * @param f
+ * @return 1 if known
+ */
+int records_format_parse(const char *name, RECORDS_FORMAT *f){
+    if (strcmp(name, "lines") == 0) { *f = RECORDS_LINES; return 1; }
+    if (strcmp(name, "lp32") == 0) { *f = RECORDS_LP32; return 1; }
+    return 0;
+}
+
+/**
+ * Hash a batch and append the digests to the output buffer.
+ * @return 1, or 0 on a write error
+ */
+static int records_flush(const RECORD *recs, size_t n, uint8_t *digests, size_t dlen, int binary,
+                         RECORDS_HASH fn, void *arg, uint8_t *out, size_t *outlen, FILE *outf){
+    static const char hex[] = "0123456789abcdef";
+    size_t per = binary ? dlen : 2 * dlen + 1;
+
+    if (n == 0) { return 1; }
+    STATS_TIMER(t);
+    fn(arg, recs, n, digests);
+    STATS_HASH(t, 0);
+    for (size_t i = 0; i < n; i++){
+        if (*outlen + per > RECORDS_OUTBUF){
+            if (fwrite(out, 1, *outlen, outf) != *outlen) { return 0; }
+            *outlen = 0;
+        }
+        const uint8_t *d = digests + i * dlen;
+        uint8_t *o = out + *outlen;
+        if (binary){
+            memcpy(o, d, dlen);
+        } else {
+            for (size_t j = 0; j < dlen; j++){ o[2*j] = (uint8_t) hex[d[j] >> 4]; o[2*j+1] = (uint8_t) hex[d[j] & 15]; }
+            o[2 * dlen] = '\n';
+        }
+        *outlen += per;
+    }
+    return 1;
+}
+
+/**
+ * Hash every record of in and write the digests to out, in order.
+ * @param in
+ * @param out
+ * @param format
+ * @param binary - 1 for raw digests, 0 for a hex line per record
+ * @param dlen - digest length in bytes, at most 64
+ * @param fn
+ * @param arg
+ * @return the number of records, or -1 on a read/write error or a truncated record
+ */
+int64_t records_run(FILE *in, FILE *out, RECORDS_FORMAT format, int binary, size_t dlen, RECORDS_HASH fn, void *arg){
+    size_t cap = RECORDS_CHUNK, have = 0, pos = 0, nrec = 0, outlen = 0;
+    uint8_t *buf = malloc(cap);
+    uint8_t *outbuf = malloc(RECORDS_OUTBUF);
+    uint8_t *digests = malloc((size_t) RECORDS_BATCH * 64);
+    RECORD *recs = malloc(RECORDS_BATCH * sizeof(RECORD));
+    int64_t total = 0;
+    int eof = 0, ok = 1;
+
+    if (!buf || !outbuf || !digests || !recs) { free(buf); free(outbuf); free(digests); free(recs); return -1; }
+
+    while (ok){
+        // Cut whole records out of buf[pos..have).
+        for (;;){
+            const uint8_t *p = buf + pos;
+            size_t left = have - pos, len, skip;
+            if (format == RECORDS_LINES){
+                const uint8_t *nl = memchr(p, '\n', left);
+                if (nl) { len = (size_t) (nl - p); skip = len + 1; }
+                else if (eof && left > 0) { len = left; skip = left; }
+                else { break; }
+            } else {
+                if (left < 4) { if (eof && left > 0) { ok = 0; } break; }
+                len = ((size_t) p[0] << 24) | ((size_t) p[1] << 16) | ((size_t) p[2] << 8) | p[3];
+                if (left - 4 < len) { if (eof) { ok = 0; } break; }
+                p += 4;
+                skip = len + 4;
+            }
+            recs[nrec].data = p;
+            recs[nrec].len = len;
+            pos += skip;
+            if (++nrec == RECORDS_BATCH){
+                ok = records_flush(recs, nrec, digests, dlen, binary, fn, arg, outbuf, &outlen, out);
+                total += (int64_t) nrec;
+                nrec = 0;
+                if (!ok) { break; }
+            }
+        }
+        if (!ok || (eof && pos == have)) { break; }
+
+        // Hash what is pending before the buffer moves under it, then keep the
+        // partial record and read more after it.
+        ok = records_flush(recs, nrec, digests, dlen, binary, fn, arg, outbuf, &outlen, out);
+        total += (int64_t) nrec;
+        nrec = 0;
+        if (!ok) { break; }
+        memmove(buf, buf + pos, have - pos);
+        have -= pos;
+        pos = 0;
+        if (cap - have < RECORDS_CHUNK / 2){
+            // A record longer than the buffer: grow it.
+            uint8_t *bigger = realloc(buf, 2 * cap);
+            if (!bigger) { ok = 0; break; }
+            buf = bigger;
+            cap *= 2;
+        }
+        STATS_TIMER(t);
+        size_t n = fread(buf + have, 1, cap - have, in);
+        STATS_READ(t, n);
+        have += n;
+        if (n == 0){
+            if (ferror(in)) { ok = 0; break; }
+            eof = 1;
+        }
+    }
+    if (ok){
+        ok = records_flush(recs, nrec, digests, dlen, binary, fn, arg, outbuf, &outlen, out);
+        total += (int64_t) nrec;
+    }
+    if (ok && outlen && fwrite(outbuf, 1, outlen, out) != outlen) { ok = 0; }
+    fflush(out);
+    free(buf); free(outbuf); free(digests); free(recs);
+    return ok ? total : -1;
+}
+
+#endif
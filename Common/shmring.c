@@ -0,0 +1,535 @@
+// --ring: a shared memory request ring for clients on the same host.
+// David Gallagher.
+//
+// Over --serve every byte is copied into the daemon; here it isn't. A client
+// connects to the ring's Unix socket and gets back a memfd holding a ring of
+// SHMRING_SLOTS request slots and a SHMRING_ARENA byte arena, which it maps. It
+// writes its messages into the arena itself, posts a slot naming the algorithm and
+// the arena range, and finds the digest written into that same slot.
+//
+// Each connection has its own ring with one producer (the client) and one consumer
+// (a worker thread), so neither side takes a lock: a slot goes FREE -> POSTED
+// (client) -> DONE (worker) -> FREE (client), each step a release store seen by an
+// acquire load on the other side. The worker takes runs of consecutive posted slots
+// for one algorithm, up to DAEMON_BATCH, through the tool's lanes.
+//
+// Waiting is busy-polling or futexes on the shared words. In futex mode the worker
+// spins SHMRING_SPIN times (not at all on a single CPU, where spinning only delays
+// the client), then sets sleeping and sleeps on head, which the client bumps and
+// wakes after posting; a client waiting for a digest sleeps on the slot's state
+// after counting itself in waiters. In poll mode the worker never sleeps, for the
+// shortest hand-off at the cost of a core. The worker rechecks the socket on every
+// timeout and leaves when the client has gone.
+//
+// The client decides where in the arena each message goes; the worker only checks
+// that the range lies inside it. The whole mapping is the client's to write, header
+// included, so the worker bounds ranges by SHMRING_ARENA rather than by the header's
+// arenasize, and reads each slot's fields once before trusting them.
+
+#ifndef COMMON_SHMRING_C
+#define COMMON_SHMRING_C
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "daemon.c"
+
+#define SHMRING_MAGIC    0x544f4152u    // "TOAR"
+#define SHMRING_SLOTS    1024
+#define SHMRING_ARENA    (64ULL << 20)
+#define SHMRING_SPIN     20000          // polls before the worker sleeps, in futex mode
+#define SHMRING_TIMEOUT  100            // ms between checks that the client is still there
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SHMRING_PAUSE() __builtin_ia32_pause()
+#else
+#define SHMRING_PAUSE()
+#endif
+
+enum {SHMRING_FREE = 0, SHMRING_POSTED = 1, SHMRING_DONE = 2};
+
+typedef struct {
+    uint32_t magic;
+    uint32_t nslots;
+    uint64_t arena;                     // offset of the arena in the mapping
+    uint64_t arenasize;
+    uint32_t head __attribute__ ((aligned (64)));   // slots posted, the worker's futex
+    uint32_t sleeping;                  // the worker is (about to be) asleep on head
+    uint32_t waiters __attribute__ ((aligned (64)));    // clients asleep on a slot
+} SHMRING_HDR;
+
+typedef struct {
+    uint32_t state;                     // SHMRING_FREE, POSTED or DONE; the client's futex
+    uint8_t algo;                       // DIGESTALGO
+    uint8_t status;                     // DAEMON_OK...
+    uint8_t dlen;
+    uint8_t pad;
+    uint32_t tag;
+    uint32_t pad2;
+    uint64_t offset;                    // of the message in the arena
+    uint64_t length;
+    uint8_t digest[64];
+} __attribute__ ((aligned (128))) SHMRING_SLOT;
+
+typedef struct {
+    int sock;
+    uint8_t *base;
+    size_t size;
+    SHMRING_HDR *hdr;
+    SHMRING_SLOT *slots;
+    uint8_t *arena;
+    uint32_t next;                      // client: next slot to post; worker: next to take
+} SHMRING;
+
+#ifdef __linux__
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <linux/futex.h>
+
+#ifndef F_ADD_SEALS
+#define F_ADD_SEALS   1033
+#define F_SEAL_SEAL   0x0001
+#define F_SEAL_SHRINK 0x0002
+#define F_SEAL_GROW   0x0004
+#endif
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+
+static size_t shmring_size(void){
+    return 4096 + SHMRING_SLOTS * sizeof(SHMRING_SLOT) + SHMRING_ARENA;
+}
+
+static void shmring_futex_wait(uint32_t *word, uint32_t val, int ms){
+    struct timespec ts;
+    ts.tv_sec = ms / 1000;
+    ts.tv_nsec = (long) (ms % 1000) * 1000000L;
+    syscall(SYS_futex, word, FUTEX_WAIT, val, ms >= 0 ? &ts : NULL, NULL, 0);
+}
+
+static void shmring_futex_wake(uint32_t *word){
+    syscall(SYS_futex, word, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+static int shmring_map(SHMRING *r, int fd){
+    r->size = shmring_size();
+    r->base = mmap(NULL, r->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (r->base == MAP_FAILED) { r->base = NULL; return 0; }
+    r->hdr = (SHMRING_HDR *) r->base;
+    r->slots = (SHMRING_SLOT *) (r->base + 4096);
+    r->arena = r->base + 4096 + SHMRING_SLOTS * sizeof(SHMRING_SLOT);
+    r->next = 0;
+    return 1;
+}
+
+/**
+ * Client: receive the ring's memfd from its worker.
+ * @param sock
+ * @return the fd, or -1
+ */
+static int shmring_recv_fd(int sock){
+    union { struct cmsghdr align; char b[CMSG_SPACE(sizeof(int))]; } ctl;
+    struct msghdr msg;
+    struct iovec iov;
+    char byte;
+    int fd = -1;
+
+    iov.iov_base = &byte;
+    iov.iov_len = 1;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctl.b;
+    msg.msg_controllen = sizeof(ctl.b);
+    if (recvmsg(sock, &msg, MSG_CMSG_CLOEXEC) != 1) { return -1; }
+    for (struct cmsghdr *h = CMSG_FIRSTHDR(&msg); h; h = CMSG_NXTHDR(&msg, h)){
+        if (h->cmsg_level == SOL_SOCKET && h->cmsg_type == SCM_RIGHTS) { memcpy(&fd, CMSG_DATA(h), sizeof(int)); }
+    }
+    return fd;
+}
+
+/**
+ * Client: take the ring a worker sends down sock, and map it.
+ * @param r
+ * @param sock - connected to the ring socket; r owns it from here, and closes it on failure
+ * @return 1 on success
+ */
+static int shmring_attach(SHMRING *r, int sock){
+    memset(r, 0, sizeof(*r));
+    r->sock = sock;
+    int fd = shmring_recv_fd(sock);
+    if (fd < 0 || !shmring_map(r, fd)) { goto fail; }
+    close(fd);
+    if (r->hdr->magic != SHMRING_MAGIC || r->hdr->nslots != SHMRING_SLOTS) { munmap(r->base, r->size); goto fail; }
+    return 1;
+fail:
+    if (fd >= 0) { close(fd); }
+    close(r->sock);
+    r->sock = -1;
+    return 0;
+}
+
+/**
+ * Client: connect to a ring socket and map the ring it hands over.
+ * @param r
+ * @param path
+ * @return 1 on success
+ */
+int shmring_connect(SHMRING *r, const char *path){
+    struct sockaddr_un addr;
+
+    memset(r, 0, sizeof(*r));
+    if (strlen(path) >= sizeof(addr.sun_path)) { return 0; }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, path, strlen(path) + 1);
+    int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock < 0) { r->sock = -1; return 0; }
+    if (connect(sock, (struct sockaddr *) &addr, sizeof(addr)) != 0) { close(sock); r->sock = -1; return 0; }
+    return shmring_attach(r, sock);
+}
+
+/**
+ * Client: post a message already written to the arena.
+ * @param r
+ * @param algo
+ * @param offset - of the message in r->arena
+ * @param length
+ * @param tag - the client's own, left in the slot
+ * @return the slot, or -1 if the next slot's digest hasn't been released yet
+ */
+int shmring_post(SHMRING *r, DIGESTALGO algo, uint64_t offset, uint64_t length, uint32_t tag){
+    uint32_t i = r->next % SHMRING_SLOTS;
+    SHMRING_SLOT *s = &r->slots[i];
+
+    if (__atomic_load_n(&s->state, __ATOMIC_ACQUIRE) != SHMRING_FREE) { return -1; }
+    s->algo = (uint8_t) algo;
+    s->tag = tag;
+    s->offset = offset;
+    s->length = length;
+    __atomic_store_n(&s->state, SHMRING_POSTED, __ATOMIC_RELEASE);
+    r->next++;
+    __atomic_add_fetch(&r->hdr->head, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&r->hdr->sleeping, __ATOMIC_SEQ_CST)) { shmring_futex_wake(&r->hdr->head); }
+    return (int) i;
+}
+
+/**
+ * Client: wait for a slot's digest.
+ * @param r
+ * @param slot
+ * @param spin - polls before sleeping on the futex; -1 to poll only
+ * @return the slot, status, digest and all; hand it back with shmring_release
+ */
+SHMRING_SLOT *shmring_wait(SHMRING *r, int slot, long spin){
+    SHMRING_SLOT *s = &r->slots[slot];
+    for (long i = 0; spin < 0 || i < spin; i++){
+        if (__atomic_load_n(&s->state, __ATOMIC_ACQUIRE) == SHMRING_DONE) { return s; }
+        SHMRING_PAUSE();
+    }
+    __atomic_add_fetch(&r->hdr->waiters, 1, __ATOMIC_SEQ_CST);
+    while (__atomic_load_n(&s->state, __ATOMIC_SEQ_CST) != SHMRING_DONE) {
+        shmring_futex_wait(&s->state, SHMRING_POSTED, SHMRING_TIMEOUT);
+    }
+    __atomic_sub_fetch(&r->hdr->waiters, 1, __ATOMIC_SEQ_CST);
+    return s;
+}
+
+/**
+ * Client: give a slot back once its digest has been read.
+ * @param s
+ */
+void shmring_release(SHMRING_SLOT *s){
+    __atomic_store_n(&s->state, SHMRING_FREE, __ATOMIC_RELEASE);
+}
+
+/**
+ * Client: unmap the ring and hang up, which ends its worker.
+ * @param r
+ */
+void shmring_close(SHMRING *r){
+    if (r->base) { munmap(r->base, r->size); }
+    if (r->sock >= 0) { close(r->sock); }
+    r->base = NULL;
+    r->sock = -1;
+}
+
+typedef struct {
+    SHMRING ring;
+    const DAEMON_OPS *ops;
+    int poll;
+    long spin;                          // polls before sleeping in futex mode
+    int yield;                          // one CPU: let the client run instead of spinning
+} SHMRING_WORKER;
+
+// The client has hung up.
+static int shmring_gone(int sock){
+    char b;
+    ssize_t n = recv(sock, &b, 1, MSG_DONTWAIT | MSG_PEEK);
+    return n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR);
+}
+
+/**
+ * Hash a run of posted slots, all for one algorithm, and mark them done.
+ * @param w
+ * @param first - ring index of the first
+ * @param n
+ * @param algo - as the worker read it when it found the run
+ */
+static void shmring_serve_run(SHMRING_WORKER *w, uint32_t first, int n, DIGESTALGO algo){
+    SHMRING *r = &w->ring;
+    RECORD recs[DAEMON_BATCH];
+    uint8_t digests[DAEMON_BATCH * 64];
+    int idx[DAEMON_BATCH], m = 0;
+    size_t dlen = w->ops->dlen(algo);
+
+    for (int i = 0; i < n; i++){
+        SHMRING_SLOT *s = &r->slots[(first + (uint32_t) i) % SHMRING_SLOTS];
+        // Once each: the client can rewrite the slot while it is being checked.
+        uint64_t off = __atomic_load_n(&s->offset, __ATOMIC_RELAXED);
+        uint64_t len = __atomic_load_n(&s->length, __ATOMIC_RELAXED);
+        s->dlen = 0;
+        if (dlen == 0) { s->status = DAEMON_EALGO; }
+        else if (off > SHMRING_ARENA || len > SHMRING_ARENA - off) { s->status = DAEMON_ETOOBIG; }
+        else { s->status = DAEMON_OK; recs[m].data = r->arena + off; recs[m].len = (size_t) len; idx[m++] = i; }
+    }
+    if (m) { w->ops->mem(algo, recs, (size_t) m, digests); }
+    for (int j = 0; j < m; j++){
+        SHMRING_SLOT *s = &r->slots[(first + (uint32_t) idx[j]) % SHMRING_SLOTS];
+        memcpy(s->digest, digests + (size_t) j * dlen, dlen);
+        s->dlen = (uint8_t) dlen;
+    }
+    for (int i = 0; i < n; i++){
+        __atomic_store_n(&r->slots[(first + (uint32_t) i) % SHMRING_SLOTS].state, SHMRING_DONE, __ATOMIC_SEQ_CST);
+    }
+    if (__atomic_load_n(&r->hdr->waiters, __ATOMIC_SEQ_CST)){
+        for (int i = 0; i < n; i++){ shmring_futex_wake(&r->slots[(first + (uint32_t) i) % SHMRING_SLOTS].state); }
+    }
+}
+
+static void *shmring_worker(void *arg){
+    SHMRING_WORKER *w = (SHMRING_WORKER *) arg;
+    SHMRING *r = &w->ring;
+    long idle = 0;
+
+    for (;;){
+        uint32_t first = r->next;
+        SHMRING_SLOT *s = &r->slots[first % SHMRING_SLOTS];
+        if (__atomic_load_n(&s->state, __ATOMIC_ACQUIRE) == SHMRING_POSTED){
+            // The run of posted slots for this algorithm, read once.
+            uint8_t algo = __atomic_load_n(&s->algo, __ATOMIC_RELAXED);
+            int n = 1;
+            while (n < DAEMON_BATCH){
+                SHMRING_SLOT *t = &r->slots[(first + (uint32_t) n) % SHMRING_SLOTS];
+                if (__atomic_load_n(&t->state, __ATOMIC_ACQUIRE) != SHMRING_POSTED ||
+                    __atomic_load_n(&t->algo, __ATOMIC_RELAXED) != algo) { break; }
+                n++;
+            }
+            shmring_serve_run(w, first, n, (DIGESTALGO) algo);
+            r->next += (uint32_t) n;
+            idle = 0;
+            continue;
+        }
+        if (++idle < w->spin || (w->poll && idle % (1L << 24) != 0)){
+            if (w->yield) { sched_yield(); } else { SHMRING_PAUSE(); }
+            continue;
+        }
+        if (shmring_gone(r->sock)) { break; }
+        if (w->poll) { continue; }
+        __atomic_store_n(&r->hdr->sleeping, 1, __ATOMIC_SEQ_CST);
+        uint32_t head = __atomic_load_n(&r->hdr->head, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&s->state, __ATOMIC_SEQ_CST) != SHMRING_POSTED) {
+            shmring_futex_wait(&r->hdr->head, head, SHMRING_TIMEOUT);
+        }
+        __atomic_store_n(&r->hdr->sleeping, 0, __ATOMIC_SEQ_CST);
+        idle = w->spin;
+    }
+    munmap(r->base, r->size);
+    close(r->sock);
+    free(w);
+    return NULL;
+}
+
+/**
+ * Give a new client its own ring and start a worker on it.
+ * @return 1 on success
+ */
+static int shmring_accept(int s, const DAEMON_OPS *ops, int poll){
+    SHMRING_WORKER *w = calloc(1, sizeof(SHMRING_WORKER));
+    union { struct cmsghdr align; char b[CMSG_SPACE(sizeof(int))]; } ctl;
+    struct msghdr msg;
+    struct iovec iov;
+    char byte = 'r';
+    pthread_t t;
+
+    // Sealed at its size: a client that could shrink the memfd would make the
+    // worker's next touch of the mapping a SIGBUS for the whole server.
+    int fd = (int) syscall(SYS_memfd_create, "toahash-ring", 3u /* MFD_CLOEXEC | MFD_ALLOW_SEALING */);
+    if (!w || fd < 0 || ftruncate(fd, (off_t) shmring_size()) != 0 ||
+        fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) != 0 || !shmring_map(&w->ring, fd)) { goto fail; }
+    w->ring.sock = s;
+    w->ops = ops;
+    w->poll = poll;
+    w->yield = sysconf(_SC_NPROCESSORS_ONLN) < 2;
+    w->spin = w->yield ? 1 : SHMRING_SPIN;
+    w->ring.hdr->magic = SHMRING_MAGIC;
+    w->ring.hdr->nslots = SHMRING_SLOTS;
+    w->ring.hdr->arena = (uint64_t) (w->ring.arena - w->ring.base);
+    w->ring.hdr->arenasize = SHMRING_ARENA;
+
+    iov.iov_base = &byte;
+    iov.iov_len = 1;
+    memset(&msg, 0, sizeof(msg));
+    memset(&ctl, 0, sizeof(ctl));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctl.b;
+    msg.msg_controllen = sizeof(ctl.b);
+    struct cmsghdr *h = CMSG_FIRSTHDR(&msg);
+    h->cmsg_level = SOL_SOCKET;
+    h->cmsg_type = SCM_RIGHTS;
+    h->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(h), &fd, sizeof(int));
+    if (sendmsg(s, &msg, MSG_NOSIGNAL) != 1 || pthread_create(&t, NULL, shmring_worker, w) != 0) { goto fail; }
+    pthread_detach(t);
+    close(fd);
+    return 1;
+fail:
+    if (w && w->ring.base) { munmap(w->ring.base, w->ring.size); }
+    if (fd >= 0) { close(fd); }
+    free(w);
+    close(s);
+    return 0;
+}
+
+/**
+ * Hand out rings on a Unix socket until the process is killed.
+ * @param path - the socket; a stale socket there is replaced
+ * @param ops - what the tool can hash
+ * @param poll - 1 for workers that busy-poll, 0 to sleep on a futex when idle
+ * @return 0 if the socket could not be set up
+ */
+int shmring_serve(const char *path, const DAEMON_OPS *ops, int poll){
+    struct sockaddr_un addr;
+    struct stat st;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) { fprintf(stderr, "Error: socket path %s is too long.\n", path); return 0; }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, path, strlen(path) + 1);
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode)) { unlink(path); }
+
+    int ls = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (ls < 0 || bind(ls, (struct sockaddr *) &addr, sizeof(addr)) != 0 || listen(ls, 128) != 0){
+        fprintf(stderr, "Error: could not listen on %s: %s\n", path, strerror(errno));
+        if (ls >= 0) { close(ls); }
+        return 0;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    fprintf(stderr, "Serving %s rings on %s (%d slots, %" PRIu64 " MiB arena, %s).\n",
+            ops->names, path, SHMRING_SLOTS, (uint64_t) (SHMRING_ARENA >> 20), poll ? "busy-poll" : "futex");
+
+    for (;;){
+        int s = accept4(ls, NULL, NULL, SOCK_CLOEXEC);
+        if (s < 0){
+            if (errno == EINTR || errno == ECONNABORTED || errno == EMFILE || errno == ENFILE) { continue; }
+            fprintf(stderr, "Error: accept failed: %s\n", strerror(errno));
+            close(ls);
+            return 0;
+        }
+        shmring_accept(s, ops, poll);
+    }
+}
+
+/**
+ * Post "abc" at the end of the arena and check its digest.
+ * @return 1 if it came back right
+ */
+static int shmring_check_abc(SHMRING *r, const DAEMON_OPS *ops, DIGESTALGO algo){
+    uint8_t want[64];
+    RECORD rec;
+
+    memcpy(r->arena + SHMRING_ARENA - 3, "abc", 3);
+    SHMRING_SLOT *s = shmring_wait(r, shmring_post(r, algo, SHMRING_ARENA - 3, 3, 0), 0);
+    rec.data = (const uint8_t *) "abc";
+    rec.len = 3;
+    ops->mem(algo, &rec, 1, want);
+    int ok = s->status == DAEMON_OK && s->dlen == ops->dlen(algo) && memcmp(s->digest, want, s->dlen) == 0;
+    shmring_release(s);
+    return ok;
+}
+
+/**
+ * --fuzz: rings over socket pairs with hostile clients. The first claims a huge
+ * arena in the header and posts ranges outside the real one, which the worker must
+ * refuse with DAEMON_ETOOBIG without touching them. The second tries to shrink and
+ * grow the memfd it was sent, which the seals must refuse. Each worker must then
+ * still hash an honest request.
+ * @param ops
+ * @param algo - one ops can hash
+ * @return 1 if the workers held up
+ */
+int shmring_check(const DAEMON_OPS *ops, DIGESTALGO algo){
+    static const struct { uint64_t offset, length; } bad[] = {
+        {1ULL << 40, 4096}, {SHMRING_ARENA - 1, 2}, {0, SHMRING_ARENA + 1}, {SHMRING_ARENA + 1, 0}, {UINT64_MAX, 2}
+    };
+    SHMRING r;
+    SHMRING_SLOT *s;
+    int sv[2], ok = 1;
+
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) != 0) { ok = 0; goto report; }
+    if (!shmring_accept(sv[0], ops, 0)) { close(sv[1]); ok = 0; goto report; }
+    if (!shmring_attach(&r, sv[1])) { ok = 0; goto report; }
+    r.hdr->arenasize = 1ULL << 62;
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++){
+        s = shmring_wait(&r, shmring_post(&r, algo, bad[i].offset, bad[i].length, (uint32_t) i), 0);
+        ok &= s->status == DAEMON_ETOOBIG && s->dlen == 0;
+        shmring_release(s);
+    }
+    ok &= shmring_check_abc(&r, ops, algo);
+    shmring_close(&r);
+
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) != 0) { ok = 0; goto report; }
+    if (!shmring_accept(sv[0], ops, 0)) { close(sv[1]); ok = 0; goto report; }
+    int fd = shmring_recv_fd(sv[1]);
+    memset(&r, 0, sizeof(r));
+    r.sock = sv[1];
+    if (fd < 0 || !shmring_map(&r, fd)) { ok = 0; }
+    else {
+        ok &= ftruncate(fd, 4096) != 0 && ftruncate(fd, (off_t) (2 * shmring_size())) != 0;
+        ok &= shmring_check_abc(&r, ops, algo);
+    }
+    if (fd >= 0) { close(fd); }
+    shmring_close(&r);
+report:
+    printf("%-40s %s\n", "ring with a hostile client", ok ? "ok" : "FAILED");
+    return ok;
+}
+
+#else
+
+int shmring_serve(const char *path, const DAEMON_OPS *ops, int poll){
+    (void) path; (void) ops; (void) poll;
+    fprintf(stderr, "Error: --ring needs Linux (memfd and futexes).\n");
+    return 0;
+}
+
+int shmring_check(const DAEMON_OPS *ops, DIGESTALGO algo){
+    (void) ops; (void) algo;
+    return 1;
+}
+
+#endif
+
+#endif
@@ -0,0 +1,335 @@
+// Run statistics for --stats.
+// David Gallagher.
+//
+// Says where the time of a run went: reading the input, compressing blocks, or
+// neither (waiting to be scheduled). Each thread counts into its own cache line
+// aligned slot, claimed once with an atomic increment, so counting takes no locks
+// and threads never share a line; the report sums the slots after the workers
+// are joined. The report goes to stderr, after everything else, so digests on
+// stdout are unchanged.
+//
+// --perf adds hardware counters (perfctr.c) to the same stage boundaries, so each
+// thread's cycles, instructions and misses are split between reading and
+// compressing. A snapshot is a read() of the counter group, which is cheap next
+// to a 1 MiB chunk from an input engine but not next to one 64 byte block of the
+// stdio path, so prefer --engine read or mmap when looking at IPC.
+//
+// Built only with TOA_STATS defined (the CMake option of the same name). Without
+// it every STATS_ macro is empty and stats_start just says so. With it, the
+// counters are skipped at run time unless --stats or --perf was given.
+
+#ifndef COMMON_STATS_C
+#define COMMON_STATS_C
+
+#include <stdio.h>
+#include <inttypes.h>
+
+#ifdef TOA_STATS
+
+#include <string.h>
+#include <stdlib.h>
+#include "ticks.c"
+#include "perfctr.c"
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+#define STATS_MAXTHREADS 64
+#define STATS_BUCKETS    16   // queue depth histogram, bucket b holds depths in [2^(b-1), 2^b)
+
+typedef struct {
+    uint64_t bytes;
+    uint64_t blocks;
+    uint64_t items;       // units of work taken from a queue
+    uint64_t readticks;
+    uint64_t hashticks;
+    uint64_t depth[STATS_BUCKETS];
+    PERFCTR perf;
+    int perfon;
+    uint64_t perflast[PERFCTR_N];
+    uint64_t perfstage[2][PERFCTR_N];   // [0] reading, [1] compressing
+} __attribute__ ((aligned (64))) STATS_THREAD;
+
+static STATS_THREAD stats_slots[STATS_MAXTHREADS];
+static unsigned stats_nslots;
+static int stats_enabled;
+static int stats_perf;
+static char stats_perfwhy[160];
+static __thread STATS_THREAD *stats_self;
+// Threads past STATS_MAXTHREADS count here and are left out of the report.
+static __thread STATS_THREAD stats_spare;
+
+static double stats_wall0;
+static uint64_t stats_ticks0;
+
+/**
+ * This thread's slot, claimed on first use.
+ * @return STATS_THREAD*
+ */
+static inline STATS_THREAD *stats_thread(void){
+    if (!stats_self){
+        unsigned i = __atomic_fetch_add(&stats_nslots, 1, __ATOMIC_RELAXED);
+        stats_self = i < STATS_MAXTHREADS ? &stats_slots[i] : &stats_spare;
+        if (stats_perf && i < STATS_MAXTHREADS){
+            char why[160];
+            stats_self->perfon = perfctr_open(&stats_self->perf, why, sizeof(why));
+            perfctr_read(&stats_self->perf, stats_self->perflast);
+        }
+    }
+    return stats_self;
+}
+
+/**
+ * Charge the hardware counts since the last snapshot to a stage.
+ * @param s
+ * @param stage - 0 reading, 1 compressing
+ */
+static void stats_perfcharge(STATS_THREAD *s, int stage){
+    uint64_t now[PERFCTR_N];
+    if (!perfctr_read(&s->perf, now)) { return; }
+    for (int i = 0; i < PERFCTR_N; i++){
+        s->perfstage[stage][i] += now[i] - s->perflast[i];
+        s->perflast[i] = now[i];
+    }
+}
+
+/**
+ * Start timing a stage, and with --perf take a counter snapshot so that only
+ * what follows is charged.
+ * @return the tick count
+ */
+static inline uint64_t stats_mark(void){
+    if (stats_perf){
+        STATS_THREAD *s = stats_thread();
+        if (s->perfon) { perfctr_read(&s->perf, s->perflast); }
+    }
+    return ticks_now();
+}
+
+/**
+ * Charge the time since *t to reading, with the bytes read, and restart *t.
+ * @param t
+ * @param nbytes
+ */
+static inline void stats_read(uint64_t *t, uint64_t nbytes){
+    uint64_t now = ticks_now();
+    STATS_THREAD *s = stats_thread();
+    s->readticks += now - *t;
+    s->bytes += nbytes;
+    if (s->perfon) { stats_perfcharge(s, 0); }
+    *t = now;
+}
+
+/**
+ * Charge the time since *t to hashing, with the blocks compressed, and restart *t.
+ * @param t
+ * @param nblocks
+ */
+static inline void stats_hash(uint64_t *t, uint64_t nblocks){
+    uint64_t now = ticks_now();
+    STATS_THREAD *s = stats_thread();
+    s->hashticks += now - *t;
+    s->blocks += nblocks;
+    if (s->perfon) { stats_perfcharge(s, 1); }
+    *t = now;
+}
+
+/**
+ * Count one item taken from a queue that held depth items.
+ * @param depth
+ */
+static inline void stats_item(uint64_t depth){
+    STATS_THREAD *s = stats_thread();
+    int b = 0;
+    while (depth && b < STATS_BUCKETS - 1) { depth >>= 1; b++; }
+    s->items++;
+    s->depth[b]++;
+}
+
+static double stats_seconds(uint64_t ticks, double hz){
+    return hz > 0 ? (double) ticks / hz : 0.0;
+}
+
+/**
+ * The hardware counters of every thread, per stage, with IPC and misses per KiB hashed.
+ * @param out
+ * @param nthreads
+ * @param bytes
+ */
+static void stats_perfreport(FILE *out, unsigned nthreads, uint64_t bytes){
+    uint64_t sum[2][PERFCTR_N];
+    int have[PERFCTR_N];
+    unsigned counted = 0, useronly = 0;
+    double kib = (double) bytes / 1024.0;
+
+    if (!stats_perf){
+        fprintf(out, "perf         : unavailable, %s\n", stats_perfwhy);
+        return;
+    }
+    memset(sum, 0, sizeof(sum));
+    for (int i = 0; i < PERFCTR_N; i++){ have[i] = 0; }
+    for (unsigned t = 0; t < nthreads; t++){
+        const STATS_THREAD *s = &stats_slots[t];
+        if (!s->perfon) { continue; }
+        counted++;
+        useronly |= (unsigned) s->perf.useronly;
+        for (int i = 0; i < PERFCTR_N; i++){
+            have[i] |= s->perf.fd[i] >= 0;
+            sum[0][i] += s->perfstage[0][i];
+            sum[1][i] += s->perfstage[1][i];
+        }
+    }
+    fprintf(out, "perf         : %u of %u threads counted, %s\n", counted, nthreads,
+            useronly ? "user space only" : "user and kernel");
+    if (have[0] && sum[0][0] + sum[1][0] == 0){
+        fprintf(out, "perf         : the counters never ran (the group could not be scheduled together)\n");
+        return;
+    }
+    fprintf(out, "%-18s %16s %16s\n", "", "read", "nexthash");
+    for (int i = 0; i < PERFCTR_N; i++){
+        if (!have[i]) { fprintf(out, "%-18s %16s %16s\n", PERFCTR_NAMES[i], "n/a", "n/a"); continue; }
+        fprintf(out, "%-18s %16" PRIu64 " %16" PRIu64 "\n", PERFCTR_NAMES[i], sum[0][i], sum[1][i]);
+    }
+    if (have[1]){
+        fprintf(out, "%-18s %16.3f %16.3f\n", "IPC",
+                sum[0][0] ? (double) sum[0][1] / (double) sum[0][0] : 0.0,
+                sum[1][0] ? (double) sum[1][1] / (double) sum[1][0] : 0.0);
+    }
+    for (int i = 2; i < PERFCTR_N; i++){
+        char name[32];
+        if (!have[i] || kib == 0) { continue; }
+        snprintf(name, sizeof(name), "%s/KiB", PERFCTR_NAMES[i]);
+        fprintf(out, "%-18s %16.3f %16.3f\n", name, (double) sum[0][i] / kib, (double) sum[1][i] / kib);
+    }
+}
+
+/**
+ * Print the totals, and per thread counts when more than one thread counted.
+ * @param out
+ */
+void stats_report(FILE *out){
+    uint64_t ticks1 = ticks_now();
+    double wall = ticks_seconds() - stats_wall0;
+    // Ticks per second over the whole run; exact for "ns", the TSC rate for rdtsc.
+    double hz = wall > 0 ? (double) (ticks1 - stats_ticks0) / wall : 0.0;
+    unsigned nthreads = stats_nslots < STATS_MAXTHREADS ? stats_nslots : STATS_MAXTHREADS;
+    STATS_THREAD sum;
+
+    memset(&sum, 0, sizeof(sum));
+    for (unsigned i = 0; i < nthreads; i++){
+        const STATS_THREAD *s = &stats_slots[i];
+        sum.bytes += s->bytes; sum.blocks += s->blocks; sum.items += s->items;
+        sum.readticks += s->readticks; sum.hashticks += s->hashticks;
+        for (int b = 0; b < STATS_BUCKETS; b++){ sum.depth[b] += s->depth[b]; }
+    }
+
+    fflush(stdout);
+    fprintf(out, "\n--- stats ---\n");
+    fprintf(out, "bytes        : %" PRIu64 "\n", sum.bytes);
+    fprintf(out, "blocks       : %" PRIu64 "\n", sum.blocks);
+    fprintf(out, "wall         : %.6f s\n", wall);
+#ifndef _WIN32
+    struct rusage ru;
+    memset(&ru, 0, sizeof(ru));
+    if (getrusage(RUSAGE_SELF, &ru) == 0){
+        fprintf(out, "cpu          : %.6f s user, %.6f s sys\n",
+                (double) ru.ru_utime.tv_sec + 1e-6 * (double) ru.ru_utime.tv_usec,
+                (double) ru.ru_stime.tv_sec + 1e-6 * (double) ru.ru_stime.tv_usec);
+    }
+#endif
+    fprintf(out, "read         : %.6f s\n", stats_seconds(sum.readticks, hz));
+    fprintf(out, "nexthash     : %.6f s\n", stats_seconds(sum.hashticks, hz));
+    fprintf(out, "throughput   : %.2f MB/s\n", wall > 0 ? (double) sum.bytes / wall / 1e6 : 0.0);
+    fprintf(out, "hash cost    : %.3f %s/byte\n",
+            sum.bytes ? (double) sum.hashticks / (double) sum.bytes : 0.0,
+            strcmp(TICKS_UNIT, "rdtsc") == 0 ? "cycles" : "ns");
+#ifndef _WIN32
+    // ru_maxrss is KiB on Linux.
+    fprintf(out, "peak rss     : %ld KiB\n", ru.ru_maxrss);
+#endif
+
+    if (stats_nslots > 1){
+        fprintf(out, "threads      : %u%s\n", stats_nslots,
+                stats_nslots > STATS_MAXTHREADS ? " (only the first are itemised)" : "");
+        for (unsigned i = 0; i < nthreads; i++){
+            const STATS_THREAD *s = &stats_slots[i];
+            double busy = stats_seconds(s->readticks + s->hashticks, hz);
+            fprintf(out, "thread %-5u : %" PRIu64 " bytes, %" PRIu64 " blocks, %" PRIu64 " items, "
+                         "read %.6f s, nexthash %.6f s, idle %.6f s\n",
+                    i, s->bytes, s->blocks, s->items, stats_seconds(s->readticks, hz),
+                    stats_seconds(s->hashticks, hz), wall > busy ? wall - busy : 0.0);
+        }
+    }
+    if (sum.items){
+        fprintf(out, "queue depth  :");
+        for (int b = 0; b < STATS_BUCKETS; b++){
+            if (!sum.depth[b]) { continue; }
+            if (b == 0) { fprintf(out, " [0] %" PRIu64, sum.depth[b]); }
+            else { fprintf(out, " [%" PRIu64 "+] %" PRIu64, (uint64_t) 1 << (b - 1), sum.depth[b]); }
+        }
+        fprintf(out, "\n");
+    }
+    if (stats_perf || stats_perfwhy[0]) { stats_perfreport(out, nthreads, sum.bytes); }
+}
+
+static void stats_atexit(void){
+    stats_report(stderr);
+}
+
+/**
+ * Turn the counters on and report them when the program exits. Calling it
+ * again with perf set adds the hardware counters.
+ * @param perf - 1 to open hardware counters too
+ * @return 1, or 0 if the hardware counters were asked for and are unavailable
+ */
+int stats_start(int perf){
+    if (!stats_enabled){
+        stats_enabled = 1;
+        stats_wall0 = ticks_seconds();
+        stats_ticks0 = ticks_now();
+        atexit(stats_atexit);
+    }
+    if (perf && !stats_perf && !stats_perfwhy[0]){
+        PERFCTR probe;
+        // Probe from the calling thread, so the reason is reported once rather
+        // than the workers each failing quietly.
+        if (!perfctr_open(&probe, stats_perfwhy, sizeof(stats_perfwhy))){
+            fprintf(stderr, "Warning: no hardware counters, %s; --perf reports --stats only.\n", stats_perfwhy);
+            return 0;
+        }
+        perfctr_close(&probe);
+        stats_perf = 1;
+    }
+    return 1;
+}
+
+// A tick count to charge from; declares nothing when stats are compiled out.
+#define STATS_TIMER(t)          uint64_t t = stats_enabled ? stats_mark() : 0
+#define STATS_READ(t, nbytes)   do { if (stats_enabled) { stats_read(&(t), (nbytes)); } } while (0)
+#define STATS_HASH(t, nblocks)  do { if (stats_enabled) { stats_hash(&(t), (nblocks)); } } while (0)
+#define STATS_ITEM(depth)       do { if (stats_enabled) { stats_item(depth); } } while (0)
+
+#else
+
+/**
+ * Stats are compiled out.
+ * @param perf
+ * @return 0
+ */
+int stats_start(int perf){
+    fprintf(stderr, "Warning: built without TOA_STATS, %s ignored.\n", perf ? "--perf" : "--stats");
+    return 0;
+}
+
+#define STATS_TIMER(t)
+#define STATS_READ(t, nbytes)   ((void) 0)
+#define STATS_HASH(t, nblocks)  ((void) 0)
+#define STATS_ITEM(depth)       ((void) 0)
+
+#endif
+
+// Blocks compressed for a message of len bytes with the given block size and
+// length field; a message always ends in at least one padding byte.
+#define STATS_PADBLOCKS(len, blocksize, lenbytes) (((uint64_t) (len) + (lenbytes) + (blocksize)) / (blocksize))
+
+#endif
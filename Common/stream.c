@@ -0,0 +1,40 @@
+// --scan: stream a large input without pushing everyone else out of the caches.
+// David Gallagher.
+//
+// An integrity scan reads each byte once, so caching it only costs the other
+// processes on the host their working set. With the policy on:
+// - the block loops (md5_blocks, sha256_blocks, sha512_update) prefetch
+//   STREAM_AHEAD bytes ahead with a non-temporal hint (prefetchnta on x86),
+//   which fills the line close to the core without making it a long-lived
+//   resident of the last level cache;
+// - Common/input.c drops each chunk from the page cache once it has been hashed,
+//   but only the pages that weren't already cached when the scan reached them,
+//   and unmaps it from a mapping, so a scan can't evict a neighbour's hot file
+//   and leaves the cache as it found it.
+// Non-temporal loads (movntdqa) are not used: on ordinary write-back memory, which
+// is what the page cache and mappings are, they behave as plain loads.
+
+#ifndef COMMON_STREAM_C
+#define COMMON_STREAM_C
+
+#include <stdint.h>
+
+#define STREAM_AHEAD  512   // bytes ahead of the block being compressed
+
+// Set by --scan before any input is opened.
+static int stream_scan;
+
+/**
+ * Hint that the line at p is wanted soon and only once. Never faults, so p may
+ * run past the end of the data.
+ * @param p
+ */
+static inline void stream_prefetch(const uint8_t *p){
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_prefetch(p, 0, 0);
+#else
+    (void) p;
+#endif
+}
+
+#endif
@@ -0,0 +1,314 @@
+// --tar: a digest per member of a tar archive, without extracting it.
+// David Gallagher.
+//
+// The archive is read from a file or stdin in large chunks and parsed in place:
+// 512 byte headers, member data, and padding to the next 512 byte boundary. Only
+// regular files are hashed; directories, links and devices have no data and are
+// passed over. Names come from the ustar name and prefix fields, or from a GNU
+// long name ('L') or pax ('x') path record before the header.
+//
+// A member of up to TAR_SMALL bytes that lies whole in the buffer is queued where
+// it is, and the queue goes through the tool's lanes RECORDS_BATCH at a time with
+// the same callback as --records. Larger members, and any that run past the end
+// of the buffer, are streamed through the tool's update and final as more of the
+// archive is read. Either way the data is hashed straight from the read buffer.
+// Output is "digest  member/path" per member, in archive order.
+
+#ifndef COMMON_TAR_C
+#define COMMON_TAR_C
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "records.c"
+
+#define TAR_BLOCK     512
+#define TAR_CHUNK     (4 << 20)     // bytes read at a time
+#define TAR_SMALL     (64 << 10)    // members up to here go through the lanes
+#define TAR_NAMEMAX   (64 << 10)    // longest GNU or pax name accepted
+
+// How a tool hashes a member.
+typedef struct {
+    size_t dlen;
+    RECORDS_HASH batch;     // members in the buffer, at most RECORDS_BATCH
+    void *batcharg;
+    void (*init)(void *ctx);
+    void (*update)(void *ctx, const uint8_t *data, size_t n);
+    void (*final)(void *ctx, uint8_t *digest);
+} TAR_OPS;
+
+typedef struct {
+    FILE *f;
+    uint8_t *buf;
+    size_t pos, end;
+    uint64_t skip;          // padding still to drop from the next bytes read
+    const TAR_OPS *ops;
+    RECORD *recs;           // queued members, pointing into buf
+    char **names;
+    size_t n;
+    uint8_t *digests;
+    int64_t members;
+} TAR;
+
+/**
+ * Print a digest line.
+ */
+static void tar_print(const uint8_t *digest, size_t dlen, const char *name){
+    for (size_t i = 0; i < dlen; i++){ printf("%02" PRIx8, digest[i]); }
+    printf("  %s\n", name);
+}
+
+/**
+ * Hash the queued members and print them. Must be called before buf is refilled.
+ * @param t
+ */
+static void tar_flush(TAR *t){
+    if (t->n == 0) { return; }
+    t->ops->batch(t->ops->batcharg, t->recs, t->n, t->digests);
+    for (size_t i = 0; i < t->n; i++){
+        tar_print(t->digests + i * t->ops->dlen, t->ops->dlen, t->names[i]);
+        free(t->names[i]);
+    }
+    t->members += (int64_t) t->n;
+    t->n = 0;
+}
+
+/**
+ * Make at least need bytes available at t->buf + t->pos, moving what is left to
+ * the front of the buffer. Flushes the queue first, as its records move too.
+ * @param t
+ * @param need - at most TAR_CHUNK
+ * @return 1 if there are need bytes, 0 if the archive ends first, -1 on a read error
+ */
+static int tar_fill(TAR *t, size_t need){
+    if (t->end - t->pos >= need) { return 1; }
+    tar_flush(t);
+    memmove(t->buf, t->buf + t->pos, t->end - t->pos);
+    t->end -= t->pos;
+    t->pos = 0;
+    while (t->end < need){
+        size_t got = fread(t->buf + t->end, 1, TAR_CHUNK - t->end, t->f);
+        if (got == 0) { return ferror(t->f) ? -1 : 0; }
+        if (t->skip){
+            size_t drop = t->skip < got ? (size_t) t->skip : got;
+            memmove(t->buf + t->end, t->buf + t->end + drop, got - drop);
+            got -= drop;
+            t->skip -= drop;
+        }
+        t->end += got;
+    }
+    return 1;
+}
+
+/**
+ * Step over len bytes of the archive, which may run past the buffer.
+ */
+static void tar_advance(TAR *t, uint64_t len){
+    if (len <= t->end - t->pos) { t->pos += (size_t) len; return; }
+    t->skip += len - (t->end - t->pos);
+    t->pos = t->end;
+}
+
+/**
+ * Read a numeric header field: octal, or base-256 when the top bit of the first
+ * byte is set (GNU, for sizes of 8 GiB and more).
+ */
+static uint64_t tar_number(const uint8_t *field, size_t len){
+    uint64_t v = 0;
+    if (field[0] & 0x80){
+        v = field[0] & 0x3f;
+        for (size_t i = 1; i < len; i++){ v = (v << 8) | field[i]; }
+        return v;
+    }
+    size_t i = 0;
+    while (i < len && field[i] == ' ') { i++; }
+    for (; i < len && field[i] >= '0' && field[i] <= '7'; i++){ v = (v << 3) | (uint64_t) (field[i] - '0'); }
+    return v;
+}
+
+/**
+ * Check a header's checksum: the sum of its bytes, the checksum field counted as spaces.
+ */
+static int tar_checksum_ok(const uint8_t *h){
+    uint64_t sum = 0;
+    for (int i = 0; i < TAR_BLOCK; i++){ sum += (i >= 148 && i < 156) ? ' ' : h[i]; }
+    return sum == tar_number(h + 148, 8);
+}
+
+/**
+ * Read a whole small payload (a long name or pax header) into a new string.
+ * @return the bytes, NUL terminated, or NULL
+ */
+static char *tar_payload(TAR *t, uint64_t size){
+    if (size > TAR_NAMEMAX) { return NULL; }
+    char *s = malloc((size_t) size + 1);
+    if (!s) { return NULL; }
+    size_t got = 0;
+    while (got < size){
+        if (t->pos == t->end && tar_fill(t, 1) <= 0) { free(s); return NULL; }
+        size_t take = t->end - t->pos < size - got ? t->end - t->pos : (size_t) (size - got);
+        memcpy(s + got, t->buf + t->pos, take);
+        t->pos += take;
+        got += take;
+    }
+    s[size] = '\0';
+    tar_advance(t, (TAR_BLOCK - size % TAR_BLOCK) % TAR_BLOCK);
+    return s;
+}
+
+/**
+ * Find the path record of a pax extended header ("len path=value\n" records).
+ * @return a new string, or NULL if it has none
+ */
+static char *tar_pax_path(const char *pax, size_t len){
+    size_t i = 0;
+    while (i < len){
+        size_t reclen = (size_t) strtoul(pax + i, NULL, 10);
+        if (reclen == 0 || i + reclen > len) { return NULL; }
+        const char *kv = memchr(pax + i, ' ', reclen);
+        if (kv && (size_t) (pax + i + reclen - kv) > 7 && memcmp(kv + 1, "path=", 5) == 0){
+            size_t vlen = (size_t) (pax + i + reclen - (kv + 6)) - 1;
+            char *p = malloc(vlen + 1);
+            if (p) { memcpy(p, kv + 6, vlen); p[vlen] = '\0'; }
+            return p;
+        }
+        i += reclen;
+    }
+    return NULL;
+}
+
+/**
+ * A member's name from its ustar header: prefix/name.
+ * Only the POSIX magic "ustar\0" has a prefix; the old GNU magic "ustar  " keeps
+ * access and change times where the prefix would be.
+ */
+static char *tar_header_name(const uint8_t *h){
+    size_t nlen = strnlen((const char *) h, 100);
+    size_t plen = memcmp(h + 257, "ustar\0", 6) == 0 ? strnlen((const char *) h + 345, 155) : 0;
+    char *s = malloc(plen + nlen + 2);
+    if (!s) { return NULL; }
+    if (plen){
+        memcpy(s, h + 345, plen);
+        s[plen] = '/';
+        memcpy(s + plen + 1, h, nlen);
+        s[plen + 1 + nlen] = '\0';
+    } else {
+        memcpy(s, h, nlen);
+        s[nlen] = '\0';
+    }
+    return s;
+}
+
+/**
+ * Stream a member that doesn't fit the lanes through the tool's update and final.
+ * @return 1, or 0 if the archive ends inside it
+ */
+static int tar_stream_member(TAR *t, uint64_t size, const char *name){
+    uint64_t ctx[64];
+    uint8_t digest[64];
+    tar_flush(t);
+    t->ops->init(ctx);
+    while (size > 0){
+        if (t->pos == t->end && tar_fill(t, 1) <= 0) { return 0; }
+        size_t take = t->end - t->pos < size ? t->end - t->pos : (size_t) size;
+        t->ops->update(ctx, t->buf + t->pos, take);
+        t->pos += take;
+        size -= take;
+    }
+    t->ops->final(ctx, digest);
+    tar_print(digest, t->ops->dlen, name);
+    t->members++;
+    return 1;
+}
+
+/**
+ * Hash every regular file in a tar archive and print "digest  name" for each.
+ * @param in - the archive, from its start
+ * @param ops
+ * @return the number of members hashed, or -1 if the archive is corrupt, cut
+ * short or unreadable (reported on stderr)
+ */
+int64_t tar_run(FILE *in, const TAR_OPS *ops){
+    TAR t;
+    char *longname = NULL;
+    const char *why = NULL;
+    int zeros = 0;
+
+    memset(&t, 0, sizeof(t));
+    t.f = in;
+    t.ops = ops;
+    t.buf = malloc(TAR_CHUNK);
+    t.recs = malloc(RECORDS_BATCH * sizeof(RECORD));
+    t.names = malloc(RECORDS_BATCH * sizeof(char *));
+    t.digests = malloc(RECORDS_BATCH * ops->dlen);
+    if (!t.buf || !t.recs || !t.names || !t.digests) { why = "out of memory"; goto done; }
+
+    for (;;){
+        int r = tar_fill(&t, TAR_BLOCK);
+        if (r < 0) { why = "read error"; break; }
+        // Archives should end with two zero blocks; plenty of writers stop after one, or none.
+        if (r == 0) { if (t.end - t.pos != 0 || longname) { why = "cut short"; } break; }
+        const uint8_t *h = t.buf + t.pos;
+        t.pos += TAR_BLOCK;
+
+        int zero = 1;
+        for (int i = 0; i < TAR_BLOCK && zero; i++){ zero = h[i] == 0; }
+        if (zero) { if (++zeros == 2) { break; } continue; }
+        zeros = 0;
+        if (!tar_checksum_ok(h)) { why = "bad header checksum, not a tar archive or corrupt"; break; }
+
+        uint64_t size = tar_number(h + 124, 12);
+        uint64_t padded = (size + TAR_BLOCK - 1) / TAR_BLOCK * TAR_BLOCK;
+        char type = (char) h[156];
+
+        if (type == 'L' || type == 'x'){
+            // The name of the member that follows.
+            char *s = tar_payload(&t, size);
+            if (!s) { why = "unreadable long name"; break; }
+            char *name = type == 'L' ? s : tar_pax_path(s, (size_t) size);
+            if (type == 'x') { free(s); }
+            if (name) { free(longname); longname = name; }
+            continue;
+        }
+        if (type != '0' && type != '\0' && type != '7'){
+            // Not a regular file. Hard links and the like have no data; anything
+            // else that has some (a GNU sparse file, a global pax header) is skipped.
+            if (type == 'S') { fprintf(stderr, "Warning: sparse member skipped.\n"); }
+            tar_advance(&t, padded);
+            // A GNU long link name or a global pax header leaves the pending name alone.
+            if (type != 'K' && type != 'g') { free(longname); longname = NULL; }
+            continue;
+        }
+
+        char *name = longname ? longname : tar_header_name(h);
+        longname = NULL;
+        if (!name) { why = "out of memory"; break; }
+        if (size <= TAR_SMALL && t.end - t.pos >= size){
+            t.recs[t.n].data = t.buf + t.pos;
+            t.recs[t.n].len = (size_t) size;
+            t.names[t.n++] = name;
+            tar_advance(&t, padded);
+            if (t.n == RECORDS_BATCH) { tar_flush(&t); }
+            continue;
+        }
+        int ok = tar_stream_member(&t, size, name);
+        free(name);
+        if (!ok) { why = "cut short"; break; }
+        tar_advance(&t, padded - size);
+    }
+    tar_flush(&t);
+
+done:
+    free(longname);
+    free(t.buf);
+    free(t.recs);
+    free(t.names);
+    free(t.digests);
+    fflush(stdout);
+    if (why) { fprintf(stderr, "Error: archive %s.\n", why); return -1; }
+    return t.members;
+}
+
+#endif
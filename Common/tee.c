@@ -0,0 +1,239 @@
+// --tee: pass a file or stdin through to stdout while hashing it.
+// David Gallagher.
+//
+// The bytes reach stdout without a second trip through user space; only the
+// hash reads them. Which path is taken depends on what stdin and stdout are:
+//  pipe in, pipe out  - tee(2) duplicates the input pipe's pages onto stdout,
+//                       then the same bytes are read once for the hash
+//  file in, pipe out  - the hash preads a chunk, splice(2) then moves the same
+//                       range from the page cache to stdout
+//  other in, pipe out - read into freshly mapped pages, hash them, and gift the
+//                       pages to the pipe with vmsplice(2); they are never
+//                       written again, so the reader sees exactly what was hashed
+//  anything else      - read and write (and everywhere but Linux)
+// The hash gets the stream in order, chunk by chunk, so the tool's usual
+// update and final (the padding nextBlock applies at EOF) finish it.
+// Needs Common/input.c for "-".
+
+#ifndef COMMON_TEE_C
+#define COMMON_TEE_C
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <errno.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/uio.h>
+#endif
+
+#define TEE_CHUNK (1 << 20)   // bytes per trip, and the pipe size asked for
+
+// Called with each chunk of the stream, in order.
+typedef void (*TEE_CONSUME)(void *arg, const uint8_t *data, size_t n);
+
+#ifdef _WIN32
+
+/**
+ * Copy a file or stdin ("-") to stdout, handing every chunk to consume on the way.
+ * @param path
+ * @param consume
+ * @param arg
+ * @return 1 on success, 0 if the input can't be opened or read, or stdout written
+ */
+int tee_stream(const char *path, TEE_CONSUME consume, void *arg){
+    FILE *in = input_fopen(path);
+    uint8_t *buf = malloc(TEE_CHUNK);
+    int ok = in && buf;
+    size_t n;
+    _setmode(_fileno(stdout), _O_BINARY);
+    while (ok && (n = fread(buf, 1, TEE_CHUNK, in)) > 0){
+        consume(arg, buf, n);
+        ok = fwrite(buf, 1, n, stdout) == n;
+    }
+    ok = ok && !ferror(in) && fflush(stdout) == 0;
+    input_fclose(in);
+    free(buf);
+    return ok;
+}
+
+#else
+
+/**
+ * Write all of buf.
+ * @return 1 on success, 0 on a write error
+ */
+static int tee_write_all(int fd, const uint8_t *buf, size_t n){
+    while (n > 0){
+        ssize_t w = write(fd, buf, n);
+        if (w < 0 && errno == EINTR) { continue; }
+        if (w <= 0) { return 0; }
+        buf += w; n -= (size_t) w;
+    }
+    return 1;
+}
+
+/**
+ * Read until n bytes or end of input.
+ * @return the bytes read, or -1 on a read error
+ */
+static ssize_t tee_read_full(int fd, uint8_t *buf, size_t n){
+    size_t got = 0;
+    while (got < n){
+        ssize_t r = read(fd, buf + got, n - got);
+        if (r < 0 && errno == EINTR) { continue; }
+        if (r < 0) { return -1; }
+        if (r == 0) { break; }
+        got += (size_t) r;
+    }
+    return (ssize_t) got;
+}
+
+/**
+ * The portable path: read, hash, write.
+ */
+static int tee_copy(int in, int out, TEE_CONSUME consume, void *arg){
+    uint8_t *buf = malloc(TEE_CHUNK);
+    ssize_t n;
+    if (!buf) { return 0; }
+    while ((n = tee_read_full(in, buf, TEE_CHUNK)) > 0){
+        consume(arg, buf, (size_t) n);
+        if (!tee_write_all(out, buf, (size_t) n)) { free(buf); return 0; }
+    }
+    free(buf);
+    return n == 0;
+}
+
+#ifdef __linux__
+/**
+ * Pipe to pipe: tee(2) the pages across, then read the same bytes for the hash.
+ * tee blocks until there is input and room on stdout, and returns 0 once the
+ * writer has gone and the pipe is empty.
+ */
+static int tee_pipe(int in, int out, TEE_CONSUME consume, void *arg){
+    uint8_t *buf = malloc(TEE_CHUNK);
+    if (!buf) { return 0; }
+    for (;;){
+        ssize_t n = tee(in, out, TEE_CHUNK, 0);
+        if (n < 0 && errno == EINTR) { continue; }
+        if (n < 0){
+            free(buf);
+            // A kernel or pipe that can't tee: nothing has been consumed yet.
+            return errno == EINVAL ? tee_copy(in, out, consume, arg) : 0;
+        }
+        if (n == 0) { break; }
+        // The n bytes are still in the input pipe, so this read can't come up short.
+        if (tee_read_full(in, buf, (size_t) n) != n) { free(buf); return 0; }
+        consume(arg, buf, (size_t) n);
+    }
+    free(buf);
+    return 1;
+}
+
+/**
+ * Regular file to pipe: pread a chunk for the hash, splice the same range out.
+ */
+static int tee_file(int in, int out, TEE_CONSUME consume, void *arg){
+    uint8_t *buf = malloc(TEE_CHUNK);
+    off_t off = lseek(in, 0, SEEK_CUR);
+    if (!buf) { return 0; }
+    if (off < 0) { off = 0; }
+    for (;;){
+        ssize_t n = pread(in, buf, TEE_CHUNK, off);
+        if (n < 0 && errno == EINTR) { continue; }
+        if (n <= 0) { free(buf); return n == 0; }
+        consume(arg, buf, (size_t) n);
+        loff_t at = off;
+        size_t left = (size_t) n;
+        while (left > 0){
+            ssize_t s = splice(in, &at, out, NULL, left, SPLICE_F_MORE);
+            if (s < 0 && errno == EINTR) { continue; }
+            if (s < 0 && errno == EINVAL && left == (size_t) n && at == off){
+                // The file system can't splice; write this chunk and the rest.
+                if (!tee_write_all(out, buf, (size_t) n)) { free(buf); return 0; }
+                free(buf);
+                lseek(in, off + n, SEEK_SET);
+                return tee_copy(in, out, consume, arg);
+            }
+            if (s <= 0) { free(buf); return 0; }
+            left -= (size_t) s;
+        }
+        off += n;
+    }
+}
+
+/**
+ * Anything else to pipe: read into new pages and gift them to the pipe.
+ */
+static int tee_gift(int in, int out, TEE_CONSUME consume, void *arg){
+    for (;;){
+        uint8_t *buf = mmap(NULL, TEE_CHUNK, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (buf == MAP_FAILED) { return 0; }
+        ssize_t n = tee_read_full(in, buf, TEE_CHUNK);
+        if (n <= 0) { munmap(buf, TEE_CHUNK); return n == 0; }
+        consume(arg, buf, (size_t) n);
+        struct iovec v = {buf, (size_t) n};
+        while (v.iov_len > 0){
+            ssize_t s = vmsplice(out, &v, 1, SPLICE_F_GIFT);
+            if (s < 0 && errno == EINTR) { continue; }
+            if (s <= 0) { munmap(buf, TEE_CHUNK); return 0; }
+            v.iov_base = (uint8_t *) v.iov_base + s;
+            v.iov_len -= (size_t) s;
+        }
+        // The pipe holds its own references to the pages; they are dropped here
+        // from this process only.
+        munmap(buf, TEE_CHUNK);
+    }
+}
+#endif
+
+/**
+ * Copy a file or stdin ("-") to stdout, handing every chunk to consume on the way.
+ * @param path
+ * @param consume
+ * @param arg
+ * @return 1 on success, 0 if the input can't be opened or read, or stdout written
+ */
+int tee_stream(const char *path, TEE_CONSUME consume, void *arg){
+    int in = input_is_stdin(path) ? STDIN_FILENO : open(path, O_RDONLY);
+    int out = STDOUT_FILENO;
+    struct stat ist, ost;
+    int ok;
+    if (in < 0) { return 0; }
+    // Anything already buffered in stdout would land after the stream.
+    fflush(stdout);
+    if (fstat(in, &ist) != 0 || fstat(out, &ost) != 0){
+        if (in != STDIN_FILENO) { close(in); }
+        return 0;
+    }
+#ifdef __linux__
+    if (S_ISFIFO(ost.st_mode)){
+        // Bigger pipes mean fewer trips; the default of 64 KiB is kept if refused.
+        fcntl(out, F_SETPIPE_SZ, TEE_CHUNK);
+        if (S_ISFIFO(ist.st_mode)){
+            fcntl(in, F_SETPIPE_SZ, TEE_CHUNK);
+            ok = tee_pipe(in, out, consume, arg);
+        } else if (S_ISREG(ist.st_mode)){
+            ok = tee_file(in, out, consume, arg);
+        } else {
+            ok = tee_gift(in, out, consume, arg);
+        }
+    } else
+#endif
+    {
+        ok = tee_copy(in, out, consume, arg);
+    }
+    if (in != STDIN_FILENO) { close(in); }
+    return ok;
+}
+
+#endif
+
+#endif
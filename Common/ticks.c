@@ -0,0 +1,45 @@
+// A cheap cycle counter for timing the hash kernels.
+// David Gallagher.
+//
+// rdtscp on x86 counts reference cycles at the constant TSC rate (not the current
+// core clock); elsewhere the count is nanoseconds. TICKS_UNIT names which.
+
+#ifndef COMMON_TICKS_C
+#define COMMON_TICKS_C
+
+#include <time.h>
+#include <inttypes.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define TICKS_UNIT "rdtsc"
+#else
+#define TICKS_UNIT "ns"
+#endif
+
+/**
+ * Read the counter.
+ * @return TSC cycles or nanoseconds
+ */
+static inline uint64_t ticks_now(void){
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned int aux;
+    return __rdtscp(&aux);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+#endif
+}
+
+/**
+ * Monotonic wall clock.
+ * @return seconds
+ */
+static inline double ticks_seconds(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + 1e-9 * (double) ts.tv_nsec;
+}
+
+#endif
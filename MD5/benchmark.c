@@ -0,0 +1,94 @@
+/**
+ * Kernels measured by --bench, each wrapped as a Common/bench.c callback that
+ * hashes a batch of equal sized messages.
+ */
+
+#include "../Common/bench.c"
+
+/**
+ * Scalar nexthash through the streaming API, one message at a time.
+ */
+static void bench_md5_scalar(void *arg, const uint8_t *data, size_t len, size_t nmsg){
+    MD5_CTX ctx;
+    WORD H[4];
+    (void) arg;
+    for (size_t i = 0; i < nmsg; i++){
+        md5_init(&ctx);
+        md5_update(&ctx, data + i * len, len);
+        md5_final(&ctx, H);
+    }
+}
+
+/**
+ * nexthash_lanes, MD5_LANES messages per pass.
+ */
+static void bench_md5_lanes(void *arg, const uint8_t *data, size_t len, size_t nmsg){
+    MD5_MBJOB jobs[MD5_LANES];
+    (void) arg;
+    for (size_t i = 0; i < nmsg; i++){
+        jobs[i].from = NULL;
+        jobs[i].data = data + i * len;
+        jobs[i].len = len;
+    }
+    md5_mb_hash(jobs, nmsg);
+}
+
+/**
+ * The same lanes behind the job manager: each message submitted on its own,
+ * then one wait, so the cost of the hand-off to the manager thread shows.
+ */
+static void bench_md5_jobmgr(void *arg, const uint8_t *data, size_t len, size_t nmsg){
+    JOBMGR_JOB jobs[MD5_LANES];
+    int left = (int) nmsg;
+    for (size_t i = 0; i < nmsg; i++){
+        jobs[i].data = data + i * len;
+        jobs[i].len = len;
+        jobs[i].cb = jobmgr_countdown;
+        jobs[i].user = &left;
+        jobmgr_submit((JOBMGR *) arg, &jobs[i]);
+    }
+    jobmgr_wait((JOBMGR *) arg, &left);
+}
+
+/**
+ * The fused MD5 + SHA-256 kernel behind --md5-sha256.
+ */
+static void bench_md5_sha256(void *arg, const uint8_t *data, size_t len, size_t nmsg){
+    WORD H5[4], H256[8];
+    (void) arg;
+    for (size_t i = 0; i < nmsg; i++){ md5_sha256(data + i * len, len, H5, H256); }
+}
+
+/**
+ * SHA-256 alone, for comparison with the fused kernel.
+ */
+static void bench_sha256_scalar(void *arg, const uint8_t *data, size_t len, size_t nmsg){
+    SHA256_CTX ctx;
+    WORD H[8];
+    (void) arg;
+    for (size_t i = 0; i < nmsg; i++){
+        sha256_init(&ctx);
+        sha256_update(&ctx, data + i * len, len);
+        sha256_final(&ctx, H);
+    }
+}
+
+/**
+ * Run the MD5 benchmark and print the JSON report to stdout.
+ * @param maxbytes - largest message size
+ * @return 1 on success
+ */
+int md5_bench(uint64_t maxbytes){
+    JOBMGR mgr;
+    if (!jobmgr_init(&mgr, &MD5_JOBMGR, 0)) { return 0; }
+    const BENCH_KERNEL kernels[] = {
+        { "md5_nexthash",        bench_md5_scalar,    NULL, 1,         0, 0 },
+        { "md5_nexthash_lanes",  bench_md5_lanes,     NULL, MD5_LANES, 0, 0 },
+        { "md5_jobmgr",          bench_md5_jobmgr,    &mgr, MD5_LANES, 0, 0 },
+        { "md5_sha256_fused",    bench_md5_sha256,    NULL, 1,         0, 0 },
+        { "sha256_nexthash256",  bench_sha256_scalar, NULL, 1,         0, 0 },
+    };
+    int ok = bench_run(stdout, "MD5", kernels, sizeof(kernels) / sizeof(kernels[0]), maxbytes);
+    jobmgr_destroy(&mgr);
+    return ok;
+}
@@ -19,6 +19,9 @@
 // word as 32 bit integer
 #define WORD uint32_t
 
+// Messages hashed side by side by the multi-buffer kernel
+#define MD5_LANES 8
+
 const uint32_t K[64] = {
         0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee,
         0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
@@ -3,8 +3,9 @@
  * READ   - Still reading file
  * PAD0   - (Not enough space to complete the padding in the current block but the 1 bit has been appended already)
  * FINISH - Padding is complete.
+ * Shared with SHA-256, which pads the same way.
 */
-typedef enum {READ, PAD0, FINISH} PADFLAG;
+#include "../Common/padflag.c"
 /**
  * BIG    - System is big endian
  * LITTLE - System is little endian
@@ -1,5 +1,20 @@
 #include "enums.c"
 #include "unions.c"
+#include "structs.c"
+#include "../Common/digestcache.c"
+#include "../Common/consttime.c"
+#include "../Common/readall.c"
+#include "../Common/input.c"
+#include "../Common/tee.c"
+#include "../Common/copyverify.c"
+#include "../Common/tar.c"
+#include "../Common/afalg.c"
+#include "../Common/stats.c"
+#include "../Common/iovec.c"
+#include "../Common/records.c"
+#include "../Common/jobmgr.c"
+#include "../Common/daemon.c"
+#include "../Common/shmring.c"
 
 #define ROTATE_LEFT(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
 #define F(x, y, z) ((x & y) | (~x & z))
@@ -17,9 +32,48 @@ int is_big_endian(void);
 void go_to_sleep(int miliseconds);
 void nexthash(union BLOCK *M, WORD *H);
 int nextBlock(union BLOCK *M, FILE *inFile, uint64_t *numbits, PADFLAG *status);
+void md5_init(MD5_CTX *ctx);
+void md5_init_midstate(MD5_CTX *ctx, const MD5_MIDSTATE *ms);
+void md5_blocks(WORD *H, const uint8_t *data, size_t n);
+void md5_update(MD5_CTX *ctx, const uint8_t *data, size_t len);
+void md5_update_iov(MD5_CTX *ctx, const struct iovec *iov, size_t n);
+void md5_final(MD5_CTX *ctx, WORD *H);
+int md5_export_midstate(const MD5_CTX *ctx, MD5_MIDSTATE *ms);
+int md5_midstate(const uint8_t *prefix, size_t len, MD5_MIDSTATE *ms);
+int md5_midstate_file(FILE *f, MD5_MIDSTATE *ms);
+void md5_midstate_format(const MD5_MIDSTATE *ms, char *out, size_t outlen);
+int md5_midstate_parse(const char *c, MD5_MIDSTATE *ms);
+void md5_stream(FILE *f, const MD5_MIDSTATE *ms, WORD *H);
+char* md5_hex(const WORD *H);
+void md5_digest_bytes(const WORD *H, uint8_t *out);
+char* bytes_hex(const uint8_t *bytes, size_t n);
+int hex_decode(const char *hex, uint8_t *out, size_t outlen);
 char* md5_file(FILE *f);
+char* md5_file_from(FILE *f, const MD5_MIDSTATE *ms);
+int md5_path(const char *path, INPUT_ENGINE engine, const MD5_MIDSTATE *ms, WORD *H);
+char* md5_file_cached(char* path, DIGESTCACHE *cache, INPUT_ENGINE engine);
 int string_to_file(char* c);
 void run_all_tests();
 void menu_no_args();
 FILE * getFile(char* c);
 void run_hash_comparison_test(int testID, char* testFile, const char *expected);
+void nexthash_lanes(WORD M[16][MD5_LANES], WORD H[MD5_LANES][4], unsigned mask);
+void md5_mb_hash(MD5_MBJOB *jobs, size_t n);
+void hmac_md5_key(HMAC_MD5_KEY *k, const uint8_t *key, size_t keylen);
+void hmac_md5_outer(const HMAC_MD5_KEY *k, const WORD *innerH, uint8_t *tag);
+void hmac_md5(const HMAC_MD5_KEY *k, const uint8_t *msg, size_t len, uint8_t *tag);
+int hmac_md5_verify(const HMAC_MD5_KEY *k, const uint8_t *msg, size_t len, const uint8_t *tag, size_t taglen);
+void hmac_md5_verify_batch(HMAC_MD5_VERIFYJOB *jobs, size_t n);
+char* hmac_md5_file(FILE *f, const HMAC_MD5_KEY *k);
+int hmac_verify_manifest(const char *manifest);
+void nexthash_md5_sha256(const uint8_t *block, WORD *H5, WORD *H256);
+void md5_sha256(const uint8_t *data, size_t len, WORD *H5, WORD *H256);
+int md5_sha256_stream(FILE *f, WORD *H5, WORD *H256);
+int md5_bench(uint64_t maxbytes);
+int md5_fuzz(uint64_t maxbytes, uint64_t nrandom);
+int md5_records(const char *path, RECORDS_FORMAT format, int raw);
+int md5_serve(const char *path);
+int md5_ring(const char *path, int poll);
+int md5_tee(const char *path, const MD5_MIDSTATE *ms, const HMAC_MD5_KEY *hmac);
+int md5_copy(char **paths, int n, INPUT_ENGINE engine);
+int md5_tar(const char *path);
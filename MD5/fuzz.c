@@ -0,0 +1,282 @@
+/**
+ * --fuzz: every MD5 kernel and input engine against the reference nexthash
+ * (Common/fuzz.c), after the RFC 1321 known answers.
+ */
+
+#include "../Common/fuzz.c"
+
+// Messages batched with the case in the lanes, so they are out of step.
+#define MD5_FUZZ_JOBS (MD5_LANES + 3)
+
+/**
+ * Reference MD5: RFC 1321 padding done in memory, then nexthash on each block.
+ * Shares nothing with md5_update, nextBlock or padtail.
+ * @param data
+ * @param len
+ * @param H - receives the four state words
+ */
+static void md5_reference(const uint8_t *data, size_t len, WORD *H){
+    union BLOCK M;
+    uint8_t tail[128];
+    size_t whole = len - len % 64, rem = len % 64;
+    size_t n = rem < 56 ? 64 : 128;
+    uint64_t bits = 8ULL * len;
+
+    H[0] = 0x67452301; H[1] = 0xefcdab89; H[2] = 0x98badcfe; H[3] = 0x10325476;
+    for (size_t i = 0; i < whole; i += 64){
+        memcpy(M.eight, data + i, 64);
+        nexthash(&M, H);
+    }
+    memset(tail, 0, sizeof(tail));
+    memcpy(tail, data + whole, rem);
+    tail[rem] = 0x80;
+    for (int i = 0; i < 8; i++){ tail[n - 8 + i] = (uint8_t) (bits >> (8 * i)); }
+    for (size_t i = 0; i < n; i += 64){
+        memcpy(M.eight, tail + i, 64);
+        nexthash(&M, H);
+    }
+}
+
+/**
+ * Record a disagreement.
+ * @return 1 if got matches want
+ */
+static int md5_fuzz_same(const char *kernel, const WORD *want, const WORD *got, char *why, size_t whylen){
+    if (memcmp(want, got, 4 * sizeof(WORD)) == 0) { return 1; }
+    snprintf(why, whylen, "%s gave %08" PRIx32 "%08" PRIx32 "%08" PRIx32 "%08" PRIx32
+                          ", nexthash gave %08" PRIx32 "%08" PRIx32 "%08" PRIx32 "%08" PRIx32,
+             kernel, got[0], got[1], got[2], got[3], want[0], want[1], want[2], want[3]);
+    return 0;
+}
+
+/**
+ * Hash one case every way the tool can and compare with the reference.
+ * @param arg - the JOBMGR
+ * @return comparisons made, or -1 on a mismatch
+ */
+static int md5_fuzz_check(void *arg, const FUZZ_CASE *c, char *why, size_t whylen){
+    WORD ref[4], got[4];
+    MD5_CTX ctx;
+    uint64_t s = c->seed;
+    int n = 0;
+
+#define MD5_FUZZ_SAME(kernel, want, have) do { \
+        if (!md5_fuzz_same(kernel, want, have, why, whylen)) { return -1; } n++; } while (0)
+
+    md5_reference(c->data, c->len, ref);
+
+    // The streaming API, in one call and then in up to eight pieces of any size.
+    md5_init(&ctx);
+    md5_update(&ctx, c->data, c->len);
+    md5_final(&ctx, got);
+    MD5_FUZZ_SAME("md5_update", ref, got);
+
+    md5_init(&ctx);
+    size_t done = 0;
+    for (int piece = 0; piece < 7 && done < c->len; piece++){
+        size_t left = c->len - done;
+        size_t take = (size_t) (fuzz_rand(&s) % (fuzz_rand(&s) & 1 ? 130 : left + 1));
+        if (take > left) { take = left; }
+        md5_update(&ctx, c->data + done, take);
+        done += take;
+    }
+    md5_update(&ctx, c->data + done, c->len - done);
+    md5_final(&ctx, got);
+    MD5_FUZZ_SAME("md5_update (split)", ref, got);
+
+    // The same kind of pieces as one scatter-gather chain, empty segments included.
+    {
+        struct iovec iov[8];
+        size_t nseg = 0;
+        done = 0;
+        while (nseg < 7){
+            size_t left = c->len - done;
+            size_t take = (size_t) (fuzz_rand(&s) % (fuzz_rand(&s) & 1 ? 130 : left + 1));
+            if (take > left) { take = left; }
+            iov[nseg].iov_base = (void *) (c->data + done);
+            iov[nseg++].iov_len = take;
+            done += take;
+        }
+        iov[nseg].iov_base = (void *) (c->data + done);
+        iov[nseg++].iov_len = c->len - done;
+        md5_init(&ctx);
+        md5_update_iov(&ctx, iov, nseg);
+        md5_final(&ctx, got);
+        MD5_FUZZ_SAME("md5_update_iov", ref, got);
+    }
+
+    // Continuing from the midstate of a block-aligned prefix.
+    if (c->len >= 64){
+        MD5_MIDSTATE ms;
+        size_t prefix = 64 * (size_t) (fuzz_rand(&s) % (c->len / 64) + 1);
+        md5_midstate(c->data, prefix, &ms);
+        md5_init_midstate(&ctx, &ms);
+        md5_update(&ctx, c->data + prefix, c->len - prefix);
+        md5_final(&ctx, got);
+        MD5_FUZZ_SAME("md5_init_midstate", ref, got);
+    }
+
+    // The lanes, with shorter messages from inside the case in the other lanes
+    // and more jobs than lanes, so lanes finish at different blocks and refill.
+    {
+        MD5_MBJOB jobs[MD5_FUZZ_JOBS];
+        size_t cap = c->len < 2048 ? c->len : 2048;
+        jobs[0].from = NULL; jobs[0].data = c->data; jobs[0].len = c->len;
+        for (int j = 1; j < MD5_FUZZ_JOBS; j++){
+            size_t off = (size_t) (fuzz_rand(&s) % (cap + 1));
+            jobs[j].from = NULL;
+            jobs[j].data = c->data + off;
+            jobs[j].len = (size_t) (fuzz_rand(&s) % (cap - off + 1));
+        }
+        md5_mb_hash(jobs, MD5_FUZZ_JOBS);
+        MD5_FUZZ_SAME("nexthash_lanes", ref, jobs[0].H);
+        for (int j = 1; j < MD5_FUZZ_JOBS; j++){
+            md5_reference(jobs[j].data, jobs[j].len, got);
+            MD5_FUZZ_SAME("nexthash_lanes (neighbour)", got, jobs[j].H);
+        }
+    }
+
+    // The job manager: the case and its neighbours submitted one by one, waited on
+    // together, sharing the lanes with whatever the other fuzz threads submit.
+    {
+        JOBMGR_JOB jobs[MD5_FUZZ_JOBS];
+        uint8_t want[16];
+        size_t cap = c->len < 2048 ? c->len : 2048;
+        int left = MD5_FUZZ_JOBS;
+        for (int j = 0; j < MD5_FUZZ_JOBS; j++){
+            size_t off = j ? (size_t) (fuzz_rand(&s) % (cap + 1)) : 0;
+            jobs[j].data = c->data + off;
+            jobs[j].len = j ? (size_t) (fuzz_rand(&s) % (cap - off + 1)) : c->len;
+            jobs[j].cb = jobmgr_countdown;
+            jobs[j].user = &left;
+            jobmgr_submit((JOBMGR *) arg, &jobs[j]);
+        }
+        jobmgr_wait((JOBMGR *) arg, &left);
+        for (int j = 0; j < MD5_FUZZ_JOBS; j++){
+            md5_reference(jobs[j].data, jobs[j].len, got);
+            md5_digest_bytes(got, want);
+            if (memcmp(want, jobs[j].digest, 16) != 0){
+                snprintf(why, whylen, "jobmgr disagrees with nexthash on a %zu byte job", jobs[j].len);
+                return -1;
+            }
+            n++;
+        }
+    }
+
+    // The fused kernel; its SHA-256 half is fuzzed against SHA-256's own reference
+    // by FinalSHA256 --fuzz, here it only has to agree with sha256_update.
+    {
+        WORD H256[8], want256[8];
+        SHA256_CTX sha;
+        md5_sha256(c->data, c->len, got, H256);
+        MD5_FUZZ_SAME("nexthash_md5_sha256", ref, got);
+        sha256_init(&sha);
+        sha256_update(&sha, c->data, c->len);
+        sha256_final(&sha, want256);
+        if (memcmp(H256, want256, sizeof(H256)) != 0){
+            snprintf(why, whylen, "nexthash_md5_sha256 SHA-256 half disagrees with sha256_update");
+            return -1;
+        }
+        n++;
+    }
+
+    // From a file: nextBlock over stdio, the fused stream, every input engine and
+    // the kernel's MD5 through AF_ALG.
+    if (c->files){
+        char path[4096];
+        if (!fuzz_tempfile(c->data, c->len, path, sizeof(path))){
+            snprintf(why, whylen, "could not write a temporary file");
+            return -1;
+        }
+        FILE *f = fopen(path, "rb");
+        int ok = f != NULL;
+        if (f){
+            WORD H256[8];
+            md5_stream(f, NULL, got);
+            ok = md5_fuzz_same("nextBlock (stdio)", ref, got, why, whylen);
+            rewind(f);
+            if (ok) { ok = md5_sha256_stream(f, got, H256) && md5_fuzz_same("md5_sha256_stream", ref, got, why, whylen); }
+            fclose(f);
+            n += 2;
+        }
+        for (int e = ENGINE_READ; ok && e <= ENGINE_AFALG; e++){
+            char kernel[64];
+            snprintf(kernel, sizeof(kernel), "--engine %s", INPUT_ENGINE_NAMES[e]);
+            ok = md5_path(path, (INPUT_ENGINE) e, NULL, got) && md5_fuzz_same(kernel, ref, got, why, whylen);
+            n++;
+        }
+        remove(path);
+        if (!ok) { if (!why[0]) { snprintf(why, whylen, "could not read back %s", path); } return -1; }
+    }
+#undef MD5_FUZZ_SAME
+    return n;
+}
+
+/**
+ * The RFC 1321 test suite and the million 'a' message, through the reference.
+ * @return the number that failed
+ */
+static int md5_fuzz_kat(void){
+    static const char *const suite[7] = {
+            "", "a", "abc", "message digest", "abcdefghijklmnopqrstuvwxyz",
+            "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789",
+            "12345678901234567890123456789012345678901234567890123456789012345678901234567890"};
+    WORD H[4];
+    uint8_t digest[16];
+    char name[64];
+    int failed = 0;
+
+    for (int i = 0; i < 7; i++){
+        md5_reference((const uint8_t *) suite[i], strlen(suite[i]), H);
+        md5_digest_bytes(H, digest);
+        snprintf(name, sizeof(name), "RFC 1321 test %d", i);
+        failed += !fuzz_kat(name, digest, 16, MD5_Test_Outputs[i]);
+    }
+    uint8_t *a = malloc(1000000);
+    if (a){
+        memset(a, 'a', 1000000);
+        md5_reference(a, 1000000, H);
+        md5_digest_bytes(H, digest);
+        failed += !fuzz_kat("one million 'a'", digest, 16, "7707d6ae4e027c70eea2a935c2296f21");
+        free(a);
+    }
+
+    // RFC 2202 HMAC-MD5 test 2, then truncated tags: down to HMAC_MD5_MINTAG bytes
+    // they verify, below it they don't, singly or in a batch.
+    static const char hmsg[] = "what do ya want for nothing?";
+    HMAC_MD5_KEY key;
+    HMAC_MD5_VERIFYJOB job;
+    hmac_md5_key(&key, (const uint8_t *) "Jefe", 4);
+    hmac_md5(&key, (const uint8_t *) hmsg, strlen(hmsg), digest);
+    failed += !fuzz_kat("RFC 2202 HMAC-MD5 test 2", digest, 16, "750c783e6ab0b503eaa86e310a5db738");
+    int ok = 1;
+    for (size_t taglen = 0; taglen <= 16; taglen++){
+        int want = taglen >= HMAC_MD5_MINTAG;
+        job.key = &key;
+        job.msg = (const uint8_t *) hmsg;
+        job.len = strlen(hmsg);
+        job.tag = digest;
+        job.taglen = taglen;
+        hmac_md5_verify_batch(&job, 1);
+        ok &= hmac_md5_verify(&key, job.msg, job.len, digest, taglen) == want && job.ok == want;
+    }
+    printf("%-40s %s\n", "HMAC-MD5 tags shorter than 10 refused", ok ? "ok" : "FAILED");
+    failed += !ok;
+    return failed;
+}
+
+/**
+ * --fuzz: known answers, then the differential run.
+ * @param maxbytes - largest random length
+ * @param nrandom - number of random lengths
+ * @return 1 if everything agreed
+ */
+int md5_fuzz(uint64_t maxbytes, uint64_t nrandom){
+    JOBMGR mgr;
+    int failed = md5_fuzz_kat();
+    if (!afalg_available("md5")) { printf("AF_ALG md5 unavailable, --engine afalg reads instead\n"); }
+    if (!jobmgr_init(&mgr, &MD5_JOBMGR, 0)) { printf("Error: could not start the job manager.\n"); return 0; }
+    int64_t mismatches = fuzz_run("md5", md5_fuzz_check, &mgr, maxbytes, nrandom, 0);
+    jobmgr_destroy(&mgr);
+    return failed == 0 && mismatches == 0;
+}
@@ -0,0 +1,123 @@
+/**
+ * HMAC-MD5, https://tools.ietf.org/html/rfc2104
+ * The key only ever affects the first block of the inner and outer hashes,
+ * (K ^ ipad) and (K ^ opad), so both are compressed once per key and kept as
+ * midstates. Each message then costs its own blocks plus one outer block.
+ */
+
+#define HMAC_IPAD 0x36
+#define HMAC_OPAD 0x5c
+#define HMAC_BATCH 64
+#define HMAC_MD5_MINTAG 10      // RFC 2104 section 5: half the output, and at least 80 bits
+
+/**
+ * Prepare a key. Keys longer than a block are hashed first (RFC 2104 section 2).
+ * @param k
+ * @param key
+ * @param keylen
+ */
+void hmac_md5_key(HMAC_MD5_KEY *k, const uint8_t *key, size_t keylen){
+    uint8_t K0[64], pad[64];
+    WORD H[4];
+    MD5_CTX ctx;
+
+    memset(K0, 0, sizeof(K0));
+    if (keylen > 64){
+        md5_init(&ctx);
+        md5_update(&ctx, key, keylen);
+        md5_final(&ctx, H);
+        md5_digest_bytes(H, K0);
+    } else {
+        memcpy(K0, key, keylen);
+    }
+
+    for (int i = 0; i < 64; i++){ pad[i] = K0[i] ^ HMAC_IPAD; }
+    md5_midstate(pad, 64, &k->inner);
+    for (int i = 0; i < 64; i++){ pad[i] = K0[i] ^ HMAC_OPAD; }
+    md5_midstate(pad, 64, &k->outer);
+}
+
+/**
+ * Finish an HMAC from the state of the inner hash, (K ^ ipad) || message.
+ * @param k
+ * @param innerH
+ * @param tag - receives 16 bytes
+ */
+void hmac_md5_outer(const HMAC_MD5_KEY *k, const WORD *innerH, uint8_t *tag){
+    MD5_CTX ctx;
+    WORD H[4];
+    uint8_t inner[16];
+
+    md5_digest_bytes(innerH, inner);
+    md5_init_midstate(&ctx, &k->outer);
+    md5_update(&ctx, inner, sizeof(inner));
+    md5_final(&ctx, H);
+    md5_digest_bytes(H, tag);
+}
+
+/**
+ * HMAC-MD5 of a message in memory.
+ * @param k
+ * @param msg
+ * @param len
+ * @param tag - receives 16 bytes
+ */
+void hmac_md5(const HMAC_MD5_KEY *k, const uint8_t *msg, size_t len, uint8_t *tag){
+    MD5_CTX ctx;
+    WORD H[4];
+
+    md5_init_midstate(&ctx, &k->inner);
+    md5_update(&ctx, msg, len);
+    md5_final(&ctx, H);
+    hmac_md5_outer(k, H, tag);
+}
+
+/**
+ * Check a (possibly truncated) tag in constant time.
+ * @return 1 if the tag is right and at least HMAC_MD5_MINTAG bytes long
+ */
+int hmac_md5_verify(const HMAC_MD5_KEY *k, const uint8_t *msg, size_t len, const uint8_t *tag, size_t taglen){
+    uint8_t expected[16];
+    if (taglen < HMAC_MD5_MINTAG || taglen > sizeof(expected)) { return 0; }
+    hmac_md5(k, msg, len, expected);
+    return consttime_equal(expected, tag, taglen);
+}
+
+/**
+ * Verify many tuples at once. The inner hashes of a group go through the
+ * multi-buffer lanes together, then the outer hashes do the same.
+ * @param jobs - ok is filled in for each
+ * @param n
+ */
+void hmac_md5_verify_batch(HMAC_MD5_VERIFYJOB *jobs, size_t n){
+    MD5_MBJOB mb[HMAC_BATCH];
+    uint8_t inner[HMAC_BATCH][16];
+    uint8_t expected[16];
+
+    for (size_t base = 0; base < n; base += HMAC_BATCH){
+        size_t count = n - base < HMAC_BATCH ? n - base : HMAC_BATCH;
+        size_t i;
+
+        for (i = 0; i < count; i++){
+            mb[i].from = &jobs[base + i].key->inner;
+            mb[i].data = jobs[base + i].msg;
+            mb[i].len = jobs[base + i].len;
+        }
+        md5_mb_hash(mb, count);
+
+        for (i = 0; i < count; i++){
+            md5_digest_bytes(mb[i].H, inner[i]);
+            mb[i].from = &jobs[base + i].key->outer;
+            mb[i].data = inner[i];
+            mb[i].len = 16;
+        }
+        md5_mb_hash(mb, count);
+
+        for (i = 0; i < count; i++){
+            HMAC_MD5_VERIFYJOB *job = &jobs[base + i];
+            md5_digest_bytes(mb[i].H, expected);
+            job->ok = job->taglen >= HMAC_MD5_MINTAG && job->taglen <= sizeof(expected)
+                      && consttime_equal(expected, job->tag, job->taglen);
+        }
+    }
+}
@@ -16,6 +16,11 @@
 // Custom
 #include "constants.c"
 #include "functions.c"
+#include "multibuffer.c"
+#include "hmac.c"
+#include "multidigest.c"
+#include "benchmark.c"
+#include "fuzz.c"
 
 ///**
 // * Put the system to sleep
@@ -183,6 +188,7 @@ int nextBlock(union BLOCK *M, FILE *inFile, uint64_t *numbits, PADFLAG *status)
         M->sixfour[7] = *numbits;
         // Set padding status to FINISH
         *status = FINISH;
+        return 1;
     }
 
     // Read in 64 * 1 byte items from infile and store in M.eight
@@ -238,7 +244,28 @@ void menu_no_args(){
     printf("--check-endian                   --> Check system endianness.\n");
     printf("--version                        --> Check current version.\n");
     printf("--string 'type your string'      --> Type an input to hash.\n");
-    printf("--file path/to/file.extension    --> Return the MD5 hash of file input.\n");
+    printf("--file path/to/file.extension    --> Return the MD5 hash of file input ('-' for stdin).\n");
+    printf("--cache-compact path/to/cache    --> Compact a digest cache file.\n");
+    printf("--midstate path/to/prefix        --> Print the state after a block-aligned prefix.\n");
+    printf("--hmac-verify path/to/manifest   --> Batch verify 'key hextag path' lines.\n");
+    printf("--md5-sha256 path/to/file        --> MD5 and SHA-256 of a file in one pass.\n");
+    printf("--bench [max size, e.g. 1G]      --> Print cycles/byte of each kernel as JSON.\n");
+    printf("--fuzz [max size] [cases]        --> Check every kernel and engine against nexthash.\n");
+    printf("--records lines|lp32 path|-      --> MD5 of every line or length prefixed record.\n");
+    printf("--serve path/to/socket           --> Serve MD5 and SHA-256 requests on a Unix socket.\n");
+    printf("--ring path [poll|futex]         --> Shared memory request rings for local clients.\n");
+    printf("--tee path|-                     --> Copy the input to stdout, its MD5 to stderr.\n");
+    printf("--copy src... dst                --> Copy files, hashing once, and verify each copy.\n");
+    printf("--tar path|-                     --> MD5 of every file in a tar archive, unextracted.\n\n");
+    printf("The following options may be given before a command:\n");
+    printf("--cache path/to/cache            --> Reuse digests of unchanged files from this cache.\n");
+    printf("--from-midstate state            --> Hash the input as the rest of a --midstate prefix.\n");
+    printf("--hmac key                       --> Print the HMAC-MD5 of the input under key.\n");
+    printf("--engine stdio|read|mmap|direct|uring|afalg|auto --> How --file reads the file (default stdio).\n");
+    printf("--stats                          --> Report bytes, read vs hash time, MB/s and peak RSS on stderr.\n");
+    printf("--perf                           --> As --stats, plus IPC and cache/branch misses per stage.\n");
+    printf("--raw                            --> --records writes 16 raw bytes per record, not hex lines.\n");
+    printf("--scan                           --> Stream without polluting the CPU and page caches.\n");
 }
 
 /**
@@ -292,66 +319,676 @@ void run_hash_comparison_test(int testID, char* testFile, const char *expected){
 }
 
 /**
- * Take file input from command line.
- * Process file
+ * Start a streaming MD5 from the RFC 1321 initial state.
+ * @param ctx
+ */
+void md5_init(MD5_CTX *ctx){
+    ctx->H[0] = 0x67452301; ctx->H[1] = 0xefcdab89; ctx->H[2] = 0x98badcfe; ctx->H[3] = 0x10325476;
+    ctx->numbits = 0;
+    ctx->buflen = 0;
+}
+
+/**
+ * Start a streaming MD5 from a midstate, as if its prefix had already been absorbed.
+ * @param ctx
+ * @param ms
+ */
+void md5_init_midstate(MD5_CTX *ctx, const MD5_MIDSTATE *ms){
+    for (int i = 0; i < 4; i++){ ctx->H[i] = ms->H[i]; }
+    ctx->numbits = ms->numbits;
+    ctx->buflen = 0;
+}
+
+/**
+ * Compress n whole blocks straight from data, which needs no particular alignment.
+ * @param H - the four state words
+ * @param data
+ * @param n - number of 64 byte blocks
+ */
+void md5_blocks(WORD *H, const uint8_t *data, size_t n){
+    union BLOCK M;
+    int nta = stream_scan;
+    for (; n > 0; n--, data += 64){
+        // --scan: fetch ahead without leaving the data in the shared cache.
+        if (nta) { stream_prefetch(data + STREAM_AHEAD); }
+        memcpy(M.eight, data, 64);
+        nexthash(&M, H);
+    }
+}
+
+/**
+ * Absorb len bytes. Full blocks are compressed straight away, any tail is buffered.
+ * @param ctx
+ * @param data
+ * @param len
+ */
+void md5_update(MD5_CTX *ctx, const uint8_t *data, size_t len){
+    ctx->numbits += 8ULL * (uint64_t) len;
+
+    // Top up a partially filled block first.
+    if (ctx->buflen > 0){
+        size_t take = 64 - ctx->buflen;
+        if (take > len) { take = len; }
+        memcpy(ctx->buf.eight + ctx->buflen, data, take);
+        ctx->buflen += take; data += take; len -= take;
+        if (ctx->buflen < 64) { return; }
+        nexthash(&ctx->buf, ctx->H);
+        ctx->buflen = 0;
+    }
+
+    md5_blocks(ctx->H, data, len / 64);
+    data += len & ~(size_t) 63; len &= 63;
+
+    memcpy(ctx->buf.eight, data, len);
+    ctx->buflen = len;
+}
+
+/**
+ * Absorb a chain of segments as if they were one message, without gathering them.
+ * A block that straddles segments is stitched together in the context's 64 byte
+ * buffer; the whole blocks inside each segment go to md5_blocks in place.
+ * @param ctx
+ * @param iov - the segments, in order; empty ones are fine
+ * @param n - number of segments
+ */
+void md5_update_iov(MD5_CTX *ctx, const struct iovec *iov, size_t n){
+    for (size_t i = 0; i < n; i++){ md5_update(ctx, (const uint8_t *) iov[i].iov_base, iov[i].iov_len); }
+}
+
+/**
+ * Pad the buffered tail exactly as nextBlock does for a file and produce the state words.
+ * @param ctx
+ * @param H - receives the four state words
+ */
+void md5_final(MD5_CTX *ctx, WORD *H){
+    union BLOCK *M = &ctx->buf;
+    uint32_t n = ctx->buflen;
+
+    // Append 1 bit to block
+    M->eight[n++] = 0x80;
+    // Not enough space for the length, pad this block out and use another
+    if (n > 56){
+        for (uint32_t i = n; i < 64; i++) { M->eight[i] = 0x00; }
+        nexthash(M, ctx->H);
+        n = 0;
+    }
+    for (uint32_t i = n; i < 56; i++) { M->eight[i] = 0x00; }
+    // Append final byte (Original message length)
+    M->sixfour[7] = ctx->numbits;
+    nexthash(M, ctx->H);
+
+    for (int i = 0; i < 4; i++){ H[i] = ctx->H[i]; }
+}
+
+/**
+ * Export the state of a context that has absorbed a block-aligned prefix.
+ * @param ctx
+ * @param ms
+ * @return 1 on success, 0 if the context is part way through a block
+ */
+int md5_export_midstate(const MD5_CTX *ctx, MD5_MIDSTATE *ms){
+    if (ctx->buflen != 0) { return 0; }
+    for (int i = 0; i < 4; i++){ ms->H[i] = ctx->H[i]; }
+    ms->numbits = ctx->numbits;
+    return 1;
+}
+
+/**
+ * Compute the midstate of a prefix held in memory.
+ * @param prefix
+ * @param len - must be a multiple of 64
+ * @param ms
+ * @return 1 on success, 0 if len is not block-aligned
+ */
+int md5_midstate(const uint8_t *prefix, size_t len, MD5_MIDSTATE *ms){
+    MD5_CTX ctx;
+    md5_init(&ctx);
+    md5_update(&ctx, prefix, len);
+    return md5_export_midstate(&ctx, ms);
+}
+
+/**
+ * Compute the midstate of a prefix stored in a file.
  * Closes file
- * Return MD5 hash as char array.
  * @param f
- * @return char*
+ * @param ms
+ * @return 1 on success, 0 if the file length is not a multiple of 64
  */
-char* md5_file(FILE *f){
-    // Init Word Constants
-    WORD H[] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476 };
+int md5_midstate_file(FILE *f, MD5_MIDSTATE *ms){
+    MD5_CTX ctx;
+    uint8_t chunk[4096];
+    size_t n;
 
-    // The current padded message block.
-    union BLOCK M;
+    md5_init(&ctx);
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0){
+        md5_update(&ctx, chunk, n);
+    }
+    fclose(f);
+    return md5_export_midstate(&ctx, ms);
+}
+
+/**
+ * Write a midstate as "AAAAAAAABBBBBBBBCCCCCCCCDDDDDDDD:bytes", the state words in hex
+ * followed by the prefix length.
+ * @param ms
+ * @param out - at least 54 characters
+ * @param outlen
+ */
+void md5_midstate_format(const MD5_MIDSTATE *ms, char *out, size_t outlen){
+    snprintf(out, outlen, "%08" PRIx32 "%08" PRIx32 "%08" PRIx32 "%08" PRIx32 ":%" PRIu64,
+             ms->H[0], ms->H[1], ms->H[2], ms->H[3], ms->numbits / 8);
+}
+
+/**
+ * Read a midstate written by md5_midstate_format.
+ * @param c
+ * @param ms
+ * @return 1 on success, 0 if c is malformed
+ */
+int md5_midstate_parse(const char *c, MD5_MIDSTATE *ms){
+    uint64_t bytes;
+    if (strlen(c) < 34 || c[32] != ':') { return 0; }
+    if (sscanf(c, "%8" SCNx32 "%8" SCNx32 "%8" SCNx32 "%8" SCNx32 ":%" SCNu64,
+               &ms->H[0], &ms->H[1], &ms->H[2], &ms->H[3], &bytes) != 5) { return 0; }
+    if (bytes % 64 != 0) { return 0; }
+    ms->numbits = 8 * bytes;
+    return 1;
+}
+
+/**
+ * Run the MD5 over every padded block of a file.
+ * Leaves the file open.
+ * @param f
+ * @param ms - midstate of a prefix to continue from, or NULL to start afresh
+ * @param H - receives the four state words
+ */
+void md5_stream(FILE *f, const MD5_MIDSTATE *ms, WORD *H){
     // Count the bits
     uint64_t numbits = 0;
+    uint64_t numbits0;
+
+    if (ms){
+        for (int i = 0; i < 4; i++){ H[i] = ms->H[i]; }
+        numbits = ms->numbits;
+    } else {
+        // Init Word Constants
+        H[0] = 0x67452301; H[1] = 0xefcdab89; H[2] = 0x98badcfe; H[3] = 0x10325476;
+    }
+
+    // The current padded message block.
+    union BLOCK M;
     // Set the status flag
     PADFLAG status = READ;
+    numbits0 = numbits;
+    STATS_TIMER(t);
 
     // Process the input in blocks
     while(nextBlock(&M, f, &numbits, &status))
     {
+        STATS_READ(t, 0);
         nexthash(&M, H);
+        STATS_HASH(t, 1);
     }
+    STATS_READ(t, (numbits - numbits0) / 8);
+    (void) numbits0;
+}
 
-    // Output the hash
-    unsigned char block1[9];
-    unsigned char block2[9];
-    unsigned char block3[9];
-    unsigned char block4[9];
+/**
+ * Format the four state words as the 32 character MD5 hex string.
+ * @param H
+ * @return char* (caller frees)
+ */
+char* md5_hex(const WORD *H){
+    char* finalOut = malloc(33);
+    for (int i = 0; i < 4; i++){
+        snprintf(finalOut + 8 * i, 9, "%08" PRIx32, bswap_32(H[i]));
+    }
+    return finalOut;
+}
 
-//    printf("MD5 Output  >: ");
-//    for (int i = 0; i < 4; i++){
-//        printf("%08" PRIx32 "", bswap_32(H[i]));
-//    }
+/**
+ * The digest bytes are the state words, low-order byte first (RFC 1321 step 5).
+ * @param H
+ * @param out - receives 16 bytes
+ */
+void md5_digest_bytes(const WORD *H, uint8_t *out){
+    for (int i = 0; i < 4; i++){
+        out[4*i]   = (uint8_t) H[i];
+        out[4*i+1] = (uint8_t) (H[i] >> 8);
+        out[4*i+2] = (uint8_t) (H[i] >> 16);
+        out[4*i+3] = (uint8_t) (H[i] >> 24);
+    }
+}
 
-    snprintf(block1, 9, "%08x" PRIx32 "", bswap_32(H[0]));
-    snprintf(block2, 9, "%08x" PRIx32 "", bswap_32(H[1]));
-    snprintf(block3, 9, "%08x" PRIx32 "", bswap_32(H[2]));
-    snprintf(block4, 9, "%08x" PRIx32 "", bswap_32(H[3]));
-//    printf("\n" );
-//    printf("snprintf    : %s", block1);
-//    printf("%s", block2);
-//    printf("%s", block3);
-//    printf("%s", block4);
-//    printf("\n" );
-//    char* finalOut;
-//    finalOut = (char*)malloc(32 * sizeof(char));
-
-    char* finalOut = malloc(32);
-
-    strncpy(finalOut, block1, 9);//finalOut += block1;
-    strncat(finalOut, block2, 9);//finalOut += block1;
-    strncat(finalOut, block3, 9);//finalOut += block1;
-    strncat(finalOut, block4, 9);//finalOut += block1;
-//    printf("Output Str  : %s\n", finalOut);
+/**
+ * Format bytes as lower case hex.
+ * @param bytes
+ * @param n
+ * @return char* (caller frees)
+ */
+char* bytes_hex(const uint8_t *bytes, size_t n){
+    char* out = malloc(2 * n + 1);
+    for (size_t i = 0; i < n; i++){ snprintf(out + 2 * i, 3, "%02" PRIx8, bytes[i]); }
+    out[2 * n] = '\0';
+    return out;
+}
+
+/**
+ * Read two hex digits per byte.
+ * @param hex
+ * @param out
+ * @param outlen
+ * @return the number of bytes, or -1 if malformed or too long
+ */
+int hex_decode(const char *hex, uint8_t *out, size_t outlen){
+    size_t n = strlen(hex);
+    if (n % 2 != 0 || n / 2 > outlen) { return -1; }
+    for (size_t i = 0; i < n / 2; i++){
+        unsigned int byte;
+        if (sscanf(hex + 2 * i, "%2x", &byte) != 1) { return -1; }
+        out[i] = (uint8_t) byte;
+    }
+    return (int) (n / 2);
+}
+
+/**
+ * Take file input from command line.
+ * Process file
+ * Closes file
+ * Return MD5 hash as char array.
+ * @param f
+ * @return char*
+ */
+char* md5_file(FILE *f){
+    return md5_file_from(f, NULL);
+}
+
+/**
+ * As md5_file, but the file is the remainder of a message whose block-aligned
+ * prefix has already been absorbed into ms.
+ * @param f
+ * @param ms - or NULL to start afresh
+ * @return char*
+ */
+char* md5_file_from(FILE *f, const MD5_MIDSTATE *ms){
+    WORD H[4];
+    md5_stream(f, ms, H);
 
     // Close the file
-    fclose(f);
+    input_fclose(f);
     // Return the output
-    return finalOut;
+    return md5_hex(H);
+}
+
+/**
+ * MD5 of a buffer as digest bytes, for tuning against the kernel's.
+ */
+static void md5_buffer(const uint8_t *data, size_t n, uint8_t *digest){
+    MD5_CTX ctx;
+    WORD H[4];
+    md5_init(&ctx);
+    md5_update(&ctx, data, n);
+    md5_final(&ctx, H);
+    md5_digest_bytes(H, digest);
+}
+
+/**
+ * Should the kernel hash the file (Common/afalg.c)? afalg always tries it; auto
+ * asks the tuner, once.
+ * @param engine
+ * @return 1 to try AF_ALG
+ */
+static int md5_kernel_wins(INPUT_ENGINE engine){
+    static int tuned = -1;
+    if (engine == ENGINE_AFALG) { return 1; }
+    if (engine != ENGINE_AUTO) { return 0; }
+    if (tuned < 0) { tuned = afalg_tune("md5", md5_buffer, 16); }
+    return tuned;
+}
+
+/**
+ * Hash a file by path, reading it through an input engine (Common/input.c), or
+ * with afalg and auto perhaps in the kernel.
+ * @param path
+ * @param engine
+ * @param ms - midstate of a prefix to continue from, or NULL to start afresh
+ * @param H - receives the four state words
+ * @return 1 on success, 0 if the file could not be opened or read
+ */
+int md5_path(const char *path, INPUT_ENGINE engine, const MD5_MIDSTATE *ms, WORD *H){
+    INPUT in;
+    MD5_CTX ctx;
+    const uint8_t *data;
+    long n;
+
+    // The kernel only hashes whole messages; a midstate is continued here.
+    if (!ms && md5_kernel_wins(engine)){
+        uint8_t digest[16];
+        int r = afalg_path("md5", path, digest, 16);
+        if (r < 0) { printf("Error: could not read %s.\n", path); return 0; }
+        if (r > 0){
+            for (int i = 0; i < 4; i++){
+                H[i] = (WORD) digest[4*i] | ((WORD) digest[4*i+1] << 8)
+                       | ((WORD) digest[4*i+2] << 16) | ((WORD) digest[4*i+3] << 24);
+            }
+            return 1;
+        }
+    }
+    if (!input_open(&in, path, engine)){
+        printf("Error: could not open %s.\n", path);
+        input_close(&in);
+        return 0;
+    }
+    if (ms) { md5_init_midstate(&ctx, ms); } else { md5_init(&ctx); }
+    uint64_t total = 0;
+    STATS_TIMER(t);
+    while ((n = input_next(&in, &data)) > 0){
+        STATS_READ(t, (uint64_t) n);
+        md5_update(&ctx, data, (size_t) n);
+        STATS_HASH(t, 0);
+        total += (uint64_t) n;
+    }
+    STATS_READ(t, 0);
+    input_close(&in);
+    if (n < 0) { printf("Error: could not read %s.\n", path); return 0; }
+    md5_final(&ctx, H);
+    STATS_HASH(t, STATS_PADBLOCKS(total + (ms ? ms->numbits / 8 : 0), 64, 8) - (ms ? ms->numbits / 512 : 0));
+    (void) total;
+    return 1;
+}
+
+/**
+ * Hash a file by path, consulting the digest cache first.
+ * A hit never opens the file. A miss hashes it and records the digest, provided
+ * the file did not change while it was being read.
+ * @param path
+ * @param cache
+ * @param engine - how a miss reads the file
+ * @return char* or NULL if the file could not be opened
+ */
+char* md5_file_cached(char* path, DIGESTCACHE *cache, INPUT_ENGINE engine){
+    WORD H[4];
+    uint8_t digest[16];
+    DIGESTKEY before, after;
+
+    int cacheable = digestcache_key(path, &before);
+    if (cacheable && digestcache_lookup(cache, &before, ALGO_MD5, digest, 16)) {
+        for (int i = 0; i < 4; i++){
+            H[i] = (WORD) digest[4*i] | ((WORD) digest[4*i+1] << 8)
+                   | ((WORD) digest[4*i+2] << 16) | ((WORD) digest[4*i+3] << 24);
+        }
+        return md5_hex(H);
+    }
+
+    // stdio reads every zero page of a sparse file, and can't drop what a scan has
+    // read; the read engine can do both.
+    if (engine == ENGINE_STDIO && (stream_scan || input_sparse(path))) { engine = ENGINE_READ; }
+    if (engine == ENGINE_STDIO){
+        FILE* f = getFile(path);
+        if (!f) { return NULL; }
+        md5_stream(f, NULL, H);
+        input_fclose(f);
+    } else if (!md5_path(path, engine, NULL, H)) {
+        return NULL;
+    }
+
+    if (cacheable && digestcache_key(path, &after) && memcmp(&before, &after, sizeof(before)) == 0) {
+        md5_digest_bytes(H, digest);
+        digestcache_insert(cache, &after, ALGO_MD5, digest, 16);
+    }
+    return md5_hex(H);
+}
+
+/**
+ * HMAC-MD5 of a file: the inner hash is the file continued from the ipad midstate.
+ * Closes file
+ * @param f
+ * @param k
+ * @return char* hex tag
+ */
+char* hmac_md5_file(FILE *f, const HMAC_MD5_KEY *k){
+    WORD H[4];
+    uint8_t tag[16];
+    md5_stream(f, &k->inner, H);
+    input_fclose(f);
+    hmac_md5_outer(k, H, tag);
+    return bytes_hex(tag, sizeof(tag));
+}
+
+/**
+ * Verify every line of a manifest, "key hextag path", as one batch.
+ * Prints OK or FAILED per line.
+ * @param manifest
+ * @return the number of lines that failed, -1 if the manifest can't be read
+ */
+int hmac_verify_manifest(const char *manifest){
+    FILE* mf = fopen(manifest, "r");
+    if (!mf) { printf("Error: could not open %s.\n", manifest); return -1; }
+
+    size_t n = 0, cap = 0;
+    HMAC_MD5_VERIFYJOB *jobs = NULL;
+    HMAC_MD5_KEY *keys = NULL;
+    char **paths = NULL;
+    char key[1024], taghex[129], path[4096];
+    int failed = 0;
+
+    while (fscanf(mf, "%1023s %128s %4095s", key, taghex, path) == 3){
+        if (n == cap){
+            cap = cap ? 2 * cap : 64;
+            jobs = realloc(jobs, cap * sizeof(*jobs));
+            keys = realloc(keys, cap * sizeof(*keys));
+            paths = realloc(paths, cap * sizeof(*paths));
+        }
+        uint8_t *tag = malloc(64);
+        int taglen = hex_decode(taghex, tag, 16);
+        FILE* infile = fopen(path, "rb");
+
+        hmac_md5_key(&keys[n], (const uint8_t *) key, strlen(key));
+        jobs[n].tag = tag;
+        jobs[n].taglen = taglen < 0 ? 0 : (size_t) taglen;
+        jobs[n].msg = infile ? read_all(infile, &jobs[n].len) : NULL;
+        if (!jobs[n].msg) { jobs[n].len = 0; jobs[n].taglen = 0; }
+        if (infile) { fclose(infile); }
+        paths[n] = strdup(path);
+        n++;
+    }
+    fclose(mf);
+
+    // keys[] may have moved while growing, so point the jobs at them afterwards.
+    for (size_t i = 0; i < n; i++){ jobs[i].key = &keys[i]; }
+
+    hmac_md5_verify_batch(jobs, n);
+
+    for (size_t i = 0; i < n; i++){
+        printf("%s: %s\n", paths[i], jobs[i].ok ? "OK" : "FAILED");
+        failed += !jobs[i].ok;
+        free((void *) jobs[i].msg);
+        free((void *) jobs[i].tag);
+        free(paths[i]);
+    }
+    free(jobs); free(keys); free(paths);
+    return failed;
+}
+
+/**
+ * Hash a batch of records through the lanes (Common/records.c callback).
+ * @param arg - RECORDS_BATCH jobs to use
+ * @param recs
+ * @param n
+ * @param digests - receives 16 bytes per record
+ */
+static void md5_records_hash(void *arg, const RECORD *recs, size_t n, uint8_t *digests){
+    MD5_MBJOB *jobs = (MD5_MBJOB *) arg;
+    for (size_t i = 0; i < n; i++){
+        jobs[i].from = NULL;
+        jobs[i].data = recs[i].data;
+        jobs[i].len = recs[i].len;
+    }
+    md5_mb_hash(jobs, n);
+    for (size_t i = 0; i < n; i++){ md5_digest_bytes(jobs[i].H, digests + 16 * i); }
+}
+
+/**
+ * MD5 of every record of a file, or of stdin for "-", one digest per record on stdout.
+ * @param path
+ * @param format - lines or 4 byte length prefixed
+ * @param raw - 1 for 16 raw bytes per record, 0 for hex lines
+ * @return 1 on success, 0 on an error (reported on stderr, stdout being the digests)
+ */
+int md5_records(const char *path, RECORDS_FORMAT format, int raw){
+    FILE* in = input_fopen(path);
+    if (!in) { fprintf(stderr, "Error: could not open %s.\n", path); return 0; }
+    MD5_MBJOB *jobs = malloc(RECORDS_BATCH * sizeof(MD5_MBJOB));
+    int64_t n = jobs ? records_run(in, stdout, format, raw, 16, md5_records_hash, jobs) : -1;
+    input_fclose(in);
+    free(jobs);
+    if (n < 0) { fprintf(stderr, "Error: could not read %s, or its last record is cut short.\n", path); return 0; }
+    return 1;
+}
+
+/**
+ * --serve: digest lengths, 0 for an algorithm the MD5 tool doesn't have.
+ */
+static size_t md5_daemon_dlen(DIGESTALGO algo){
+    return algo == ALGO_MD5 ? 16 : algo == ALGO_SHA256 ? 32 : 0;
+}
+
+/**
+ * --serve: a batch of small requests, MD5 through the lanes.
+ */
+static void md5_daemon_mem(DIGESTALGO algo, const RECORD *recs, size_t n, uint8_t *digests){
+    if (algo == ALGO_MD5){
+        MD5_MBJOB jobs[DAEMON_BATCH];
+        md5_records_hash(jobs, recs, n, digests);
+        return;
+    }
+    for (size_t i = 0; i < n; i++){
+        SHA256_CTX ctx;
+        WORD H[8];
+        sha256_init(&ctx);
+        sha256_update(&ctx, recs[i].data, recs[i].len);
+        sha256_final(&ctx, H);
+        sha256_digest_bytes(H, digests + 32 * i);
+    }
+}
+
+/**
+ * --serve: a file descriptor from its start.
+ */
+static int md5_daemon_fd(DIGESTALGO algo, int fd, uint8_t *digest){
+    uint8_t *buf = malloc(DAEMON_FDCHUNK);
+    uint64_t off = 0;
+    MD5_CTX md5;
+    SHA256_CTX sha;
+    WORD H[8];
+    long n;
+
+    if (!buf) { return 0; }
+    if (algo == ALGO_MD5) { md5_init(&md5); } else { sha256_init(&sha); }
+    while ((n = daemon_fd_next(fd, buf, DAEMON_FDCHUNK, &off)) > 0){
+        if (algo == ALGO_MD5) { md5_update(&md5, buf, (size_t) n); } else { sha256_update(&sha, buf, (size_t) n); }
+    }
+    free(buf);
+    if (n < 0) { return 0; }
+    if (algo == ALGO_MD5) { md5_final(&md5, H); md5_digest_bytes(H, digest); }
+    else { sha256_final(&sha, H); sha256_digest_bytes(H, digest); }
+    return 1;
+}
+
+static const DAEMON_OPS MD5_DAEMON = { "md5, sha256", md5_daemon_dlen, md5_daemon_mem, md5_daemon_fd };
+
+/**
+ * Serve MD5 and SHA-256 requests on a Unix socket (Common/daemon.c).
+ * @param path
+ * @return 0 if it could not start; otherwise it runs until killed
+ */
+int md5_serve(const char *path){
+    return daemon_serve(path, &MD5_DAEMON, 0);
+}
+
+/**
+ * Hand out shared memory request rings on a Unix socket (Common/shmring.c).
+ * @param path
+ * @param poll - 1 for busy-polling workers, 0 for futex wakeups
+ * @return 0 if it could not start; otherwise it runs until killed
+ */
+int md5_ring(const char *path, int poll){
+    return shmring_serve(path, &MD5_DAEMON, poll);
+}
+
+static void md5_tee_consume(void *arg, const uint8_t *data, size_t n){
+    md5_update((MD5_CTX *) arg, data, n);
+}
+
+/**
+ * Copy a file or stdin ("-") to stdout while hashing it (Common/tee.c).
+ * stdout is the stream, so the digest and any error go to stderr.
+ * @param path
+ * @param ms - midstate of a prefix to continue from, or NULL
+ * @param hmac - key for an HMAC-MD5 tag instead of the digest, or NULL
+ * @return 1 on success, 0 on a read or write error
+ */
+int md5_tee(const char *path, const MD5_MIDSTATE *ms, const HMAC_MD5_KEY *hmac){
+    MD5_CTX ctx;
+    WORD H[4];
+    char *c;
+    if (hmac) { ms = &hmac->inner; }
+    if (ms) { md5_init_midstate(&ctx, ms); } else { md5_init(&ctx); }
+    if (!tee_stream(path, md5_tee_consume, &ctx)){
+        fprintf(stderr, "Error: could not pass %s through to stdout.\n", path);
+        return 0;
+    }
+    md5_final(&ctx, H);
+    if (hmac){
+        uint8_t tag[16];
+        hmac_md5_outer(hmac, H, tag);
+        c = bytes_hex(tag, sizeof(tag));
+    } else {
+        c = md5_hex(H);
+    }
+    fprintf(stderr, "Output Str  : %s\n", c);
+    free(c);
+    return 1;
+}
+
+// The streaming API behind void pointers, for the Common modules.
+static void md5_ctx_init(void *ctx) { md5_init((MD5_CTX *) ctx); }
+static void md5_ctx_update(void *ctx, const uint8_t *data, size_t n) { md5_update((MD5_CTX *) ctx, data, n); }
+static void md5_ctx_final(void *ctx, uint8_t *digest){
+    WORD H[4];
+    md5_final((MD5_CTX *) ctx, H);
+    md5_digest_bytes(H, digest);
+}
+
+static const COPYVERIFY_OPS MD5_COPYVERIFY = {16, md5_ctx_init, md5_ctx_update, md5_ctx_final};
+
+/**
+ * Copy files, hashing each source once on the way and verifying the copy with an
+ * O_DIRECT re-read (Common/copyverify.c).
+ * @param paths - the sources, then the destination file or directory
+ * @param n
+ * @param engine - how the sources are read
+ * @return 1 if every copy matched its source
+ */
+int md5_copy(char **paths, int n, INPUT_ENGINE engine){
+    return copyverify_run(paths, n, engine, &MD5_COPYVERIFY, 0);
+}
+
+/**
+ * MD5 of every regular file in a tar archive, or of one on stdin for "-",
+ * without extracting it (Common/tar.c).
+ * @param path
+ * @return 1 on success, 0 if the archive could not be read
+ */
+int md5_tar(const char *path){
+    FILE* in = input_fopen(path);
+    if (!in) { fprintf(stderr, "Error: could not open %s.\n", path); return 0; }
+    MD5_MBJOB *jobs = malloc(RECORDS_BATCH * sizeof(MD5_MBJOB));
+    TAR_OPS ops = {16, md5_records_hash, jobs, md5_ctx_init, md5_ctx_update, md5_ctx_final};
+    int64_t n = jobs ? tar_run(in, &ops) : -1;
+    input_fclose(in);
+    free(jobs);
+    return n >= 0;
 }
 
 /**
@@ -393,7 +1030,7 @@ int string_to_file(char* c){
 FILE * getFile(char* c){
     FILE *infile = NULL;
 //    printf("Opening File: %s\n", c);
-    infile = fopen(c, "rb");
+    infile = input_fopen(c);
     if (!infile) {
         printf("Error: An error occurred while processing the input string to file.\n");
         return NULL;
@@ -401,6 +1038,8 @@ FILE * getFile(char* c){
     return infile;
 }
 
+// libtoahash builds this file for its hashing code and leaves out the CLI.
+#ifndef TOAHASH_LIBRARY
 int main(int argc,char *argv[]) {
 
     // Debugging args
@@ -412,8 +1051,85 @@ int main(int argc,char *argv[]) {
 //        printf("argv: %s\n", argv[ctr] );
 //    }
 
+    // Global options come before the command and are consumed from argv.
+    DIGESTCACHE cache;
+    int usecache = 0;
+    MD5_MIDSTATE midstate;
+    MD5_MIDSTATE *from = NULL;
+    HMAC_MD5_KEY hmackey;
+    int usehmac = 0;
+    INPUT_ENGINE engine = ENGINE_STDIO;
+    int raw = 0;
+    while (argc >= 3){
+        // --stats, --perf, --raw and --scan are the options without a value.
+        if (strcmp(argv[1], "--scan")==0){
+            stream_scan = 1;
+            argv[1] = argv[0]; argv++; argc--;
+            continue;
+        }
+        if (strcmp(argv[1], "--stats")==0 || strcmp(argv[1], "--perf")==0){
+            stats_start(strcmp(argv[1], "--perf")==0);
+            argv[1] = argv[0]; argv++; argc--;
+            continue;
+        }
+        if (strcmp(argv[1], "--raw")==0){
+            raw = 1;
+            argv[1] = argv[0]; argv++; argc--;
+            continue;
+        }
+        if (strcmp(argv[1], "--cache")==0){
+            if (usecache) { digestcache_close(&cache); }
+            usecache = digestcache_open(&cache, argv[2]);
+            if (!usecache) { printf("Warning: digest cache %s unavailable, hashing without it.\n", argv[2]); }
+        } else if (strcmp(argv[1], "--from-midstate")==0){
+            if (!md5_midstate_parse(argv[2], &midstate)) { printf("Error: malformed midstate %s\n", argv[2]); return 1; }
+            from = &midstate;
+        } else if (strcmp(argv[1], "--hmac")==0){
+            hmac_md5_key(&hmackey, (const uint8_t *) argv[2], strlen(argv[2]));
+            usehmac = 1;
+        } else if (strcmp(argv[1], "--engine")==0){
+            if (!input_engine_parse(argv[2], &engine)) { printf("Error: unknown input engine %s\n", argv[2]); return 1; }
+        } else {
+            break;
+        }
+        argv[2] = argv[0]; argv += 2; argc -= 2;
+    }
+
     // Check args
     if (argc < 2) { printf("No input given.. Enter --help for assistance.\n"); return 1; }
+    // --bench command (JSON report of cycles/byte per kernel and message size)
+    if((argc == 2 || argc == 3) && strcmp(argv[1], "--bench")==0){
+        return md5_bench(argc == 3 ? bench_parse_size(argv[2]) : (16ULL << 20)) ? 0 : 1;
+    }
+    // --fuzz command (every kernel and engine against the reference nexthash)
+    if(argc >= 2 && argc <= 4 && strcmp(argv[1], "--fuzz")==0){
+        int ok = md5_fuzz(argc >= 3 ? bench_parse_size(argv[2]) : (16ULL << 20),
+                          argc == 4 ? strtoull(argv[3], NULL, 10) : 1000);
+        ok &= shmring_check(&MD5_DAEMON, ALGO_MD5);
+        return ok ? 0 : 1;
+    }
+    // --records command (a digest per line or length prefixed record, straight to stdout)
+    if(argc == 4 && strcmp(argv[1], "--records")==0){
+        RECORDS_FORMAT format;
+        if (!records_format_parse(argv[2], &format)) { printf("Error: unknown record format %s\n", argv[2]); return 1; }
+        return md5_records(argv[3], format, raw) ? 0 : 1;
+    }
+    // --serve command (hashing daemon on a Unix socket)
+    if(argc == 3 && strcmp(argv[1], "--serve")==0){ return md5_serve(argv[2]) ? 0 : 1; }
+    // --ring command (shared memory request rings, handed out on a Unix socket)
+    if((argc == 3 || argc == 4) && strcmp(argv[1], "--ring")==0){
+        if (argc == 4 && strcmp(argv[3], "poll")!=0 && strcmp(argv[3], "futex")!=0){
+            printf("Error: --ring waits by poll or futex, not %s\n", argv[3]); return 1; }
+        return md5_ring(argv[2], argc == 4 && strcmp(argv[3], "poll")==0) ? 0 : 1;
+    }
+    // --tee command (the input through to stdout, the digest on stderr)
+    if(argc == 3 && strcmp(argv[1], "--tee")==0){
+        return md5_tee(argv[2], from, usehmac ? &hmackey : NULL) ? 0 : 1;
+    }
+    // --copy command (copy with one read of each source, then verify the copies)
+    if(argc >= 4 && strcmp(argv[1], "--copy")==0){ return md5_copy(argv + 2, argc - 2, engine) ? 0 : 1; }
+    // --tar command (a digest per member of an archive, nothing extracted)
+    if(argc == 3 && strcmp(argv[1], "--tar")==0){ return md5_tar(argv[2]) ? 0 : 1; }
     // --help command
     if(argc == 2 && strcmp(argv[1], "--help")==0){ menu_no_args(); return 0; }
     // --test command
@@ -428,21 +1144,79 @@ int main(int argc,char *argv[]) {
         // parse input string to file
         string_to_file(argv[2]);
         FILE* infile = getFile("plaintext.txt");
-        char* c = md5_file(infile);
+        char* c = usehmac ? hmac_md5_file(infile, &hmackey) : md5_file_from(infile, from);
         printf("Output Str  : %s\n", c);
     }// end --string
 
     // --file command (process input file)
     if(argc == 3 && strcmp(argv[1], "--file")==0){
-        FILE* infile = getFile(argv[2]);
-        char* c = md5_file(infile);
-        printf("Output Str  : %s\n", c);
+        char* c = NULL;
+        INPUT_ENGINE fileengine = engine == ENGINE_STDIO && (stream_scan || input_sparse(argv[2])) ? ENGINE_READ : engine;
+        // Cached digests are of whole files, so a midstate bypasses the cache.
+        if (usecache && !from && !usehmac) { c = md5_file_cached(argv[2], &cache, engine); }
+        else if (fileengine != ENGINE_STDIO) {
+            WORD H[4];
+            if (md5_path(argv[2], fileengine, usehmac ? &hmackey.inner : from, H)){
+                if (usehmac){
+                    uint8_t tag[16];
+                    hmac_md5_outer(&hmackey, H, tag);
+                    c = bytes_hex(tag, sizeof(tag));
+                } else {
+                    c = md5_hex(H);
+                }
+            }
+        }
+        else {
+            FILE* infile = getFile(argv[2]);
+            if (infile) { c = usehmac ? hmac_md5_file(infile, &hmackey) : md5_file_from(infile, from); }
+        }
+        if (c) { printf("Output Str  : %s\n", c); free(c); }
     }// end --file
 
+    // --cache-compact command
+    if(argc == 3 && strcmp(argv[1], "--cache-compact")==0){
+        if (!digestcache_compact(argv[2])) { printf("Error: could not compact %s.\n", argv[2]); }
+    }// end --cache-compact
+
+    // --midstate command (export the state after a prefix file)
+    if(argc == 3 && strcmp(argv[1], "--midstate")==0){
+        FILE* infile = getFile(argv[2]);
+        char out[64];
+        if (infile && md5_midstate_file(infile, &midstate)){
+            md5_midstate_format(&midstate, out, sizeof(out));
+            printf("Midstate    : %s\n", out);
+        } else if (infile) {
+            printf("Error: prefix length must be a multiple of 64 bytes.\n");
+        }
+    }// end --midstate
+
+    // --hmac-verify command
+    if(argc == 3 && strcmp(argv[1], "--hmac-verify")==0){
+        int failed = hmac_verify_manifest(argv[2]);
+        if (usecache) { digestcache_close(&cache); }
+        return failed == 0 ? 0 : 1;
+    }// end --hmac-verify
+
+    // --md5-sha256 command (both digests from one read of the file)
+    if(argc == 3 && strcmp(argv[1], "--md5-sha256")==0){
+        WORD H5[4], H256[8];
+        FILE* infile = getFile(argv[2]);
+        if (infile && md5_sha256_stream(infile, H5, H256)){
+            char* c = md5_hex(H5);
+            printf("MD5         : %s\n", c);
+            printf("SHA-256     : ");
+            for (int i = 0; i < 8; i++){ printf("%08" PRIx32, H256[i]); }
+            printf("\n");
+            free(c);
+        }
+        if (infile) { input_fclose(infile); }
+    }// end --md5-sha256
+
+    if (usecache) { digestcache_close(&cache); }
+
     // Terminate the program
     printf("Terminating program..");
     return 0;
 }// end main
 
-
-
+#endif
@@ -0,0 +1,148 @@
+/**
+ * Multi-buffer MD5.
+ * Independent messages are hashed side by side, one message per lane of a SIMD
+ * vector, so one pass of the 64 operations compresses MD5_LANES blocks. MD5 is a
+ * single dependency chain per message, so this is how it fills the execution units.
+ * Written with GCC/Clang vector extensions; F, G, H, I and ROTATE_LEFT from
+ * functions.c work on whole vectors.
+ */
+
+typedef WORD LANEWORD __attribute__ ((vector_size (4 * MD5_LANES)));
+
+// Eight 32 bit lanes fill an AVX2 register; without AVX2 they are two SSE2 halves.
+// The kernel is built both ways and the loader picks one for the CPU.
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(_WIN32) && !defined(__APPLE__)
+#define MD5_LANES_TARGETS __attribute__ ((target_clones ("avx2", "default")))
+#else
+#define MD5_LANES_TARGETS
+#endif
+
+// Message word used by each of the 64 operations, and the shift amounts, per rfc1321 step 4.
+static const uint8_t MD5_Message_Index[64] = {
+        0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+        1, 6, 11, 0, 5, 10, 15, 4, 9, 14, 3, 8, 13, 2, 7, 12,
+        5, 8, 11, 14, 1, 4, 7, 10, 13, 0, 3, 6, 9, 12, 15, 2,
+        0, 7, 14, 5, 12, 3, 10, 1, 8, 15, 6, 13, 4, 11, 2, 9};
+static const uint8_t MD5_Shift[4][4] = {
+        {S11, S12, S13, S14}, {S21, S22, S23, S24}, {S31, S32, S33, S34}, {S41, S42, S43, S44}};
+
+/**
+ * Compress one block in each lane.
+ * @param M - M[t][l] is word t of lane l's block
+ * @param H - H[l] is lane l's state
+ * @param mask - only lanes whose bit is set are written back
+ */
+MD5_LANES_TARGETS
+void nexthash_lanes(WORD M[16][MD5_LANES], WORD H[MD5_LANES][4], unsigned mask)
+{
+    LANEWORD X[16], V[4], a, b, c, d, f, tmp;
+
+    for (int t = 0; t < 16; t++){ memcpy(&X[t], M[t], sizeof(LANEWORD)); }
+    for (int i = 0; i < 4; i++){
+        for (int l = 0; l < MD5_LANES; l++){ V[i][l] = H[l][i]; }
+    }
+
+    a = V[0]; b = V[1]; c = V[2]; d = V[3];
+    for (int t = 0; t < 64; t++){
+        if (t < 16)      { f = F(b, c, d); }
+        else if (t < 32) { f = G(b, c, d); }
+        else if (t < 48) { f = H(b, c, d); }
+        else             { f = I(b, c, d); }
+        f += a + X[MD5_Message_Index[t]] + K[t];
+        tmp = d; d = c; c = b;
+        b = b + ROTATE_LEFT(f, MD5_Shift[t / 16][t % 4]);
+        a = tmp;
+    }
+    V[0] += a; V[1] += b; V[2] += c; V[3] += d;
+
+    for (int l = 0; l < MD5_LANES; l++){
+        if (!(mask & (1u << l))) { continue; }
+        for (int i = 0; i < 4; i++){ H[l][i] = V[i][l]; }
+    }
+}
+
+/**
+ * A lane's progress through a job: whole blocks are read in place from the job's
+ * data, the padded tail (one or two blocks) is built once in tail.
+ */
+typedef struct {
+    MD5_MBJOB *job;
+    size_t whole;
+    size_t next;
+    size_t nblocks;
+    uint8_t tail[128];
+} MD5_LANE;
+
+static void md5_lane_start(MD5_LANE *lane, MD5_MBJOB *job, WORD *H){
+    size_t rem = job->len % 64;
+    uint64_t numbits = (job->from ? job->from->numbits : 0) + 8ULL * job->len;
+    size_t ntail = rem < 56 ? 1 : 2;
+
+    lane->job = job;
+    lane->whole = job->len / 64;
+    lane->next = 0;
+    lane->nblocks = lane->whole + ntail;
+
+    memset(lane->tail, 0, sizeof(lane->tail));
+    memcpy(lane->tail, job->data + 64 * lane->whole, rem);
+    // Append 1 bit, then the message length low-order byte first.
+    lane->tail[rem] = 0x80;
+    for (int i = 0; i < 8; i++){ lane->tail[64 * ntail - 8 + i] = (uint8_t) (numbits >> (8 * i)); }
+
+    if (job->from){ for (int i = 0; i < 4; i++){ H[i] = job->from->H[i]; } }
+    else { H[0] = 0x67452301; H[1] = 0xefcdab89; H[2] = 0x98badcfe; H[3] = 0x10325476; }
+}
+
+/**
+ * Hash n jobs through the lanes. A lane whose job finishes is refilled with the
+ * next job straight away, so short and long messages can be mixed freely.
+ * @param jobs
+ * @param n
+ */
+void md5_mb_hash(MD5_MBJOB *jobs, size_t n){
+    MD5_LANE lanes[MD5_LANES];
+    WORD M[16][MD5_LANES];
+    WORD H[MD5_LANES][4];
+    unsigned mask = 0;
+    size_t nextjob = 0;
+    int l;
+
+    memset(M, 0, sizeof(M));
+    for (l = 0; l < MD5_LANES && nextjob < n; l++, nextjob++){
+        md5_lane_start(&lanes[l], &jobs[nextjob], H[l]);
+        mask |= 1u << l;
+    }
+
+    while (mask){
+        // Gather the next block of every busy lane.
+        for (l = 0; l < MD5_LANES; l++){
+            if (!(mask & (1u << l))) { continue; }
+            MD5_LANE *lane = &lanes[l];
+            const uint8_t *p = lane->next < lane->whole
+                               ? lane->job->data + 64 * lane->next
+                               : lane->tail + 64 * (lane->next - lane->whole);
+            for (int t = 0; t < 16; t++){
+                M[t][l] = (WORD) p[4*t] | ((WORD) p[4*t+1] << 8)
+                          | ((WORD) p[4*t+2] << 16) | ((WORD) p[4*t+3] << 24);
+            }
+        }
+
+        nexthash_lanes(M, H, mask);
+
+        for (l = 0; l < MD5_LANES; l++){
+            if (!(mask & (1u << l)) || ++lanes[l].next < lanes[l].nblocks) { continue; }
+            memcpy(lanes[l].job->H, H[l], sizeof(H[l]));
+            if (nextjob < n) { md5_lane_start(&lanes[l], &jobs[nextjob++], H[l]); }
+            else { mask &= ~(1u << l); }
+        }
+    }
+}
+
+// The job manager's view of MD5 (Common/jobmgr.c).
+static const uint32_t MD5_IV[4] = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476};
+
+static void md5_jobmgr_compress(uint32_t *M, uint32_t *H, unsigned mask){
+    nexthash_lanes((WORD (*)[MD5_LANES]) M, (WORD (*)[4]) H, mask);
+}
+
+const JOBMGR_OPS MD5_JOBMGR = { "md5", MD5_LANES, 4, 0, MD5_IV, md5_jobmgr_compress };
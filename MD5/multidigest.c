@@ -0,0 +1,142 @@
+/**
+ * Single pass MD5 + SHA-256.
+ * Both algorithms pad to 64 byte blocks, so each block read from the file feeds
+ * both compressions. MD5 reads the block as little endian words and SHA-256 as
+ * big endian words, and both run 64 steps per block. The two dependency chains are
+ * independent, so the kernel below interleaves step t of MD5 with round t of
+ * SHA-256 and an out of order core overlaps their latencies.
+ * The SHA-256 core is shared with SHA256/FinalSHA256.
+ */
+
+#include "../SHA256/FinalSHA256/sha256.c"
+
+// Bytes read from the file per fread, a whole number of blocks.
+#define MULTIDIGEST_CHUNK (64 * 1024)
+
+/**
+ * Compress one 64 byte block (message byte order) into both states.
+ * The SHA-256 working variables are sa..sh, because MD5's F, G, H and I are macros.
+ * @param block
+ * @param H5 - MD5 state
+ * @param H256 - SHA-256 state
+ */
+void nexthash_md5_sha256(const uint8_t *block, WORD *H5, WORD *H256)
+{
+    WORD X[16], W[64];
+    WORD a = H5[0], b = H5[1], c = H5[2], d = H5[3], f, tmp;
+    WORD sa = H256[0], sb = H256[1], sc = H256[2], sd = H256[3];
+    WORD se = H256[4], sf = H256[5], sg = H256[6], sh = H256[7], T1, T2;
+    int t;
+
+    for (t = 0; t < 16; t++){
+        const uint8_t *p = block + 4 * t;
+        X[t] = (WORD) p[0] | ((WORD) p[1] << 8) | ((WORD) p[2] << 16) | ((WORD) p[3] << 24);
+        W[t] = bswap_32(X[t]);
+    }
+    for (t = 16; t < 64; t++){
+        W[t] = sig1(W[t-2]) + W[t-7] + sig0(W[t-15]) + W[t-16];
+    }
+
+    // One MD5 step with round function FN, then SHA-256 round t.
+#define MD5_SHA256_STEP(FN) do {                                        \
+        f = FN(b, c, d) + a + X[MD5_Message_Index[t]] + K[t];          \
+        tmp = d; d = c; c = b;                                          \
+        b = b + ROTATE_LEFT(f, MD5_Shift[t / 16][t % 4]);               \
+        a = tmp;                                                        \
+        T1 = sh + Sig1(se) + Ch(se, sf, sg) + K256[t] + W[t];          \
+        T2 = Sig0(sa) + Maj(sa, sb, sc);                                \
+        sh = sg; sg = sf; sf = se; se = sd + T1;                        \
+        sd = sc; sc = sb; sb = sa; sa = T1 + T2;                        \
+    } while (0)
+
+    // A loop per MD5 round, so the round function is fixed, unrolled so the
+    // shift amounts and message indices become constants.
+#pragma GCC unroll 16
+    for (t = 0; t < 16; t++){ MD5_SHA256_STEP(F); }
+#pragma GCC unroll 16
+    for (; t < 32; t++){ MD5_SHA256_STEP(G); }
+#pragma GCC unroll 16
+    for (; t < 48; t++){ MD5_SHA256_STEP(H); }
+#pragma GCC unroll 16
+    for (; t < 64; t++){ MD5_SHA256_STEP(I); }
+#undef MD5_SHA256_STEP
+
+    H5[0] += a; H5[1] += b; H5[2] += c; H5[3] += d;
+    H256[0] += sa; H256[1] += sb; H256[2] += sc; H256[3] += sd;
+    H256[4] += se; H256[5] += sf; H256[6] += sg; H256[7] += sh;
+}
+
+/**
+ * Run whole blocks through the fused kernel and count them in both contexts.
+ * Both contexts must be on a block boundary.
+ * @param md5
+ * @param sha
+ * @param data
+ * @param whole - a multiple of 64
+ */
+static void md5_sha256_blocks(MD5_CTX *md5, SHA256_CTX *sha, const uint8_t *data, size_t whole)
+{
+    for (size_t i = 0; i < whole; i += 64){
+        nexthash_md5_sha256(data + i, md5->H, sha->H);
+    }
+    md5->numbits += 8ULL * whole;
+    sha->numbits += 8ULL * whole;
+}
+
+/**
+ * MD5 and SHA-256 of a message in memory.
+ * @param data
+ * @param len
+ * @param H5 - receives the four MD5 state words
+ * @param H256 - receives the eight SHA-256 state words
+ */
+void md5_sha256(const uint8_t *data, size_t len, WORD *H5, WORD *H256)
+{
+    MD5_CTX md5;
+    SHA256_CTX sha;
+    size_t whole = len - len % 64;
+
+    md5_init(&md5);
+    sha256_init(&sha);
+    md5_sha256_blocks(&md5, &sha, data, whole);
+    md5_update(&md5, data + whole, len - whole);
+    sha256_update(&sha, data + whole, len - whole);
+    md5_final(&md5, H5);
+    sha256_final(&sha, H256);
+}
+
+/**
+ * MD5 and SHA-256 of a file from a single read of it.
+ * Whole blocks go through the fused kernel, the tail is padded by each
+ * algorithm's own final step. Leaves the file open.
+ * @param f
+ * @param H5 - receives the four MD5 state words
+ * @param H256 - receives the eight SHA-256 state words
+ * @return 1 on success, 0 on a read error
+ */
+int md5_sha256_stream(FILE *f, WORD *H5, WORD *H256)
+{
+    MD5_CTX md5;
+    SHA256_CTX sha;
+    uint8_t *chunk = malloc(MULTIDIGEST_CHUNK);
+    size_t n;
+
+    if (!chunk) { return 0; }
+    md5_init(&md5);
+    sha256_init(&sha);
+
+    while ((n = fread(chunk, 1, MULTIDIGEST_CHUNK, f)) > 0){
+        size_t whole = n - n % 64;
+        md5_sha256_blocks(&md5, &sha, chunk, whole);
+        // Only the last chunk of the file can be short.
+        md5_update(&md5, chunk + whole, n - whole);
+        sha256_update(&sha, chunk + whole, n - whole);
+        if (n < MULTIDIGEST_CHUNK) { break; }
+    }
+
+    int ok = !ferror(f);
+    free(chunk);
+    md5_final(&md5, H5);
+    sha256_final(&sha, H256);
+    return ok;
+}
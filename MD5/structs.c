@@ -0,0 +1,55 @@
+/**
+ * Streaming MD5 state, for hashing messages that are already in memory.
+ * H       - the four state words A, B, C, D
+ * numbits - message bits absorbed so far, including any midstate prefix
+ * buf     - bytes waiting to make up a full 64 byte block
+ * buflen  - number of bytes waiting in buf
+ */
+typedef struct {
+    WORD H[4];
+    uint64_t numbits;
+    union BLOCK buf;
+    uint32_t buflen;
+} MD5_CTX;
+
+/**
+ * The MD5 state after a block-aligned prefix.
+ * Messages that share the prefix start from here instead of the initial constants,
+ * so the prefix blocks are only ever compressed once.
+ */
+typedef struct {
+    WORD H[4];
+    uint64_t numbits;
+} MD5_MIDSTATE;
+
+/**
+ * A message for the multi-buffer lanes. It continues from the midstate from
+ * (or the initial constants when NULL) and its final state is left in H.
+ */
+typedef struct {
+    const MD5_MIDSTATE *from;
+    const uint8_t *data;
+    size_t len;
+    WORD H[4];
+} MD5_MBJOB;
+
+/**
+ * A key prepared for HMAC: the midstates after (K ^ ipad) and (K ^ opad).
+ */
+typedef struct {
+    MD5_MIDSTATE inner;
+    MD5_MIDSTATE outer;
+} HMAC_MD5_KEY;
+
+/**
+ * One (key, message, tag) tuple for batch verification.
+ * ok is set to 1 when the first taglen bytes of the HMAC match tag.
+ */
+typedef struct {
+    const HMAC_MD5_KEY *key;
+    const uint8_t *msg;
+    size_t len;
+    const uint8_t *tag;
+    size_t taglen;
+    int ok;
+} HMAC_MD5_VERIFYJOB;
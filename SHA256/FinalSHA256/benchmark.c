@@ -0,0 +1,97 @@
+// Kernels measured by --bench, each wrapped as a Common/bench.c callback that
+// hashes a batch of equal sized messages.
+
+#include "../../Common/bench.c"
+
+// nexthash256 through the streaming API, one message at a time.
+static void bench_sha256_scalar(void *arg, const uint8_t *data, size_t len, size_t nmsg) {
+    SHA256_CTX ctx;
+    WORD H[8];
+    (void) arg;
+    for (size_t i = 0; i < nmsg; i++) {
+        sha256_init(&ctx);
+        sha256_update(&ctx, data + i * len, len);
+        sha256_final(&ctx, H);
+    }
+}
+
+// nexthash_lanes, SHA256_LANES messages per pass.
+static void bench_sha256_lanes(void *arg, const uint8_t *data, size_t len, size_t nmsg) {
+    SHA256_MBJOB jobs[SHA256_LANES];
+    (void) arg;
+    for (size_t i = 0; i < nmsg; i++) {
+        jobs[i].from = NULL;
+        jobs[i].data = data + i * len;
+        jobs[i].len = len;
+    }
+    sha256_mb_hash(jobs, nmsg);
+}
+
+// The same lanes behind the job manager: each message submitted on its own, then
+// one wait, so the cost of the hand-off to the manager thread shows.
+static void bench_sha256_jobmgr(void *arg, const uint8_t *data, size_t len, size_t nmsg) {
+    JOBMGR_JOB jobs[SHA256_LANES];
+    int left = (int) nmsg;
+    for (size_t i = 0; i < nmsg; i++) {
+        jobs[i].data = data + i * len;
+        jobs[i].len = len;
+        jobs[i].cb = jobmgr_countdown;
+        jobs[i].user = &left;
+        jobmgr_submit((JOBMGR *) arg, &jobs[i]);
+    }
+    jobmgr_wait((JOBMGR *) arg, &left);
+}
+
+// The fixed length kernels of fixed.c; len is always 32 or 64.
+static void bench_sha256_fixed(void *arg, const uint8_t *data, size_t len, size_t nmsg) {
+    uint8_t out[32];
+    (void) arg;
+    for (size_t i = 0; i < nmsg; i++) {
+        if (len == 32)
+            sha256_32(data + i * len, out);
+        else
+            sha256_64(data + i * len, out);
+    }
+}
+
+// nexthash512 through the streaming API; arg points at the DIGESTALGO.
+static void bench_sha512_scalar(void *arg, const uint8_t *data, size_t len, size_t nmsg) {
+    SHA512_CTX ctx;
+    uint8_t out[64];
+    for (size_t i = 0; i < nmsg; i++) {
+        sha512_init(&ctx, *(const DIGESTALGO *) arg);
+        sha512_update(&ctx, data + i * len, len);
+        sha512_final(&ctx, out);
+    }
+}
+
+// nexthash512_lanes, SHA512_LANES messages per pass.
+static void bench_sha512_lanes(void *arg, const uint8_t *data, size_t len, size_t nmsg) {
+    SHA512_MBJOB jobs[SHA512_LANES];
+    for (size_t i = 0; i < nmsg; i++) {
+        jobs[i].algo = *(const DIGESTALGO *) arg;
+        jobs[i].data = data + i * len;
+        jobs[i].len = len;
+    }
+    sha512_mb_hash(jobs, nmsg);
+}
+
+// Run the SHA benchmark and print the JSON report to stdout.
+int sha256_bench(uint64_t maxbytes) {
+    static DIGESTALGO sha512 = ALGO_SHA512;
+    JOBMGR mgr;
+    if (!jobmgr_init(&mgr, &SHA256_JOBMGR, 0))
+        return 0;
+    const BENCH_KERNEL kernels[] = {
+        { "sha256_nexthash256",   bench_sha256_scalar, NULL,    1,             0,  0 },
+        { "sha256_nexthash_lanes", bench_sha256_lanes, NULL,    SHA256_LANES,  0,  0 },
+        { "sha256_jobmgr",        bench_sha256_jobmgr, &mgr,    SHA256_LANES,  0,  0 },
+        { "sha256_nexthash32",    bench_sha256_fixed,  NULL,    1,             32, 32 },
+        { "sha256_nexthash64pad", bench_sha256_fixed,  NULL,    1,             64, 64 },
+        { "sha512_nexthash512",   bench_sha512_scalar, &sha512, 1,             0,  0 },
+        { "sha512_nexthash512_lanes", bench_sha512_lanes, &sha512, SHA512_LANES, 0, 0 },
+    };
+    int ok = bench_run(stdout, "FinalSHA256", kernels, sizeof(kernels) / sizeof(kernels[0]), maxbytes);
+    jobmgr_destroy(&mgr);
+    return ok;
+}
@@ -0,0 +1,181 @@
+// Fixed length SHA-256 kernels for 32 and 64 byte messages.
+// Digest-of-digest (SHA256d) and Merkle tree nodes only ever hash 32 or 64
+// bytes, so the padding is known in advance:
+//  - a 32 byte message is one block whose words 8..15 are 0x80000000, six
+//    zero words and the length 256;
+//  - a 64 byte message is its data block followed by a block that is nothing
+//    but padding (0x80000000, zeros, length 512).
+// The constant words are folded into the code below. Their K[t] + W[t] sums
+// and the whole schedule of the padding block were generated offline from
+// the section 6.2.2 recurrence; the fixed-length paths never go near nextblock.
+
+// K[t] + W[t] for t = 8..15 of a 32 byte message block.
+static const WORD KW32[8] = {
+        0x5807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+        0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf274
+};
+
+// K[t] + W[t] for the padding block of a 64 byte message.
+static const WORD KW64PAD[64] = {
+        0xc28a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+        0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+        0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf374,
+        0x649b69c1, 0xf0fe4786, 0x0fe1edc6, 0x240cf254,
+        0x4fe9346f, 0x6cc984be, 0x61b9411e, 0x16f988fa,
+        0xf2c65152, 0xa88e5a6d, 0xb019fc65, 0xb9d99ec7,
+        0x9a1231c3, 0xe70eeaa0, 0xfdb1232b, 0xc7353eb0,
+        0x3069bad5, 0xcb976d5f, 0x5a0f118f, 0xdc1eeefd,
+        0x0a35b689, 0xde0b7a04, 0x58f4ca9d, 0xe15d5b16,
+        0x007f3e86, 0x37088980, 0xa507ea32, 0x6fab9537,
+        0x17406110, 0x0d8cd6f1, 0xcdaa3b6d, 0xc0bbbe37,
+        0x83613bda, 0xdb48a363, 0x0b02e931, 0x6fd15ca7,
+        0x521afaca, 0x31338431, 0x6ed41a95, 0x6d437890,
+        0xc39c91f2, 0x9eccabbd, 0xb5c9a0e6, 0x532fb63c,
+        0xd2c741c6, 0x07237ea3, 0xa4954b68, 0x4c191d76
+};
+
+// One round with the K[t] + W[t] sum already made.
+#define ROUND(kw) do {                                      \
+        T1 = h + Sig1(e) + Ch(e, f, g) + (kw);              \
+        T2 = Sig0(a) + Maj(a, b, c);                        \
+        h = g; g = f; f = e; e = d + T1;                    \
+        d = c; c = b; b = a; a = T1 + T2;                   \
+    } while (0)
+
+// Read 8 big endian words.
+static void sha256_load8(const uint8_t *p, WORD *X) {
+    for (int i = 0; i < 8; i++)
+        X[i] = ((WORD) p[4*i] << 24) | ((WORD) p[4*i+1] << 16) | ((WORD) p[4*i+2] << 8) | (WORD) p[4*i+3];
+}
+
+// Compress a 32 byte message block (X[0..7] plus its padding) into H.
+// Words 8..15 are constants, so W[16..31] only compute their variable terms.
+void nexthash32(const WORD *X, WORD *H) {
+
+    WORD W[64];
+    WORD a, b, c, d, e, f, g, h, T1, T2;
+    int t;
+
+    for (t = 0; t < 8; t++)
+        W[t] = X[t];
+
+    W[16] = sig0(W[1]) + W[0];
+    W[17] = 0x00a00000 + sig0(W[2]) + W[1];
+    W[18] = sig1(W[16]) + sig0(W[3]) + W[2];
+    W[19] = sig1(W[17]) + sig0(W[4]) + W[3];
+    W[20] = sig1(W[18]) + sig0(W[5]) + W[4];
+    W[21] = sig1(W[19]) + sig0(W[6]) + W[5];
+    W[22] = sig1(W[20]) + 0x00000100 + sig0(W[7]) + W[6];
+    W[23] = sig1(W[21]) + W[16] + 0x11002000 + W[7];
+    W[24] = sig1(W[22]) + W[17] + 0x80000000;
+    W[25] = sig1(W[23]) + W[18];
+    W[26] = sig1(W[24]) + W[19];
+    W[27] = sig1(W[25]) + W[20];
+    W[28] = sig1(W[26]) + W[21];
+    W[29] = sig1(W[27]) + W[22];
+    W[30] = sig1(W[28]) + W[23] + 0x00400022;
+    W[31] = sig1(W[29]) + W[24] + sig0(W[16]) + 0x00000100;
+    for (t = 32; t < 64; t++)
+        W[t] = sig1(W[t-2]) + W[t-7] + sig0(W[t-15]) + W[t-16];
+
+    a = H[0]; b = H[1]; c = H[2]; d = H[3];
+    e = H[4]; f = H[5]; g = H[6]; h = H[7];
+
+    for (t = 0; t < 8; t++)
+        ROUND(K256[t] + W[t]);
+    for (t = 8; t < 16; t++)
+        ROUND(KW32[t - 8]);
+    for (t = 16; t < 64; t++)
+        ROUND(K256[t] + W[t]);
+
+    H[0] += a; H[1] += b; H[2] += c; H[3] += d;
+    H[4] += e; H[5] += f; H[6] += g; H[7] += h;
+}
+
+// Compress the padding block of a 64 byte message: no schedule at all.
+void nexthash64pad(WORD *H) {
+
+    WORD a, b, c, d, e, f, g, h, T1, T2;
+
+    a = H[0]; b = H[1]; c = H[2]; d = H[3];
+    e = H[4]; f = H[5]; g = H[6]; h = H[7];
+
+    for (int t = 0; t < 64; t++)
+        ROUND(KW64PAD[t]);
+
+    H[0] += a; H[1] += b; H[2] += c; H[3] += d;
+    H[4] += e; H[5] += f; H[6] += g; H[7] += h;
+}
+
+#undef ROUND
+
+// SHA-256 of exactly 32 bytes.
+void sha256_32(const uint8_t *in, uint8_t *out) {
+    WORD X[8], H[8];
+    memcpy(H, H0, sizeof(H));
+    sha256_load8(in, X);
+    nexthash32(X, H);
+    sha256_digest_bytes(H, out);
+}
+
+// SHA-256 of exactly 64 bytes.
+void sha256_64(const uint8_t *in, uint8_t *out) {
+    WORD M[16], H[8];
+    memcpy(H, H0, sizeof(H));
+    sha256_load8(in, M);
+    sha256_load8(in + 32, M + 8);
+    nexthash256(M, H);
+    nexthash64pad(H);
+    sha256_digest_bytes(H, out);
+}
+
+// SHA256d(x) = SHA-256(SHA-256(x)); the outer hash is always a 32 byte kernel.
+void sha256d(const uint8_t *in, size_t len, uint8_t *out) {
+    SHA256_CTX ctx;
+    WORD X[8];
+
+    if (len == 32 || len == 64) {
+        uint8_t inner[32];
+        if (len == 32)
+            sha256_32(in, inner);
+        else
+            sha256_64(in, inner);
+        sha256_32(inner, out);
+        return;
+    }
+
+    sha256_init(&ctx);
+    sha256_update(&ctx, in, len);
+    sha256_final(&ctx, X);
+    {
+        WORD H[8];
+        memcpy(H, H0, sizeof(H));
+        nexthash32(X, H);
+        sha256_digest_bytes(H, out);
+    }
+}
+
+// Merkle node: SHA256d(left || right).
+void merkle_node(const uint8_t *left, const uint8_t *right, uint8_t *out) {
+    uint8_t pair[64];
+    memcpy(pair, left, 32);
+    memcpy(pair + 32, right, 32);
+    sha256d(pair, 64, out);
+}
+
+// Root of a Merkle tree over n 32 byte leaves, paired level by level with the
+// last node of an odd level paired with itself. The leaves are overwritten.
+void merkle_root(uint8_t (*nodes)[32], size_t n, uint8_t *root) {
+    if (n == 0) {
+        memset(root, 0, 32);
+        return;
+    }
+    while (n > 1) {
+        size_t i, m = 0;
+        for (i = 0; i < n; i += 2, m++)
+            merkle_node(nodes[i], nodes[i + 1 < n ? i + 1 : i], nodes[m]);
+        n = m;
+    }
+    memcpy(root, nodes[0], 32);
+}
@@ -0,0 +1,405 @@
+// --fuzz: every SHA-256 and SHA-512 family kernel and input engine against a
+// reference nexthash256/nexthash512 (Common/fuzz.c), after the NIST known answers.
+
+#include "../../Common/fuzz.c"
+
+// In main.c.
+int sha256_file(const char *path, DIGESTCACHE *cache, const SHA256_MIDSTATE *ms, INPUT_ENGINE engine, WORD *H);
+int sha512_file(const char *path, DIGESTCACHE *cache, DIGESTALGO algo, INPUT_ENGINE engine, uint8_t *digest);
+int hex_decode(const char *hex, uint8_t *out, size_t outlen);
+
+// Messages batched with the case in the lanes, so they are out of step.
+#define SHA256_FUZZ_JOBS (SHA256_LANES + 3)
+#define SHA512_FUZZ_JOBS (SHA512_LANES + 3)
+
+static WORD fuzz_be32(const uint8_t *p) {
+    return ((WORD) p[0] << 24) | ((WORD) p[1] << 16) | ((WORD) p[2] << 8) | (WORD) p[3];
+}
+
+static WORD64 fuzz_be64(const uint8_t *p) {
+    return ((WORD64) fuzz_be32(p) << 32) | fuzz_be32(p + 4);
+}
+
+// Reference SHA-256: section 5.1.1 padding done in memory, then nexthash256 on
+// each block. Shares nothing with sha256_update, nextblock or padtail.
+static void sha256_reference(const uint8_t *data, size_t len, WORD *H) {
+    WORD M[16];
+    uint8_t tail[128];
+    size_t whole = len - len % 64, rem = len % 64;
+    size_t n = rem < 56 ? 64 : 128;
+    uint64_t bits = 8ULL * len;
+    int t;
+
+    memcpy(H, H0, 8 * sizeof(WORD));
+    for (size_t i = 0; i < whole; i += 64) {
+        for (t = 0; t < 16; t++)
+            M[t] = fuzz_be32(data + i + 4 * t);
+        nexthash256(M, H);
+    }
+    memset(tail, 0, sizeof(tail));
+    memcpy(tail, data + whole, rem);
+    tail[rem] = 0x80;
+    for (t = 0; t < 8; t++)
+        tail[n - 1 - t] = (uint8_t) (bits >> (8 * t));
+    for (size_t i = 0; i < n; i += 64) {
+        for (t = 0; t < 16; t++)
+            M[t] = fuzz_be32(tail + i + 4 * t);
+        nexthash256(M, H);
+    }
+}
+
+// Reference SHA-512 family digest: section 5.1.2 padding in memory, nexthash512 per block.
+static void sha512_reference(const uint8_t *data, size_t len, DIGESTALGO algo, uint8_t *digest) {
+    WORD64 M[16], H[8];
+    uint8_t tail[256];
+    size_t whole = len - len % 128, rem = len % 128;
+    size_t n = rem < 112 ? 128 : 256;
+    uint64_t bits = 8ULL * len;
+    int t;
+
+    memcpy(H, sha512_iv(algo), sizeof(H));
+    for (size_t i = 0; i < whole; i += 128) {
+        for (t = 0; t < 16; t++)
+            M[t] = fuzz_be64(data + i + 8 * t);
+        nexthash512(M, H);
+    }
+    memset(tail, 0, sizeof(tail));
+    memcpy(tail, data + whole, rem);
+    tail[rem] = 0x80;
+    // A size_t length never reaches the top 64 bits of the 128 bit length field.
+    for (t = 0; t < 8; t++)
+        tail[n - 1 - t] = (uint8_t) (bits >> (8 * t));
+    for (size_t i = 0; i < n; i += 128) {
+        for (t = 0; t < 16; t++)
+            M[t] = fuzz_be64(tail + i + 8 * t);
+        nexthash512(M, H);
+    }
+    sha512_digest_bytes(H, algo, digest);
+}
+
+static const char *const SHA512_FUZZ_NAMES[] = {"", "", "", "SHA-512", "SHA-384", "SHA-512/256"};
+
+// Compare two digests and describe a difference.
+static int sha_fuzz_same(const char *kernel, const uint8_t *want, const uint8_t *got, size_t n,
+                         char *why, size_t whylen) {
+    if (memcmp(want, got, n) == 0)
+        return 1;
+    int k = snprintf(why, whylen, "%s gave ", kernel);
+    for (size_t i = 0; i < n && k > 0 && (size_t) k + 3 < whylen; i++)
+        k += snprintf(why + k, whylen - k, "%02" PRIx8, got[i]);
+    if (k > 0 && (size_t) k + 20 < whylen)
+        k += snprintf(why + k, whylen - k, ", reference gave ");
+    for (size_t i = 0; i < n && k > 0 && (size_t) k + 3 < whylen; i++)
+        k += snprintf(why + k, whylen - k, "%02" PRIx8, want[i]);
+    return 0;
+}
+
+static int sha256_fuzz_same(const char *kernel, const WORD *want, const WORD *got, char *why, size_t whylen) {
+    uint8_t a[32], b[32];
+    sha256_digest_bytes(want, a);
+    sha256_digest_bytes(got, b);
+    return sha_fuzz_same(kernel, a, b, 32, why, whylen);
+}
+
+// Split a message into up to eight update calls of random sizes, some tiny.
+static size_t fuzz_piece(uint64_t *s, size_t left) {
+    size_t bound = fuzz_rand(s) & 1 ? 200 : left + 1;
+    size_t take = (size_t) (fuzz_rand(s) % bound);
+    return take > left ? left : take;
+}
+
+// Hash one case every way the tool can and compare with the references; arg is the JOBMGR.
+static int sha_fuzz_check(void *arg, const FUZZ_CASE *c, char *why, size_t whylen) {
+    WORD ref[8], got[8];
+    SHA256_CTX ctx;
+    uint64_t s = c->seed;
+    int n = 0;
+
+#define SHA256_FUZZ_SAME(kernel, want, have) do { \
+        if (!sha256_fuzz_same(kernel, want, have, why, whylen)) { return -1; } n++; } while (0)
+#define BYTES_FUZZ_SAME(kernel, want, have, len) do { \
+        if (!sha_fuzz_same(kernel, want, have, len, why, whylen)) { return -1; } n++; } while (0)
+
+    sha256_reference(c->data, c->len, ref);
+
+    // The streaming API, in one call and in pieces.
+    sha256_init(&ctx);
+    sha256_update(&ctx, c->data, c->len);
+    sha256_final(&ctx, got);
+    SHA256_FUZZ_SAME("sha256_update", ref, got);
+
+    sha256_init(&ctx);
+    size_t done = 0;
+    for (int piece = 0; piece < 7 && done < c->len; piece++) {
+        size_t take = fuzz_piece(&s, c->len - done);
+        sha256_update(&ctx, c->data + done, take);
+        done += take;
+    }
+    sha256_update(&ctx, c->data + done, c->len - done);
+    sha256_final(&ctx, got);
+    SHA256_FUZZ_SAME("sha256_update (split)", ref, got);
+
+    // The same kind of pieces as one scatter-gather chain, empty segments included.
+    {
+        struct iovec iov[8];
+        size_t nseg = 0;
+        for (done = 0; nseg < 7; nseg++) {
+            size_t take = fuzz_piece(&s, c->len - done);
+            iov[nseg].iov_base = (void *) (c->data + done);
+            iov[nseg].iov_len = take;
+            done += take;
+        }
+        iov[nseg].iov_base = (void *) (c->data + done);
+        iov[nseg++].iov_len = c->len - done;
+        sha256_init(&ctx);
+        sha256_update_iov(&ctx, iov, nseg);
+        sha256_final(&ctx, got);
+        SHA256_FUZZ_SAME("sha256_update_iov", ref, got);
+    }
+
+    // Continuing from the midstate of a block-aligned prefix.
+    if (c->len >= 64) {
+        SHA256_MIDSTATE ms;
+        size_t prefix = 64 * (size_t) (fuzz_rand(&s) % (c->len / 64) + 1);
+        sha256_midstate(c->data, prefix, &ms);
+        sha256_init_midstate(&ctx, &ms);
+        sha256_update(&ctx, c->data + prefix, c->len - prefix);
+        sha256_final(&ctx, got);
+        SHA256_FUZZ_SAME("sha256_init_midstate", ref, got);
+    }
+
+    // The lanes, with shorter neighbours and more jobs than lanes so they refill.
+    {
+        SHA256_MBJOB jobs[SHA256_FUZZ_JOBS];
+        size_t cap = c->len < 2048 ? c->len : 2048;
+        jobs[0].from = NULL; jobs[0].data = c->data; jobs[0].len = c->len;
+        for (int j = 1; j < SHA256_FUZZ_JOBS; j++) {
+            size_t off = (size_t) (fuzz_rand(&s) % (cap + 1));
+            jobs[j].from = NULL;
+            jobs[j].data = c->data + off;
+            jobs[j].len = (size_t) (fuzz_rand(&s) % (cap - off + 1));
+        }
+        sha256_mb_hash(jobs, SHA256_FUZZ_JOBS);
+        SHA256_FUZZ_SAME("nexthash_lanes", ref, jobs[0].H);
+        for (int j = 1; j < SHA256_FUZZ_JOBS; j++) {
+            sha256_reference(jobs[j].data, jobs[j].len, got);
+            SHA256_FUZZ_SAME("nexthash_lanes (neighbour)", got, jobs[j].H);
+        }
+    }
+
+    // The job manager: the case and its neighbours submitted one by one, waited on
+    // together, sharing the lanes with whatever the other fuzz threads submit.
+    {
+        JOBMGR_JOB jobs[SHA256_FUZZ_JOBS];
+        size_t cap = c->len < 2048 ? c->len : 2048;
+        int left = SHA256_FUZZ_JOBS;
+        for (int j = 0; j < SHA256_FUZZ_JOBS; j++) {
+            size_t off = j ? (size_t) (fuzz_rand(&s) % (cap + 1)) : 0;
+            jobs[j].data = c->data + off;
+            jobs[j].len = j ? (size_t) (fuzz_rand(&s) % (cap - off + 1)) : c->len;
+            jobs[j].cb = jobmgr_countdown;
+            jobs[j].user = &left;
+            jobmgr_submit((JOBMGR *) arg, &jobs[j]);
+        }
+        jobmgr_wait((JOBMGR *) arg, &left);
+        for (int j = 0; j < SHA256_FUZZ_JOBS; j++) {
+            uint8_t want[32];
+            sha256_reference(jobs[j].data, jobs[j].len, got);
+            sha256_digest_bytes(got, want);
+            BYTES_FUZZ_SAME(j ? "jobmgr (neighbour)" : "jobmgr", want, jobs[j].digest, 32);
+        }
+    }
+
+    // The fixed length kernels: SHA-256 of 32 and 64 bytes, and SHA256d of anything.
+    {
+        uint8_t want[32], have[32];
+        WORD outer[8];
+        sha256_digest_bytes(ref, want);
+        if (c->len == 32 || c->len == 64) {
+            if (c->len == 32)
+                sha256_32(c->data, have);
+            else
+                sha256_64(c->data, have);
+            BYTES_FUZZ_SAME(c->len == 32 ? "sha256_32" : "sha256_64", want, have, 32);
+        }
+        sha256_reference(want, 32, outer);
+        sha256_digest_bytes(outer, want);
+        sha256d(c->data, c->len, have);
+        BYTES_FUZZ_SAME("sha256d", want, have, 32);
+    }
+
+    // One of the SHA-512 family per case, streaming, split and in the lanes.
+    DIGESTALGO algo = (DIGESTALGO) (ALGO_SHA512 + (int) (c->seed % 3));
+    size_t dlen = sha512_digest_len(algo);
+    uint8_t ref512[64], got512[64];
+    char kernel[64];
+    {
+        SHA512_CTX ctx512;
+        sha512_reference(c->data, c->len, algo, ref512);
+
+        sha512_init(&ctx512, algo);
+        sha512_update(&ctx512, c->data, c->len);
+        sha512_final(&ctx512, got512);
+        snprintf(kernel, sizeof(kernel), "%s sha512_update", SHA512_FUZZ_NAMES[algo]);
+        BYTES_FUZZ_SAME(kernel, ref512, got512, dlen);
+
+        sha512_init(&ctx512, algo);
+        done = 0;
+        for (int piece = 0; piece < 7 && done < c->len; piece++) {
+            size_t take = fuzz_piece(&s, c->len - done);
+            sha512_update(&ctx512, c->data + done, take);
+            done += take;
+        }
+        sha512_update(&ctx512, c->data + done, c->len - done);
+        sha512_final(&ctx512, got512);
+        snprintf(kernel, sizeof(kernel), "%s sha512_update (split)", SHA512_FUZZ_NAMES[algo]);
+        BYTES_FUZZ_SAME(kernel, ref512, got512, dlen);
+
+        SHA512_MBJOB jobs[SHA512_FUZZ_JOBS];
+        size_t cap = c->len < 2048 ? c->len : 2048;
+        jobs[0].algo = algo; jobs[0].data = c->data; jobs[0].len = c->len;
+        for (int j = 1; j < SHA512_FUZZ_JOBS; j++) {
+            size_t off = (size_t) (fuzz_rand(&s) % (cap + 1));
+            jobs[j].algo = (DIGESTALGO) (ALGO_SHA512 + (int) (fuzz_rand(&s) % 3));
+            jobs[j].data = c->data + off;
+            jobs[j].len = (size_t) (fuzz_rand(&s) % (cap - off + 1));
+        }
+        sha512_mb_hash(jobs, SHA512_FUZZ_JOBS);
+        snprintf(kernel, sizeof(kernel), "%s nexthash512_lanes", SHA512_FUZZ_NAMES[algo]);
+        BYTES_FUZZ_SAME(kernel, ref512, jobs[0].digest, dlen);
+        for (int j = 1; j < SHA512_FUZZ_JOBS; j++) {
+            sha512_reference(jobs[j].data, jobs[j].len, jobs[j].algo, got512);
+            snprintf(kernel, sizeof(kernel), "%s nexthash512_lanes (neighbour)", SHA512_FUZZ_NAMES[jobs[j].algo]);
+            BYTES_FUZZ_SAME(kernel, got512, jobs[j].digest, sha512_digest_len(jobs[j].algo));
+        }
+    }
+
+    // From a file: nextblock/nextblock512 over stdio and every input engine, and
+    // the kernel's SHA-256 through AF_ALG.
+    if (c->files) {
+        char path[4096];
+        int ok = 1;
+        if (!fuzz_tempfile(c->data, c->len, path, sizeof(path))) {
+            snprintf(why, whylen, "could not write a temporary file");
+            return -1;
+        }
+        for (int e = ENGINE_STDIO; ok && e <= ENGINE_AFALG; e++) {
+            snprintf(kernel, sizeof(kernel), "--engine %s", INPUT_ENGINE_NAMES[e]);
+            ok = sha256_file(path, NULL, NULL, (INPUT_ENGINE) e, got) && sha256_fuzz_same(kernel, ref, got, why, whylen);
+            snprintf(kernel, sizeof(kernel), "%s --engine %s", SHA512_FUZZ_NAMES[algo], INPUT_ENGINE_NAMES[e]);
+            ok = ok && sha512_file(path, NULL, algo, (INPUT_ENGINE) e, got512)
+                 && sha_fuzz_same(kernel, ref512, got512, dlen, why, whylen);
+            n += 2;
+        }
+        remove(path);
+        if (!ok) {
+            if (!why[0])
+                snprintf(why, whylen, "could not read back %s", path);
+            return -1;
+        }
+    }
+#undef SHA256_FUZZ_SAME
+#undef BYTES_FUZZ_SAME
+    return n;
+}
+
+// FIPS 180-4 examples, NIST CAVP SHA256ShortMsg entries and the million 'a' message,
+// through the references. Returns the number that failed.
+static int sha_fuzz_kat(void) {
+    static const char m448[] = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+    static const char m896[] = "abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmn"
+                               "hijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu";
+    static const struct { const char *name; const char *msg; int hex; const char *digest; } sha256_kats[] = {
+            {"SHA-256 empty", "", 0, "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855"},
+            {"SHA-256 abc", "abc", 0, "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"},
+            {"SHA-256 448 bits", m448, 0, "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1"},
+            {"SHA-256 896 bits", m896, 0, "cf5b16a778af8380036ce59e7b0492370b249b11e8f07a51afac45037afee9d1"},
+            {"SHA256ShortMsg Len = 8", "d3", 1, "28969cdfa74a12c82f3bad960b0b000aca2ac329deea5c2328ebc6f2ba9802c1"},
+            {"SHA256ShortMsg Len = 16", "11af", 1, "5ca7133fa735326081558ac312c620eeca9970d1e70a4b95533d956f072d1f98"},
+            {"SHA256ShortMsg Len = 24", "b4190e", 1, "dff2e73091f6c05e528896c4c831b9448653dc2ff043528f6769437bc7b975c2"},
+            {"SHA256ShortMsg Len = 32", "74ba2521", 1, "b16aa56be3880d18cd41e68384cf1ec8c17680c45a02b1575dc1518923ae8b0e"},
+    };
+    static const struct { const char *name; const char *msg; DIGESTALGO algo; const char *digest; } sha512_kats[] = {
+            {"SHA-512 abc", "abc", ALGO_SHA512,
+             "ddaf35a193617abacc417349ae20413112e6fa4e89a97ea20a9eeee64b55d39a2192992a274fc1a836ba3c23a3feebbd454d4423643ce80e2a9ac94fa54ca49f"},
+            {"SHA-512 896 bits", m896, ALGO_SHA512,
+             "8e959b75dae313da8cf4f72814fc143f8f7779c6eb9f7fa17299aeadb6889018501d289e4900f7e4331b99dec4b5433ac7d329eeb6dd26545e96e55b874be909"},
+            {"SHA-384 abc", "abc", ALGO_SHA384,
+             "cb00753f45a35e8bb5a03d699ac65007272c32ab0eded1631a8b605a43ff5bed8086072ba1e7cc2358baeca134c825a7"},
+            {"SHA-384 896 bits", m896, ALGO_SHA384,
+             "09330c33f71147e83d192fc782cd1b4753111b173b3b05d22fa08086e3b0f712fcc7c71a557e2db966c3e9fa91746039"},
+            {"SHA-512/256 abc", "abc", ALGO_SHA512_256, "53048e2681941ef99b2e29b76b4c7dabe4c2d0c634fc6d46e0e2f13107e7af23"},
+            {"SHA-512/256 896 bits", m896, ALGO_SHA512_256, "3928e184fb8690f840da3988121d31be65cb9d3ef83ee6146feac861e19b563a"},
+    };
+    uint8_t msg[128], digest[64];
+    WORD H[8];
+    int failed = 0;
+
+    for (size_t i = 0; i < sizeof(sha256_kats) / sizeof(sha256_kats[0]); i++) {
+        size_t len = strlen(sha256_kats[i].msg);
+        if (sha256_kats[i].hex)
+            len = (size_t) hex_decode(sha256_kats[i].msg, msg, sizeof(msg));
+        else
+            memcpy(msg, sha256_kats[i].msg, len);
+        sha256_reference(msg, len, H);
+        sha256_digest_bytes(H, digest);
+        failed += !fuzz_kat(sha256_kats[i].name, digest, 32, sha256_kats[i].digest);
+    }
+    for (size_t i = 0; i < sizeof(sha512_kats) / sizeof(sha512_kats[0]); i++) {
+        sha512_reference((const uint8_t *) sha512_kats[i].msg, strlen(sha512_kats[i].msg), sha512_kats[i].algo, digest);
+        failed += !fuzz_kat(sha512_kats[i].name, digest, sha512_digest_len(sha512_kats[i].algo), sha512_kats[i].digest);
+    }
+
+    uint8_t *a = malloc(1000000);
+    if (a) {
+        memset(a, 'a', 1000000);
+        sha256_reference(a, 1000000, H);
+        sha256_digest_bytes(H, digest);
+        failed += !fuzz_kat("SHA-256 one million 'a'", digest, 32,
+                            "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+        sha512_reference(a, 1000000, ALGO_SHA512, digest);
+        failed += !fuzz_kat("SHA-512 one million 'a'", digest, 64,
+                            "e718483d0ce769644e2e42c7bc15b4638e1f98b13b2044285632a803afa973eb"
+                            "de0ff244877ea60a4cb0432ce577c31beb009c5c2c49aa2e4eadb217ad8cc09b");
+        free(a);
+    }
+
+    // RFC 4231 HMAC-SHA256 test 2, then truncated tags: down to HMAC_SHA256_MINTAG
+    // bytes they verify, below it they don't, singly or in a batch.
+    static const char hmsg[] = "what do ya want for nothing?";
+    HMAC_SHA256_KEY key;
+    HMAC_SHA256_VERIFYJOB job;
+    hmac_sha256_key(&key, (const uint8_t *) "Jefe", 4);
+    hmac_sha256(&key, (const uint8_t *) hmsg, strlen(hmsg), digest);
+    failed += !fuzz_kat("RFC 4231 HMAC-SHA256 test 2", digest, 32,
+                        "5bdcc146bf60754e6a042426089575c75a003f089d2739839dec58b964ec3843");
+    int ok = 1;
+    for (size_t taglen = 0; taglen <= 32; taglen++) {
+        int want = taglen >= HMAC_SHA256_MINTAG;
+        job.key = &key;
+        job.msg = (const uint8_t *) hmsg;
+        job.len = strlen(hmsg);
+        job.tag = digest;
+        job.taglen = taglen;
+        hmac_sha256_verify_batch(&job, 1);
+        ok &= hmac_sha256_verify(&key, job.msg, job.len, digest, taglen) == want && job.ok == want;
+    }
+    printf("%-40s %s\n", "HMAC-SHA256 tags shorter than 16 refused", ok ? "ok" : "FAILED");
+    failed += !ok;
+    return failed;
+}
+
+// --fuzz: known answers, then the differential run on nthreads threads (0 for all CPUs).
+int sha_fuzz(uint64_t maxbytes, uint64_t nrandom, int nthreads) {
+    JOBMGR mgr;
+    int failed = sha_fuzz_kat();
+    if (!afalg_available("sha256"))
+        printf("AF_ALG sha256 unavailable, --engine afalg reads instead\n");
+    if (!jobmgr_init(&mgr, &SHA256_JOBMGR, 0)) {
+        printf("Error: could not start the job manager.\n");
+        return 0;
+    }
+    int64_t mismatches = fuzz_run("sha", sha_fuzz_check, &mgr, maxbytes, nrandom, nthreads);
+    jobmgr_destroy(&mgr);
+    return failed == 0 && mismatches == 0;
+}
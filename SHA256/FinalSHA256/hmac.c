@@ -0,0 +1,126 @@
+// https://tools.ietf.org/html/rfc2104
+// HMAC-SHA256.
+// The key only ever affects the first block of the inner and outer hashes,
+// (K ^ ipad) and (K ^ opad), so both are compressed once per key and kept as
+// midstates. Each message then costs its own blocks plus one outer block.
+
+#include "../../Common/consttime.c"
+
+#define HMAC_IPAD 0x36
+#define HMAC_OPAD 0x5c
+// The shortest truncated tag accepted: RFC 2104 section 5 keeps at least half the
+// output and no fewer than 80 bits, or a forger could simply guess.
+#define HMAC_SHA256_MINTAG 16
+
+// A key prepared for HMAC: the midstates after (K ^ ipad) and (K ^ opad).
+typedef struct {
+    SHA256_MIDSTATE inner;
+    SHA256_MIDSTATE outer;
+} HMAC_SHA256_KEY;
+
+// One (key, message, tag) tuple for batch verification; ok is set to 1 when
+// taglen is at least HMAC_SHA256_MINTAG and the first taglen bytes of the HMAC
+// match tag.
+typedef struct {
+    const HMAC_SHA256_KEY *key;
+    const uint8_t *msg;
+    size_t len;
+    const uint8_t *tag;
+    size_t taglen;
+    int ok;
+} HMAC_SHA256_VERIFYJOB;
+
+// Prepare a key. Keys longer than a block are hashed first (RFC 2104 section 2).
+void hmac_sha256_key(HMAC_SHA256_KEY *k, const uint8_t *key, size_t keylen) {
+    uint8_t K0[64], pad[64];
+    WORD H[8];
+    SHA256_CTX ctx;
+
+    memset(K0, 0, sizeof(K0));
+    if (keylen > 64) {
+        sha256_init(&ctx);
+        sha256_update(&ctx, key, keylen);
+        sha256_final(&ctx, H);
+        sha256_digest_bytes(H, K0);
+    } else {
+        memcpy(K0, key, keylen);
+    }
+
+    for (int i = 0; i < 64; i++)
+        pad[i] = K0[i] ^ HMAC_IPAD;
+    sha256_midstate(pad, 64, &k->inner);
+    for (int i = 0; i < 64; i++)
+        pad[i] = K0[i] ^ HMAC_OPAD;
+    sha256_midstate(pad, 64, &k->outer);
+}
+
+// Finish an HMAC from the hash value of the inner hash, (K ^ ipad) || message.
+void hmac_sha256_outer(const HMAC_SHA256_KEY *k, const WORD *innerH, uint8_t *tag) {
+    SHA256_CTX ctx;
+    WORD H[8];
+    uint8_t inner[32];
+
+    sha256_digest_bytes(innerH, inner);
+    sha256_init_midstate(&ctx, &k->outer);
+    sha256_update(&ctx, inner, sizeof(inner));
+    sha256_final(&ctx, H);
+    sha256_digest_bytes(H, tag);
+}
+
+void hmac_sha256(const HMAC_SHA256_KEY *k, const uint8_t *msg, size_t len, uint8_t *tag) {
+    SHA256_CTX ctx;
+    WORD H[8];
+
+    sha256_init_midstate(&ctx, &k->inner);
+    sha256_update(&ctx, msg, len);
+    sha256_final(&ctx, H);
+    hmac_sha256_outer(k, H, tag);
+}
+
+// Check a (possibly truncated) tag in constant time. Tags shorter than
+// HMAC_SHA256_MINTAG bytes fail.
+int hmac_sha256_verify(const HMAC_SHA256_KEY *k, const uint8_t *msg, size_t len,
+                       const uint8_t *tag, size_t taglen) {
+    uint8_t expected[32];
+    if (taglen < HMAC_SHA256_MINTAG || taglen > sizeof(expected))
+        return 0;
+    hmac_sha256(k, msg, len, expected);
+    return consttime_equal(expected, tag, taglen);
+}
+
+// Verify many tuples at once. The inner hashes of a group go through the
+// multi-buffer lanes together, then the outer hashes do the same.
+#define HMAC_BATCH 64
+
+void hmac_sha256_verify_batch(HMAC_SHA256_VERIFYJOB *jobs, size_t n) {
+    SHA256_MBJOB mb[HMAC_BATCH];
+    uint8_t inner[HMAC_BATCH][32];
+    uint8_t expected[32];
+
+    for (size_t base = 0; base < n; base += HMAC_BATCH) {
+        size_t count = n - base < HMAC_BATCH ? n - base : HMAC_BATCH;
+        size_t i;
+
+        for (i = 0; i < count; i++) {
+            mb[i].from = &jobs[base + i].key->inner;
+            mb[i].data = jobs[base + i].msg;
+            mb[i].len = jobs[base + i].len;
+        }
+        sha256_mb_hash(mb, count);
+
+        for (i = 0; i < count; i++) {
+            sha256_digest_bytes(mb[i].H, inner[i]);
+            mb[i].from = &jobs[base + i].key->outer;
+            mb[i].data = inner[i];
+            mb[i].len = 32;
+        }
+        sha256_mb_hash(mb, count);
+
+        for (i = 0; i < count; i++) {
+            HMAC_SHA256_VERIFYJOB *job = &jobs[base + i];
+            sha256_digest_bytes(mb[i].H, expected);
+            job->ok = job->taglen >= HMAC_SHA256_MINTAG && job->taglen <= sizeof(expected)
+                      && consttime_equal(expected, job->tag, job->taglen);
+        }
+    }
+}
@@ -2,86 +2,331 @@
 // The Secure Hash Algorithm 256-bit version.
 
 #include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
 #include <inttypes.h>
 
-// Section 2.1
-#define WORD uint32_t
-
-// Section 4.2.2
-// Constants (Cubed root of the first 64 primes, first 32 bits after the decimal point to integer then hex)
-const WORD K[] = {
-        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
-        0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
-        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
-        0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
-        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
-        0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
-        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
-        0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
-        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
-        0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
-        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
-        0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
-        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
-        0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
-        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
-        0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
-};
-
-// Section 4.1.2
-// Choose
-#define Ch(x, y, z) ((x & y) ^ (~x & z))
-// Majority
-#define Maj(x, y, z) ((x & y) ^ (x & z) ^ (y & z))
-// Shift Right
-#define SHR(x, n) (x >> n)
-// Rotate Right
-#define ROTR(x, n) ((x >> n) | (x << (32 - n)))
-// Big Sigma Zero
-#define Sig0(x) (ROTR(x,  2) ^ ROTR(x, 13) ^ ROTR(x, 22))
-// Big Sigma One
-#define Sig1(x) (ROTR(x,  6) ^ ROTR(x, 11) ^ ROTR(x, 25))
-// Small Sigma Zero
-#define sig0(x) (ROTR(x,  7) ^ ROTR(x, 18) ^ SHR(x, 3))
-// Small Sigma One
-#define sig1(x) (ROTR(x, 17) ^ ROTR(x, 19) ^ SHR(x, 10))
-
-// A sixty-four byte block of memory, accessed with different types.
-// Represents the current block which has been read from the padded message
-// The Union will consume 64 bytes of memory
-// Can be read as an array of 64, 32 or 8 bit integers
-typedef union {
-    uint64_t sixfour[8];
-    uint32_t threetwo[16];
-    uint8_t eight[64];
-} BLOCK;
-
-// Flags represent the four different states that nextblock may encounter:
-// READ   - Still reading file
-// PAD0   - Started padding zero's to end of message
-// PAD0   - (Not enough space to complete the padding in the current block but the 1 bit has been appended already)
-// FINISH - Padding is complete.
-typedef enum {READ, PAD0, FINISH} PADFLAG;
-
-// Custom endian swap
-uint64_t  swap_endian(uint64_t x){
-
-    uint64_t mask[8];
-    mask[0] = 0xff;
-    for (int i = 1; i < 8; i++) {
-        mask[i] = mask[0] << (8 * i);
-    }
-    uint64_t y =    (x >> 56) & mask[0]
-                 ^ ((x >> 40) & mask[1])
-                 ^ ((x >> 24) & mask[2])
-                 ^ ((x >>  8) & mask[3])
-                 ^ ((x <<  8) & mask[4])
-                 ^ ((x << 24) & mask[5])
-                 ^ ((x << 40) & mask[6])
-                 ^ ((x << 56) & mask[7]);
-
-    return y;
+#include "../../Common/digestcache.c"
+#include "../../Common/readall.c"
+#include "../../Common/input.c"
+#include "../../Common/tee.c"
+#include "../../Common/copyverify.c"
+#include "../../Common/tar.c"
+#include "../../Common/afalg.c"
+#include "../../Common/records.c"
+#include "../../Common/jobmgr.c"
+#include "../../Common/daemon.c"
+#include "../../Common/shmring.c"
+
+#include "sha256.c"
+#include "multibuffer.c"
+#include "hmac.c"
+#include "pbkdf2.c"
+#include "fixed.c"
+#include "sha512.c"
+#include "multibuffer512.c"
+#include "benchmark.c"
+#include "fuzz.c"
+
+// SHA-256 of a buffer as digest bytes, for tuning against the kernel's.
+static void sha256_buffer(const uint8_t *data, size_t n, uint8_t *digest) {
+    SHA256_CTX ctx;
+    WORD H[8];
+    sha256_init(&ctx);
+    sha256_update(&ctx, data, n);
+    sha256_final(&ctx, H);
+    sha256_digest_bytes(H, digest);
 }
+
+// Should the kernel hash the file (Common/afalg.c)? afalg always tries it; auto
+// asks the tuner, once.
+static int sha_kernel_wins(INPUT_ENGINE engine) {
+    static int tuned = -1;
+    if (engine == ENGINE_AFALG)
+        return 1;
+    if (engine != ENGINE_AUTO)
+        return 0;
+    if (tuned < 0)
+        tuned = afalg_tune("sha256", sha256_buffer, 32);
+    return tuned;
+}
+
+// Hash a file by path. engine chooses how it is read (Common/input.c); stdio
+// goes through nextblock as it always has, afalg and auto may hand it to the
+// kernel. With a digest cache, an unchanged file is answered from the cache
+// without being opened, and a freshly computed digest is recorded.
+// A midstate makes the file the tail of a longer message, which the cache does
+// not describe, so the cache is bypassed.
+int sha256_file(const char *path, DIGESTCACHE *cache, const SHA256_MIDSTATE *ms, INPUT_ENGINE engine, WORD *H) {
+
+    uint8_t digest[32];
+    DIGESTKEY before, after;
+    int cacheable = cache && !ms && digestcache_key(path, &before);
+
+    // stdio reads every zero page of a sparse file, and can't drop what a scan has
+    // read; the read engine can do both.
+    if (engine == ENGINE_STDIO && (stream_scan || input_sparse(path)))
+        engine = ENGINE_READ;
+
+    if (cacheable && digestcache_lookup(cache, &before, ALGO_SHA256, digest, 32)) {
+        for (int i = 0; i < 8; i++)
+            H[i] = ((WORD) digest[4*i] << 24) | ((WORD) digest[4*i+1] << 16)
+                 | ((WORD) digest[4*i+2] << 8) | (WORD) digest[4*i+3];
+        return 1;
+    }
+
+    // The kernel only hashes whole messages; a midstate is continued here.
+    int kernel = !ms && sha_kernel_wins(engine) ? afalg_path("sha256", path, digest, 32) : 0;
+    if (kernel < 0) {
+        printf("Error: couldn't read file %s.\n", path);
+        return 0;
+    }
+    if (kernel > 0) {
+        for (int i = 0; i < 8; i++)
+            H[i] = ((WORD) digest[4*i] << 24) | ((WORD) digest[4*i+1] << 16)
+                 | ((WORD) digest[4*i+2] << 8) | (WORD) digest[4*i+3];
+    } else if (engine == ENGINE_STDIO) {
+        FILE *infile = input_fopen(path);
+        if (!infile) {
+            printf("Error: couldn't open file %s.\n", path);
+            return 0;
+        }
+        sha256_stream(infile, ms, H);
+        input_fclose(infile);
+    } else {
+        INPUT in;
+        SHA256_CTX ctx;
+        const uint8_t *data;
+        long n;
+        if (!input_open(&in, path, engine)) {
+            printf("Error: couldn't open file %s.\n", path);
+            input_close(&in);
+            return 0;
+        }
+        if (ms)
+            sha256_init_midstate(&ctx, ms);
+        else
+            sha256_init(&ctx);
+        uint64_t total = 0;
+        STATS_TIMER(t);
+        while ((n = input_next(&in, &data)) > 0) {
+            STATS_READ(t, (uint64_t) n);
+            sha256_update(&ctx, data, (size_t) n);
+            STATS_HASH(t, 0);
+            total += (uint64_t) n;
+        }
+        STATS_READ(t, 0);
+        input_close(&in);
+        if (n < 0) {
+            printf("Error: couldn't read file %s.\n", path);
+            return 0;
+        }
+        sha256_final(&ctx, H);
+        STATS_HASH(t, STATS_PADBLOCKS(total + (ms ? ms->numbits / 8 : 0), 64, 8) - (ms ? ms->numbits / 512 : 0));
+        (void) total;
+    }
+
+    // Only record the digest if the file did not change underneath us.
+    if (cacheable && digestcache_key(path, &after) && memcmp(&before, &after, sizeof(before)) == 0) {
+        sha256_digest_bytes(H, digest);
+        digestcache_insert(cache, &after, ALGO_SHA256, digest, 32);
+    }
+    return 1;
+}
+
+// SHA-512 family digest of a file by path, cached like sha256_file.
+int sha512_file(const char *path, DIGESTCACHE *cache, DIGESTALGO algo, INPUT_ENGINE engine, uint8_t *digest) {
+
+    size_t len = sha512_digest_len(algo);
+    DIGESTKEY before, after;
+    int cacheable = cache && digestcache_key(path, &before);
+
+    if (cacheable && digestcache_lookup(cache, &before, algo, digest, len))
+        return 1;
+    if (engine == ENGINE_STDIO && (stream_scan || input_sparse(path)))
+        engine = ENGINE_READ;
+
+    if (engine == ENGINE_STDIO) {
+        FILE *infile = input_fopen(path);
+        if (!infile) {
+            printf("Error: couldn't open file %s.\n", path);
+            return 0;
+        }
+        WORD64 H[8];
+        sha512_stream(infile, algo, H);
+        input_fclose(infile);
+        sha512_digest_bytes(H, algo, digest);
+    } else {
+        INPUT in;
+        SHA512_CTX ctx;
+        const uint8_t *data;
+        long n;
+        if (!input_open(&in, path, engine)) {
+            printf("Error: couldn't open file %s.\n", path);
+            input_close(&in);
+            return 0;
+        }
+        sha512_init(&ctx, algo);
+        uint64_t total = 0;
+        STATS_TIMER(t);
+        while ((n = input_next(&in, &data)) > 0) {
+            STATS_READ(t, (uint64_t) n);
+            sha512_update(&ctx, data, (size_t) n);
+            STATS_HASH(t, 0);
+            total += (uint64_t) n;
+        }
+        STATS_READ(t, 0);
+        input_close(&in);
+        if (n < 0) {
+            printf("Error: couldn't read file %s.\n", path);
+            return 0;
+        }
+        sha512_final(&ctx, digest);
+        STATS_HASH(t, STATS_PADBLOCKS(total, 128, 16));
+        (void) total;
+    }
+
+    if (cacheable && digestcache_key(path, &after) && memcmp(&before, &after, sizeof(before)) == 0)
+        digestcache_insert(cache, &after, algo, digest, len);
+    return 1;
+}
+
+// Several files at once: those up to SHA512_FILES_SMALL bytes are read whole and
+// hashed through the lanes together, at most SHA512_FILES_BATCH bytes of them at a
+// time; larger ones stream through sha512_file. Memory stays bounded whatever the
+// sizes, and both honour --engine, --cache and --scan.
+#define SHA512_FILES_SMALL  (1 << 20)
+#define SHA512_FILES_BATCH  (32 << 20)
+#define SHA512_FILES_JOBS   256
+
+typedef struct {
+    SHA512_MBJOB jobs[SHA512_FILES_JOBS];
+    int index[SHA512_FILES_JOBS];           // into the paths
+    DIGESTKEY key[SHA512_FILES_JOBS];       // as it was before the read
+    int cacheable[SHA512_FILES_JOBS];
+    int n;
+    size_t bytes;
+} SHA512_FILES_BATCHED;
+
+// Read a small file whole through an engine. Returns NULL if it can't be read.
+static uint8_t *sha512_read_whole(const char *path, INPUT_ENGINE engine, uint64_t size, size_t *len) {
+    INPUT in;
+    const uint8_t *data;
+    long n;
+    uint8_t *buf = malloc(size ? (size_t) size : 1);
+
+    *len = 0;
+    if (!buf || !input_open(&in, path, engine)) {
+        if (buf)
+            input_close(&in);
+        free(buf);
+        return NULL;
+    }
+    while ((n = input_next(&in, &data)) > 0) {
+        // A file that grew since it was looked at is read again as a large one.
+        if (*len + (size_t) n > size) {
+            n = -1;
+            break;
+        }
+        memcpy(buf + *len, data, (size_t) n);
+        *len += (size_t) n;
+    }
+    input_close(&in);
+    if (n < 0) {
+        free(buf);
+        return NULL;
+    }
+    return buf;
+}
+
+// Hash the batch through the lanes and file the digests.
+static void sha512_files_flush(SHA512_FILES_BATCHED *b, DIGESTCACHE *cache, DIGESTALGO algo,
+                               char **paths, uint8_t (*digests)[64]) {
+    size_t len = sha512_digest_len(algo);
+    uint64_t blocks = 0;
+    STATS_TIMER(t);
+
+    for (int i = 0; i < b->n; i++)
+        blocks += STATS_PADBLOCKS(b->jobs[i].len, 128, 16);
+    sha512_mb_hash(b->jobs, (size_t) b->n);
+    STATS_HASH(t, blocks);
+    (void) blocks;
+    for (int i = 0; i < b->n; i++) {
+        DIGESTKEY after;
+        memcpy(digests[b->index[i]], b->jobs[i].digest, len);
+        if (b->cacheable[i] && digestcache_key(paths[b->index[i]], &after)
+            && memcmp(&b->key[i], &after, sizeof(after)) == 0)
+            digestcache_insert(cache, &after, algo, b->jobs[i].digest, len);
+        free((void *) b->jobs[i].data);
+    }
+    b->n = 0;
+    b->bytes = 0;
+}
+
+// SHA-512 family digests of several files. Prints "digest  path" per file, in
+// order, like sha512sum.
+int sha512_files(char **paths, int n, DIGESTCACHE *cache, DIGESTALGO algo, INPUT_ENGINE engine) {
+
+    size_t len = sha512_digest_len(algo);
+    SHA512_FILES_BATCHED *b = calloc(1, sizeof(*b));
+    uint8_t (*digests)[64] = calloc((size_t) n, 64);
+    int *done = calloc((size_t) n, sizeof(int));
+    int ok = 1;
+
+    if (!b || !digests || !done) {
+        free(b); free(digests); free(done);
+        printf("Error: out of memory.\n");
+        return 0;
+    }
+    // Small files are copied out of the chunks anyway, so stdio would only add a copy.
+    INPUT_ENGINE small = engine == ENGINE_STDIO ? ENGINE_READ : engine;
+    for (int i = 0; i < n; i++) {
+        DIGESTKEY key;
+        size_t got;
+        uint8_t *data = NULL;
+
+        if (digestcache_key(paths[i], &key) && key.size <= SHA512_FILES_SMALL) {
+            if (cache && digestcache_lookup(cache, &key, algo, digests[i], len)) {
+                done[i] = 1;
+                continue;
+            }
+            STATS_TIMER(t);
+            data = sha512_read_whole(paths[i], small, key.size, &got);
+            STATS_READ(t, data ? (uint64_t) got : 0);
+        }
+        if (!data) {
+            // Large, not a regular file, or changed under us: stream it.
+            done[i] = sha512_file(paths[i], cache, algo, engine, digests[i]);
+            ok &= done[i];
+            continue;
+        }
+        if (b->n == SHA512_FILES_JOBS || b->bytes + got > SHA512_FILES_BATCH)
+            sha512_files_flush(b, cache, algo, paths, digests);
+        b->jobs[b->n].algo = algo;
+        b->jobs[b->n].data = data;
+        b->jobs[b->n].len = got;
+        b->index[b->n] = i;
+        b->key[b->n] = key;
+        b->cacheable[b->n] = cache != NULL;
+        b->n++;
+        b->bytes += got;
+        done[i] = 1;
+    }
+    sha512_files_flush(b, cache, algo, paths, digests);
+
+    for (int i = 0; i < n; i++) {
+        if (!done[i])
+            continue;
+        for (size_t j = 0; j < len; j++)
+            printf("%02" PRIx8, digests[i][j]);
+        printf("  %s\n", paths[i]);
+    }
+    free(b);
+    free(digests);
+    free(done);
+    return ok;
+}
+
 // Check endianness of machine
 int is_big_endian(void)
 {
@@ -93,134 +338,535 @@ int is_big_endian(void)
     return e.c[0];
 }
 
-// Section 6.2.2
-// H Initialised in main - values for 'H' used in the algorithm (first 32 bits of the fractional parts of sqRoot of first 8 primes)
-void nexthash(WORD *M, WORD *H) {
+// Read two hex digits per byte; returns the number of bytes, or -1 if malformed.
+int hex_decode(const char *hex, uint8_t *out, size_t outlen) {
+    size_t n = strlen(hex);
+    if (n % 2 != 0 || n / 2 > outlen)
+        return -1;
+    for (size_t i = 0; i < n / 2; i++) {
+        unsigned int byte;
+        if (sscanf(hex + 2 * i, "%2x", &byte) != 1)
+            return -1;
+        out[i] = (uint8_t) byte;
+    }
+    return (int) (n / 2);
+}
 
-    WORD W[64];
-    WORD a, b, c, d, e, f, g, h, T1, T2;
-    int t;
+// Verify every line of a manifest, "key hextag path", as one batch.
+// Returns the number of lines that failed.
+int hmac_verify_manifest(const char *manifest) {
 
-    for (t = 0; t < 16; t++)
-        W[t] = M[t];
+    FILE *mf = fopen(manifest, "r");
+    if (!mf) {
+        printf("Error: couldn't open file %s.\n", manifest);
+        return -1;
+    }
 
-    for (t = 16; t < 64; t++)
-        W[t] = sig1(W[t-2]) + W[t-7] + sig0(W[t-15]) + W[t-16];
+    size_t n = 0, cap = 0;
+    HMAC_SHA256_VERIFYJOB *jobs = NULL;
+    HMAC_SHA256_KEY *keys = NULL;
+    char **paths = NULL;
+    char key[1024], taghex[129], path[4096];
+    int failed = 0;
+
+    while (fscanf(mf, "%1023s %128s %4095s", key, taghex, path) == 3) {
+        if (n == cap) {
+            cap = cap ? 2 * cap : 64;
+            jobs = realloc(jobs, cap * sizeof(*jobs));
+            keys = realloc(keys, cap * sizeof(*keys));
+            paths = realloc(paths, cap * sizeof(*paths));
+        }
+        uint8_t *tag = malloc(64);
+        int taglen = hex_decode(taghex, tag, 32);
+        FILE *infile = fopen(path, "rb");
+
+        hmac_sha256_key(&keys[n], (const uint8_t *) key, strlen(key));
+        jobs[n].tag = tag;
+        jobs[n].taglen = taglen < 0 ? 0 : (size_t) taglen;
+        jobs[n].msg = infile ? read_all(infile, &jobs[n].len) : NULL;
+        if (!jobs[n].msg)
+            jobs[n].len = 0, jobs[n].taglen = 0;
+        if (infile)
+            fclose(infile);
+        paths[n] = strdup(path);
+        n++;
+    }
+    fclose(mf);
 
-    a = H[0]; b = H[1]; c = H[2]; d = H[3];
-    e = H[4]; f = H[5]; g = H[6]; h = H[7];
+    // keys[] may have moved while growing, so point the jobs at them afterwards.
+    for (size_t i = 0; i < n; i++)
+        jobs[i].key = &keys[i];
 
-    for (t = 0; t < 64; t++) {
-        T1 = h + Sig1(e) + Ch(e, f, g) + K[t] + W[t];
-        T2 = Sig0(a) + Maj(a, b, c);
-        h = g; g = f; f = e; e = d + T1;
-        d = c; c = b; b = a; a = T1 + T2;
+    hmac_sha256_verify_batch(jobs, n);
+
+    for (size_t i = 0; i < n; i++) {
+        printf("%s: %s\n", paths[i], jobs[i].ok ? "OK" : "FAILED");
+        failed += !jobs[i].ok;
+        free((void *) jobs[i].msg);
+        free((void *) jobs[i].tag);
+        free(paths[i]);
+    }
+    free(jobs); free(keys); free(paths);
+    return failed;
+}
+
+// PBKDF2-HMAC-SHA256 of every "password salt" line of a file, as one batch.
+// Prints one 32 byte derived key per line, in hex.
+int pbkdf2_accounts(const char *path, uint32_t iterations, int nthreads) {
+
+    FILE *af = fopen(path, "r");
+    if (!af) {
+        printf("Error: couldn't open file %s.\n", path);
+        return 0;
+    }
+
+    size_t n = 0, cap = 0;
+    PBKDF2_JOB *jobs = NULL;
+    char password[1024], salt[1024];
+
+    while (fscanf(af, "%1023s %1023s", password, salt) == 2) {
+        if (n == cap) {
+            cap = cap ? 2 * cap : 64;
+            jobs = realloc(jobs, cap * sizeof(*jobs));
+        }
+        jobs[n].password = (uint8_t *) strdup(password);
+        jobs[n].passlen = strlen(password);
+        jobs[n].salt = (uint8_t *) strdup(salt);
+        jobs[n].saltlen = strlen(salt);
+        jobs[n].iterations = iterations;
+        jobs[n].dklen = 32;
+        jobs[n].dk = malloc(32);
+        n++;
     }
+    fclose(af);
 
-    H[0] += a; H[1] += b ; H[2] += c; H[3] += d;
-    H[4] += e; H[5] += f ; H[6] += g; H[7] += h;
+    pbkdf2_sha256_batch(jobs, n, nthreads);
 
+    for (size_t i = 0; i < n; i++) {
+        for (int j = 0; j < 32; j++)
+            printf("%02" PRIx8, jobs[i].dk[j]);
+        printf("\n");
+        free((void *) jobs[i].password);
+        free((void *) jobs[i].salt);
+        free(jobs[i].dk);
+    }
+    free(jobs);
+    return 1;
 }
 
-// Section 5.1.1 - message input from infile.
-int nextblock(BLOCK *M, FILE *infile, uint64_t *numbits, PADFLAG *status) {
+// Records callback: a batch through the lanes, arg being RECORDS_BATCH jobs.
+static void sha256_records_hash(void *arg, const RECORD *recs, size_t n, uint8_t *digests) {
+    SHA256_MBJOB *jobs = (SHA256_MBJOB *) arg;
+    for (size_t i = 0; i < n; i++) {
+        jobs[i].from = NULL;
+        jobs[i].data = recs[i].data;
+        jobs[i].len = recs[i].len;
+    }
+    sha256_mb_hash(jobs, n);
+    for (size_t i = 0; i < n; i++)
+        sha256_digest_bytes(jobs[i].H, digests + 32 * i);
+}
 
-    int i;
-    size_t numbytesread;
+// SHA-256 of every record of a file, or of stdin for "-", one digest per record
+// on stdout. Errors go to stderr, stdout being the digests.
+int sha256_records(const char *path, RECORDS_FORMAT format, int raw) {
+    FILE *in = input_fopen(path);
+    if (!in) {
+        fprintf(stderr, "Error: couldn't open file %s.\n", path);
+        return 0;
+    }
+    SHA256_MBJOB *jobs = malloc(RECORDS_BATCH * sizeof(SHA256_MBJOB));
+    int64_t n = jobs ? records_run(in, stdout, format, raw, 32, sha256_records_hash, jobs) : -1;
+    input_fclose(in);
+    free(jobs);
+    if (n < 0) {
+        fprintf(stderr, "Error: couldn't read %s, or its last record is cut short.\n", path);
+        return 0;
+    }
+    return 1;
+}
 
-    switch(*status){
-        case FINISH:
-            return 0;
-        case PAD0:
-            // We need an all-padding block without the 1 bit.
-            for (int i = 0; i < 56; i++)
-                M->eight[i] = 0x00;
-            M->sixfour[7] = swap_endian(*numbits);
-            *status = FINISH;
-            break;
-        default:
-            // Try to read 64 bytes from the file.
-            numbytesread = fread(M->eight, 1, 64, infile);
-            *numbits += (8ULL * ((uint64_t) numbytesread));
-//            if (numbytesread == 64) {
-//                for (int i = 0; i < 16; i++) {
-//                    M->threetwo[i] = swap_endian(M->threetwo[i]);
-//                }
-//                return 1;
-//            }
-
-            if (numbytesread < 56) {
-                // We can put all padding in this block.
-                M->eight[numbytesread] = 0x80;
-                for (i = numbytesread + 1; i < 56; i++)
-                    M->eight[i] = 0x00;
-                M->sixfour[7] = swap_endian(*numbits);
-                *status = FINISH;
-            } else if (numbytesread < 64) {
-                // Otherwise we have read between 56 (incl) and 64 (excl) bytes.
-                M->eight[numbytesread] = 0x80;
-                for (int i = numbytesread + 1; i < 64; i++)
-                    M->eight[i] = 0x00;
-                *status = PAD0;
-            }
+// --serve: digest lengths, 0 for an algorithm this tool doesn't have.
+static size_t sha_daemon_dlen(DIGESTALGO algo) {
+    if (algo == ALGO_SHA256)
+        return 32;
+    if (algo == ALGO_SHA512 || algo == ALGO_SHA384 || algo == ALGO_SHA512_256)
+        return sha512_digest_len(algo);
+    return 0;
+}
+
+// --serve: a batch of small requests through the lanes of their algorithm.
+static void sha_daemon_mem(DIGESTALGO algo, const RECORD *recs, size_t n, uint8_t *digests) {
+    if (algo == ALGO_SHA256) {
+        SHA256_MBJOB jobs[DAEMON_BATCH];
+        sha256_records_hash(jobs, recs, n, digests);
+        return;
     }
+    SHA512_MBJOB jobs[DAEMON_BATCH];
+    size_t dlen = sha512_digest_len(algo);
+    for (size_t i = 0; i < n; i++) {
+        jobs[i].algo = algo;
+        jobs[i].data = recs[i].data;
+        jobs[i].len = recs[i].len;
+    }
+    sha512_mb_hash(jobs, n);
+    for (size_t i = 0; i < n; i++)
+        memcpy(digests + dlen * i, jobs[i].digest, dlen);
+}
 
-    // Convert to host endianess, word-size-wise.
-    for (i = 0; i < 16; i++)
-        M->threetwo[i] = swap_endian(M->threetwo[i]);
+// --serve: a file descriptor from its start.
+static int sha_daemon_fd(DIGESTALGO algo, int fd, uint8_t *digest) {
+    uint8_t *buf = malloc(DAEMON_FDCHUNK);
+    uint64_t off = 0;
+    SHA256_CTX ctx;
+    SHA512_CTX ctx512;
+    WORD H[8];
+    long n;
+
+    if (!buf)
+        return 0;
+    if (algo == ALGO_SHA256)
+        sha256_init(&ctx);
+    else
+        sha512_init(&ctx512, algo);
+    while ((n = daemon_fd_next(fd, buf, DAEMON_FDCHUNK, &off)) > 0) {
+        if (algo == ALGO_SHA256)
+            sha256_update(&ctx, buf, (size_t) n);
+        else
+            sha512_update(&ctx512, buf, (size_t) n);
+    }
+    free(buf);
+    if (n < 0)
+        return 0;
+    if (algo == ALGO_SHA256) {
+        sha256_final(&ctx, H);
+        sha256_digest_bytes(H, digest);
+    } else {
+        sha512_final(&ctx512, digest);
+    }
+    return 1;
+}
+
+static const DAEMON_OPS SHA_DAEMON = {"sha256, sha512, sha384, sha512/256",
+                                      sha_daemon_dlen, sha_daemon_mem, sha_daemon_fd};
+
+// Serve the SHA-2 algorithms on a Unix socket until killed (Common/daemon.c).
+int sha_serve(const char *path, int nthreads) {
+    return daemon_serve(path, &SHA_DAEMON, nthreads);
+}
+
+// Hand out shared memory request rings on a Unix socket until killed
+// (Common/shmring.c); poll picks busy-polling workers over futex wakeups.
+int sha_ring(const char *path, int poll) {
+    return shmring_serve(path, &SHA_DAEMON, poll);
+}
 
+static void sha_tee_consume(void *arg, const uint8_t *data, size_t n) {
+    sha256_update((SHA256_CTX *) arg, data, n);
+}
+
+// Copy a file or stdin ("-") to stdout while hashing it (Common/tee.c). stdout
+// is the stream, so the digest (or HMAC tag under hmac) and errors go to stderr.
+int sha_tee(const char *path, const SHA256_MIDSTATE *ms, const HMAC_SHA256_KEY *hmac) {
+    SHA256_CTX ctx;
+    WORD H[8];
+    if (hmac)
+        ms = &hmac->inner;
+    if (ms)
+        sha256_init_midstate(&ctx, ms);
+    else
+        sha256_init(&ctx);
+    if (!tee_stream(path, sha_tee_consume, &ctx)) {
+        fprintf(stderr, "Error: couldn't pass %s through to stdout.\n", path);
+        return 0;
+    }
+    sha256_final(&ctx, H);
+    uint8_t digest[32];
+    if (hmac)
+        hmac_sha256_outer(hmac, H, digest);
+    else
+        sha256_digest_bytes(H, digest);
+    for (int i = 0; i < 32; i++)
+        fprintf(stderr, "%02" PRIx8, digest[i]);
+    fprintf(stderr, "\n");
     return 1;
+}
+
+// The streaming API behind void pointers, for the Common modules.
+static void sha_ctx_init(void *ctx) { sha256_init((SHA256_CTX *) ctx); }
+static void sha_ctx_update(void *ctx, const uint8_t *data, size_t n) { sha256_update((SHA256_CTX *) ctx, data, n); }
+static void sha_ctx_final(void *ctx, uint8_t *digest) {
+    WORD H[8];
+    sha256_final((SHA256_CTX *) ctx, H);
+    sha256_digest_bytes(H, digest);
+}
+
+static const COPYVERIFY_OPS SHA_COPYVERIFY = {32, sha_ctx_init, sha_ctx_update, sha_ctx_final};
+
+// Copy files to a file or directory, hashing each source once on the way, and
+// verify every copy with an O_DIRECT re-read (Common/copyverify.c).
+int sha_copy(char **paths, int n, INPUT_ENGINE engine, int nthreads) {
+    return copyverify_run(paths, n, engine, &SHA_COPYVERIFY, nthreads);
+}
+
+// SHA-256 of every regular file in a tar archive, or of one on stdin for "-",
+// without extracting it (Common/tar.c).
+int sha_tar(const char *path) {
+    FILE *in = input_fopen(path);
+    if (!in) {
+        fprintf(stderr, "Error: couldn't open %s.\n", path);
+        return 0;
+    }
+    SHA256_MBJOB *jobs = malloc(RECORDS_BATCH * sizeof(SHA256_MBJOB));
+    TAR_OPS ops = {32, sha256_records_hash, jobs, sha_ctx_init, sha_ctx_update, sha_ctx_final};
+    int64_t n = jobs ? tar_run(in, &ops) : -1;
+    input_fclose(in);
+    free(jobs);
+    return n >= 0;
+}
+
+// SHA256d of a file, or the Merkle root of a file of 32 byte leaves.
+int fixed_file(const char *path, int merkle) {
+
+    FILE *infile = input_fopen(path);
+    if (!infile) {
+        printf("Error: couldn't open file %s.\n", path);
+        return 0;
+    }
+    size_t len;
+    uint8_t *data = read_all(infile, &len);
+    input_fclose(infile);
+    if (!data)
+        return 0;
+
+    uint8_t out[32];
+    if (merkle) {
+        if (len % 32 != 0) {
+            printf("Error: %s is not a whole number of 32 byte leaves.\n", path);
+            free(data);
+            return 0;
+        }
+        merkle_root((uint8_t (*)[32]) data, len / 32, out);
+    } else {
+        sha256d(data, len, out);
+    }
+    free(data);
 
+    for (int i = 0; i < 32; i++)
+        printf("%02" PRIx8, out[i]);
+    printf("\n");
+    return 1;
 }
 
 int main(int argc, char *argv[]) {
 
+    // --bench [max size] prints a JSON report of cycles/byte per kernel, and nothing else.
+    if ((argc == 2 || argc == 3) && strcmp(argv[1], "--bench") == 0)
+        return sha256_bench(argc == 3 ? bench_parse_size(argv[2]) : (16ULL << 20)) ? 0 : 1;
+
+    // Options, given before the filename:
+    // --cache <file>          reuse digests of unchanged files
+    // --from-midstate <state> hash the file as the rest of a --midstate prefix
+    // --hmac <key>            print HMAC-SHA256 of the file under key
+    // --threads <n>           worker threads for --pbkdf2, --fuzz, --serve and --copy
+    // --engine <name>         stdio, read, mmap, direct, uring, afalg or auto: how files are read
+    // --stats                 report where the time went on stderr when done
+    // --perf                  as --stats, with hardware counters per stage
+    // --raw                   --records writes raw digest bytes instead of hex lines
+    // --scan                  stream without polluting the CPU and page caches (Common/stream.c)
+    DIGESTCACHE cache;
+    DIGESTCACHE *pcache = NULL;
+    SHA256_MIDSTATE midstate;
+    SHA256_MIDSTATE *from = NULL;
+    HMAC_SHA256_KEY hmackey;
+    int usehmac = 0;
+    int nthreads = 0;   // 0: one for --pbkdf2, every CPU for --fuzz and --serve
+    INPUT_ENGINE engine = ENGINE_STDIO;
+    int raw = 0;
+    while (argc >= 3) {
+        // The options without a value.
+        if (strcmp(argv[1], "--scan") == 0) {
+            stream_scan = 1;
+            argv[1] = argv[0]; argv++; argc--;
+            continue;
+        }
+        if (strcmp(argv[1], "--stats") == 0 || strcmp(argv[1], "--perf") == 0) {
+            stats_start(strcmp(argv[1], "--perf") == 0);
+            argv[1] = argv[0]; argv++; argc--;
+            continue;
+        }
+        if (strcmp(argv[1], "--raw") == 0) {
+            raw = 1;
+            argv[1] = argv[0]; argv++; argc--;
+            continue;
+        }
+        if (argc < 4)
+            break;
+        if (strcmp(argv[1], "--cache") == 0) {
+            if (pcache)
+                digestcache_close(pcache);
+            pcache = digestcache_open(&cache, argv[2]) ? &cache : NULL;
+            if (!pcache)
+                printf("Warning: digest cache %s unavailable, hashing without it.\n", argv[2]);
+        } else if (strcmp(argv[1], "--from-midstate") == 0) {
+            if (!sha256_midstate_parse(argv[2], &midstate)) {
+                printf("Error: malformed midstate %s.\n", argv[2]);
+                return 1;
+            }
+            from = &midstate;
+        } else if (strcmp(argv[1], "--hmac") == 0) {
+            hmac_sha256_key(&hmackey, (const uint8_t *) argv[2], strlen(argv[2]));
+            usehmac = 1;
+        } else if (strcmp(argv[1], "--threads") == 0) {
+            nthreads = atoi(argv[2]) > 0 ? atoi(argv[2]) : 1;
+        } else if (strcmp(argv[1], "--engine") == 0) {
+            if (!input_engine_parse(argv[2], &engine)) {
+                printf("Error: unknown input engine %s.\n", argv[2]);
+                return 1;
+            }
+        } else {
+            break;
+        }
+        argv[2] = argv[0]; argv += 2; argc -= 2;
+    }
+
+    // A digest per record of a file or stdin, and nothing else on stdout.
+    if (argc == 4 && strcmp(argv[1], "--records") == 0) {
+        RECORDS_FORMAT format;
+        if (!records_format_parse(argv[2], &format)) {
+            fprintf(stderr, "Error: unknown record format %s.\n", argv[2]);
+            return 1;
+        }
+        return sha256_records(argv[3], format, raw) ? 0 : 1;
+    }
+
+    // Copy and verify, a digest line per copy and nothing else on stdout.
+    if (argc >= 4 && strcmp(argv[1], "--copy") == 0)
+        return sha_copy(argv + 2, argc - 2, engine, nthreads) ? 0 : 1;
+
+    // A digest line per tar member and nothing else on stdout.
+    if (argc == 3 && strcmp(argv[1], "--tar") == 0)
+        return sha_tar(argv[2]) ? 0 : 1;
+
+    // The input through to stdout and the digest on stderr, so nothing else on stdout.
+    if (argc == 3 && strcmp(argv[1], "--tee") == 0)
+        return sha_tee(argv[2], from, usehmac ? &hmackey : NULL) ? 0 : 1;
+
     printf("System is %s-endian.\n",
            is_big_endian() ? "big" : "little");
 
-//    uint64_t asd = 0xaa0f5f0c7e810180;
-//    printf("%016" PRIx64 " \n", asd);
-//    printf("%016" PRIx64 " \n",swap_endian(asd));
-//    printf("%016" PRIx64 " \n", swap_endian(swap_endian(asd)) );
-
+    // Compact a digest cache and exit.
+    if (argc == 3 && strcmp(argv[1], "--cache-compact") == 0)
+        return digestcache_compact(argv[2]) ? 0 : 1;
+
+    // Print the midstate of a block-aligned prefix file and exit.
+    if (argc == 3 && strcmp(argv[1], "--midstate") == 0) {
+        SHA256_MIDSTATE ms;
+        char out[96];
+        FILE *infile = input_fopen(argv[2]);
+        if (!infile) {
+            printf("Error: couldn't open file %s.\n", argv[2]);
+            return 1;
+        }
+        int ok = sha256_midstate_file(infile, &ms);
+        input_fclose(infile);
+        if (!ok) {
+            printf("Error: prefix length must be a multiple of 64 bytes.\n");
+            return 1;
+        }
+        sha256_midstate_format(&ms, out, sizeof(out));
+        printf("%s\n", out);
+        return 0;
+    }
 
-    // Expect and open a single filename.
-    if (argc != 2) {
-        printf("Error: expected single filename as argument.\n");
-        return 1;
+    // Verify a manifest of HMAC tags and exit.
+    if (argc == 3 && strcmp(argv[1], "--hmac-verify") == 0)
+        return hmac_verify_manifest(argv[2]) == 0 ? 0 : 1;
+
+    // Double SHA-256 / Merkle root of a file and exit.
+    if (argc == 3 && strcmp(argv[1], "--sha256d") == 0)
+        return fixed_file(argv[2], 0) ? 0 : 1;
+    if (argc == 3 && strcmp(argv[1], "--merkle") == 0)
+        return fixed_file(argv[2], 1) ? 0 : 1;
+
+    // SHA-512, SHA-384 or SHA-512/256 of one or more files and exit.
+    if (argc >= 3 && (strcmp(argv[1], "--sha512") == 0 || strcmp(argv[1], "--sha384") == 0
+                      || strcmp(argv[1], "--sha512-256") == 0)) {
+        DIGESTALGO algo = strcmp(argv[1], "--sha384") == 0 ? ALGO_SHA384
+                        : strcmp(argv[1], "--sha512-256") == 0 ? ALGO_SHA512_256 : ALGO_SHA512;
+        int ok;
+        if (argc == 3) {
+            uint8_t digest[64];
+            ok = sha512_file(argv[2], pcache, algo, engine, digest);
+            if (ok) {
+                for (size_t i = 0; i < sha512_digest_len(algo); i++)
+                    printf("%02" PRIx8, digest[i]);
+                printf("\n");
+            }
+        } else {
+            ok = sha512_files(argv + 2, argc - 2, pcache, algo, engine);
+        }
+        if (pcache)
+            digestcache_close(pcache);
+        return ok ? 0 : 1;
     }
 
-    FILE *infile = fopen(argv[1], "rb");
-    if (!infile) {
-        printf("Error: couldn't open file %s.\n", argv[1]);
-        return 1;
+    // Check every kernel and engine against the reference nexthash and exit.
+    if (argc >= 2 && argc <= 4 && strcmp(argv[1], "--fuzz") == 0) {
+        int ok = sha_fuzz(argc >= 3 ? bench_parse_size(argv[2]) : (16ULL << 20),
+                          argc == 4 ? strtoull(argv[3], NULL, 10) : 1000, nthreads);
+        ok &= shmring_check(&SHA_DAEMON, ALGO_SHA256);
+        return ok ? 0 : 1;
     }
 
-    // Section 5.3.3
-    WORD H[] = {
-            0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
-            0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
-    };
+    // Serve hash requests on a Unix socket; --threads sets the workers.
+    if (argc == 3 && strcmp(argv[1], "--serve") == 0)
+        return sha_serve(argv[2], nthreads) ? 0 : 1;
+
+    // Shared memory rings for local clients, handed out on a Unix socket.
+    if ((argc == 3 || argc == 4) && strcmp(argv[1], "--ring") == 0) {
+        if (argc == 4 && strcmp(argv[3], "poll") != 0 && strcmp(argv[3], "futex") != 0) {
+            printf("Error: --ring waits by poll or futex, not %s\n", argv[3]);
+            return 1;
+        }
+        return sha_ring(argv[2], argc == 4 && strcmp(argv[3], "poll") == 0) ? 0 : 1;
+    }
 
-    // The current padded message block.
-    BLOCK M;
-    uint64_t numbits = 0;
-    PADFLAG status = READ;
+    // Derive keys for a file of "password salt" lines and exit.
+    if (argc == 4 && strcmp(argv[1], "--pbkdf2") == 0)
+        return pbkdf2_accounts(argv[3], (uint32_t) strtoul(argv[2], NULL, 10), nthreads) ? 0 : 1;
 
-    // Read through all of the padded message blocks.
-    while (nextblock(&M, infile, &numbits, &status)) {
-        // Calculate the next hash value.
-        nexthash(M.threetwo, H);
+    // Expect and open a single filename, "-" for stdin.
+    if (argc != 2) {
+        printf("Error: expected single filename as argument.\n");
+        return 1;
     }
 
-    // Print the hash.
-    for (int i = 0; i < 8; i++)
-        printf("%08" PRIx32 "", H[i]);
-    printf("\n");
+    WORD H[8];
+
+    // The inner hash of an HMAC is the file continued from the ipad midstate.
+    if (usehmac) {
+        uint8_t tag[32];
+        if (!sha256_file(argv[1], NULL, &hmackey.inner, engine, H))
+            return 1;
+        hmac_sha256_outer(&hmackey, H, tag);
+        for (int i = 0; i < 32; i++)
+            printf("%02" PRIx8, tag[i]);
+        printf("\n");
+        return 0;
+    }
 
-    fclose(infile);
+    int ok = sha256_file(argv[1], pcache, from, engine, H);
 
+    // Print the hash.
+    if (ok) {
+        for (int i = 0; i < 8; i++)
+            printf("%08" PRIx32 "", H[i]);
+        printf("\n");
+    }
 
+    if (pcache)
+        digestcache_close(pcache);
 
-    return 0;
-}
\ No newline at end of file
+    return ok ? 0 : 1;
+}
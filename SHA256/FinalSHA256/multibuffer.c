@@ -0,0 +1,143 @@
+// Multi-buffer SHA-256.
+// Independent messages are hashed side by side, one message per lane of a
+// SIMD vector, so one pass of the round loop compresses SHA256_LANES blocks.
+// Written with GCC/Clang vector extensions, which lower to SSE/AVX/NEON as the
+// target allows; the Ch/Maj/Sig macros from sha256.c work on whole vectors.
+
+#define SHA256_LANES 8
+
+typedef WORD LANEWORD __attribute__ ((vector_size (4 * SHA256_LANES)));
+
+// Eight 32 bit lanes fill an AVX2 register. As in multibuffer512.c the kernel is
+// also built for the baseline target, and the loader picks one.
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(_WIN32) && !defined(__APPLE__)
+#define SHA256_LANES_TARGETS __attribute__ ((target_clones ("avx2", "default")))
+#else
+#define SHA256_LANES_TARGETS
+#endif
+
+// A message for the lanes. It continues from the midstate 'from' (or H0 when
+// NULL) and its final hash value is left in H.
+typedef struct {
+    const SHA256_MIDSTATE *from;
+    const uint8_t *data;
+    size_t len;
+    WORD H[8];
+} SHA256_MBJOB;
+
+// Compress one block in each lane. M[t][l] is word t of lane l's block in host
+// order and H[l] is lane l's hash value; only lanes whose bit is set in mask
+// are written back.
+SHA256_LANES_TARGETS
+void nexthash_lanes(WORD M[16][SHA256_LANES], WORD H[SHA256_LANES][8], unsigned mask) {
+
+    LANEWORD W[64];
+    LANEWORD a, b, c, d, e, f, g, h, T1, T2;
+    LANEWORD V[8];
+    int t, l, i;
+
+    for (t = 0; t < 16; t++)
+        memcpy(&W[t], M[t], sizeof(LANEWORD));
+
+    for (t = 16; t < 64; t++)
+        W[t] = sig1(W[t-2]) + W[t-7] + sig0(W[t-15]) + W[t-16];
+
+    for (i = 0; i < 8; i++)
+        for (l = 0; l < SHA256_LANES; l++)
+            V[i][l] = H[l][i];
+
+    a = V[0]; b = V[1]; c = V[2]; d = V[3];
+    e = V[4]; f = V[5]; g = V[6]; h = V[7];
+
+    for (t = 0; t < 64; t++) {
+        T1 = h + Sig1(e) + Ch(e, f, g) + K256[t] + W[t];
+        T2 = Sig0(a) + Maj(a, b, c);
+        h = g; g = f; f = e; e = d + T1;
+        d = c; c = b; b = a; a = T1 + T2;
+    }
+
+    V[0] += a; V[1] += b; V[2] += c; V[3] += d;
+    V[4] += e; V[5] += f; V[6] += g; V[7] += h;
+
+    for (l = 0; l < SHA256_LANES; l++)
+        if (mask & (1u << l))
+            for (i = 0; i < 8; i++)
+                H[l][i] = V[i][l];
+}
+
+// Per-lane progress through a job: its whole blocks are read in place from the
+// job's data, the padded tail (one or two blocks) is built once in 'tail'.
+typedef struct {
+    SHA256_MBJOB *job;
+    size_t whole;
+    size_t next;
+    size_t nblocks;
+    uint8_t tail[128];
+} SHA256_LANE;
+
+static void sha256_lane_start(SHA256_LANE *lane, SHA256_MBJOB *job, WORD *H) {
+    size_t rem = job->len % 64;
+    uint64_t numbits = (job->from ? job->from->numbits : 0) + 8ULL * job->len;
+
+    lane->job = job;
+    lane->whole = job->len / 64;
+    lane->next = 0;
+
+    memcpy(lane->tail, job->data + 64 * lane->whole, rem);
+    lane->nblocks = lane->whole + padtail(lane->tail, rem, 64, 0, numbits);
+
+    for (int i = 0; i < 8; i++)
+        H[i] = job->from ? job->from->H[i] : H0[i];
+}
+
+// Hash n jobs through the lanes. A lane whose job finishes is refilled with the
+// next job straight away, so short and long messages can be mixed freely.
+void sha256_mb_hash(SHA256_MBJOB *jobs, size_t n) {
+
+    SHA256_LANE lanes[SHA256_LANES];
+    WORD M[16][SHA256_LANES];
+    WORD H[SHA256_LANES][8];
+    unsigned mask = 0;
+    size_t nextjob = 0;
+    int l, t;
+
+    memset(M, 0, sizeof(M));
+    for (l = 0; l < SHA256_LANES && nextjob < n; l++, nextjob++) {
+        sha256_lane_start(&lanes[l], &jobs[nextjob], H[l]);
+        mask |= 1u << l;
+    }
+
+    while (mask) {
+        // Gather the next block of every busy lane, converting to host order.
+        for (l = 0; l < SHA256_LANES; l++) {
+            if (!(mask & (1u << l)))
+                continue;
+            SHA256_LANE *lane = &lanes[l];
+            const uint8_t *p = lane->next < lane->whole
+                               ? lane->job->data + 64 * lane->next
+                               : lane->tail + 64 * (lane->next - lane->whole);
+            for (t = 0; t < 16; t++)
+                M[t][l] = ((WORD) p[4*t] << 24) | ((WORD) p[4*t+1] << 16)
+                        | ((WORD) p[4*t+2] << 8) | (WORD) p[4*t+3];
+        }
+
+        nexthash_lanes(M, H, mask);
+
+        for (l = 0; l < SHA256_LANES; l++) {
+            if (!(mask & (1u << l)) || ++lanes[l].next < lanes[l].nblocks)
+                continue;
+            memcpy(lanes[l].job->H, H[l], sizeof(H[l]));
+            if (nextjob < n)
+                sha256_lane_start(&lanes[l], &jobs[nextjob++], H[l]);
+            else
+                mask &= ~(1u << l);
+        }
+    }
+}
+
+// The job manager's view of SHA-256 (Common/jobmgr.c).
+static void sha256_jobmgr_compress(uint32_t *M, uint32_t *H, unsigned mask) {
+    nexthash_lanes((WORD (*)[SHA256_LANES]) M, (WORD (*)[8]) H, mask);
+}
+
+const JOBMGR_OPS SHA256_JOBMGR = { "sha256", SHA256_LANES, 8, 1, H0, sha256_jobmgr_compress };
@@ -0,0 +1,130 @@
+// Multi-buffer SHA-512 family.
+// As multibuffer.c, one message per lane, but with 64 bit words: four lanes
+// fill a 256 bit AVX2 register. The kernel is built twice, for AVX2 and for
+// the baseline target, and the loader picks the AVX2 one on CPUs that have it.
+// Elsewhere the vector extensions fall back to SSE2 pairs or plain scalar code.
+
+#define SHA512_LANES 4
+
+typedef WORD64 LANEWORD64 __attribute__ ((vector_size (8 * SHA512_LANES)));
+
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(_WIN32) && !defined(__APPLE__)
+#define SHA512_LANES_TARGETS __attribute__ ((target_clones ("avx2", "default")))
+#else
+#define SHA512_LANES_TARGETS
+#endif
+
+// A message for the lanes; its digest, sha512_digest_len(algo) bytes, is left in digest.
+typedef struct {
+    DIGESTALGO algo;
+    const uint8_t *data;
+    size_t len;
+    uint8_t digest[64];
+} SHA512_MBJOB;
+
+// Compress one block in each lane. M[t][l] is word t of lane l's block in host
+// order and H[l] is lane l's hash value; only lanes set in mask are written back.
+SHA512_LANES_TARGETS
+void nexthash512_lanes(WORD64 M[16][SHA512_LANES], WORD64 H[SHA512_LANES][8], unsigned mask) {
+
+    LANEWORD64 W[80];
+    LANEWORD64 a, b, c, d, e, f, g, h, T1, T2;
+    LANEWORD64 V[8];
+    int t, l, i;
+
+    for (t = 0; t < 16; t++)
+        memcpy(&W[t], M[t], sizeof(LANEWORD64));
+
+    for (t = 16; t < 80; t++)
+        W[t] = sig1_512(W[t-2]) + W[t-7] + sig0_512(W[t-15]) + W[t-16];
+
+    for (i = 0; i < 8; i++)
+        for (l = 0; l < SHA512_LANES; l++)
+            V[i][l] = H[l][i];
+
+    a = V[0]; b = V[1]; c = V[2]; d = V[3];
+    e = V[4]; f = V[5]; g = V[6]; h = V[7];
+
+    for (t = 0; t < 80; t++) {
+        T1 = h + Sig1_512(e) + Ch(e, f, g) + K512[t] + W[t];
+        T2 = Sig0_512(a) + Maj(a, b, c);
+        h = g; g = f; f = e; e = d + T1;
+        d = c; c = b; b = a; a = T1 + T2;
+    }
+
+    V[0] += a; V[1] += b; V[2] += c; V[3] += d;
+    V[4] += e; V[5] += f; V[6] += g; V[7] += h;
+
+    for (l = 0; l < SHA512_LANES; l++)
+        if (mask & (1u << l))
+            for (i = 0; i < 8; i++)
+                H[l][i] = V[i][l];
+}
+
+// Per-lane progress through a job, as SHA256_LANE with 128 byte blocks.
+typedef struct {
+    SHA512_MBJOB *job;
+    size_t whole;
+    size_t next;
+    size_t nblocks;
+    uint8_t tail[256];
+} SHA512_LANE;
+
+static void sha512_lane_start(SHA512_LANE *lane, SHA512_MBJOB *job, WORD64 *H) {
+    size_t rem = job->len % 128;
+
+    lane->job = job;
+    lane->whole = job->len / 128;
+    lane->next = 0;
+
+    memcpy(lane->tail, job->data + 128 * lane->whole, rem);
+    lane->nblocks = lane->whole + padtail(lane->tail, rem, 128, (uint64_t) job->len >> 61, 8ULL * job->len);
+
+    memcpy(H, sha512_iv(job->algo), 8 * sizeof(WORD64));
+}
+
+// Hash n jobs through the lanes, refilling a lane as soon as its job is done.
+void sha512_mb_hash(SHA512_MBJOB *jobs, size_t n) {
+
+    SHA512_LANE lanes[SHA512_LANES];
+    WORD64 M[16][SHA512_LANES];
+    WORD64 H[SHA512_LANES][8];
+    unsigned mask = 0;
+    size_t nextjob = 0;
+    int l, t, i;
+
+    memset(M, 0, sizeof(M));
+    for (l = 0; l < SHA512_LANES && nextjob < n; l++, nextjob++) {
+        sha512_lane_start(&lanes[l], &jobs[nextjob], H[l]);
+        mask |= 1u << l;
+    }
+
+    while (mask) {
+        for (l = 0; l < SHA512_LANES; l++) {
+            if (!(mask & (1u << l)))
+                continue;
+            SHA512_LANE *lane = &lanes[l];
+            const uint8_t *p = lane->next < lane->whole
+                               ? lane->job->data + 128 * lane->next
+                               : lane->tail + 128 * (lane->next - lane->whole);
+            for (t = 0; t < 16; t++) {
+                WORD64 w = 0;
+                for (i = 0; i < 8; i++)
+                    w = (w << 8) | p[8*t + i];
+                M[t][l] = w;
+            }
+        }
+
+        nexthash512_lanes(M, H, mask);
+
+        for (l = 0; l < SHA512_LANES; l++) {
+            if (!(mask & (1u << l)) || ++lanes[l].next < lanes[l].nblocks)
+                continue;
+            sha512_digest_bytes(H[l], lanes[l].job->algo, lanes[l].job->digest);
+            if (nextjob < n)
+                sha512_lane_start(&lanes[l], &jobs[nextjob++], H[l]);
+            else
+                mask &= ~(1u << l);
+        }
+    }
+}
@@ -0,0 +1,291 @@
+// https://tools.ietf.org/html/rfc8018#section-5.2
+// PBKDF2-HMAC-SHA256.
+// After the first one, every iteration is U = HMAC(P, U): an inner and an outer
+// compression of a single block holding a 32 byte value. Words 8 to 15 of that
+// block are always the same padding (0x80, zeros, and the 768 bit length of
+// 64 + 32 bytes), so their part of the message schedule and of K[t] + W[t] is
+// worked out once. Independent (password, block) pairs run in the SIMD lanes
+// of multibuffer.c and big batches are spread over threads.
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+// One derivation. dk receives dklen bytes.
+typedef struct {
+    const uint8_t *password;
+    size_t passlen;
+    const uint8_t *salt;
+    size_t saltlen;
+    uint32_t iterations;
+    uint8_t *dk;
+    size_t dklen;
+} PBKDF2_JOB;
+
+// The constant half of an iteration block, prepared once per batch.
+// SCHED[t] is the sum of the terms of W[t] that only involve words 8..15
+// (t = 16..31), KW[t] is K[t] + W[t] for the constant words t = 8..15.
+typedef struct {
+    WORD SCHED[32];
+    WORD KW[16];
+} PBKDF2_TABLES;
+
+// Words 8..15 of every iteration block.
+static const WORD PBKDF2_PAD[8] = { 0x80000000, 0, 0, 0, 0, 0, 0, (64 + 32) * 8 };
+
+static int pbkdf2_is_const(int t) {
+    return t >= 8 && t < 16;
+}
+
+void pbkdf2_tables(PBKDF2_TABLES *tab) {
+    WORD W[16];
+    for (int t = 8; t < 16; t++) {
+        W[t] = PBKDF2_PAD[t - 8];
+        tab->KW[t] = K256[t] + W[t];
+    }
+    for (int t = 16; t < 32; t++) {
+        WORD s = 0;
+        if (pbkdf2_is_const(t - 2))  s += sig1(W[t - 2]);
+        if (pbkdf2_is_const(t - 7))  s += W[t - 7];
+        if (pbkdf2_is_const(t - 15)) s += sig0(W[t - 15]);
+        if (pbkdf2_is_const(t - 16)) s += W[t - 16];
+        tab->SCHED[t] = s;
+    }
+}
+
+// Compress the block (X[0..7], padding) into state S in every lane.
+static void pbkdf2_compress(const PBKDF2_TABLES *tab, const LANEWORD *S, const LANEWORD *X, LANEWORD *out) {
+
+    LANEWORD W[64];
+    LANEWORD a, b, c, d, e, f, g, h, T1, T2;
+    const LANEWORD zero = {0};
+    int t;
+
+    for (t = 0; t < 8; t++)
+        W[t] = X[t];
+
+    // W[16..31] still draw on the padding words; only the terms from words
+    // 0..7 and from W[16..] are computed, the rest is in SCHED.
+    for (t = 16; t < 32; t++) {
+        LANEWORD w = zero + tab->SCHED[t];
+        if (!pbkdf2_is_const(t - 2))  w += sig1(W[t - 2]);
+        if (!pbkdf2_is_const(t - 7))  w += W[t - 7];
+        if (!pbkdf2_is_const(t - 15)) w += sig0(W[t - 15]);
+        if (!pbkdf2_is_const(t - 16)) w += W[t - 16];
+        W[t] = w;
+    }
+    for (t = 32; t < 64; t++)
+        W[t] = sig1(W[t-2]) + W[t-7] + sig0(W[t-15]) + W[t-16];
+
+    a = S[0]; b = S[1]; c = S[2]; d = S[3];
+    e = S[4]; f = S[5]; g = S[6]; h = S[7];
+
+    for (t = 0; t < 64; t++) {
+        if (pbkdf2_is_const(t))
+            T1 = h + Sig1(e) + Ch(e, f, g) + tab->KW[t];
+        else
+            T1 = h + Sig1(e) + Ch(e, f, g) + K256[t] + W[t];
+        T2 = Sig0(a) + Maj(a, b, c);
+        h = g; g = f; f = e; e = d + T1;
+        d = c; c = b; b = a; a = T1 + T2;
+    }
+
+    out[0] = S[0] + a; out[1] = S[1] + b; out[2] = S[2] + c; out[3] = S[3] + d;
+    out[4] = S[4] + e; out[5] = S[5] + f; out[6] = S[6] + g; out[7] = S[7] + h;
+}
+
+// Shared by the worker threads: the jobs and the next (job, block) to hand out.
+typedef struct {
+    PBKDF2_JOB *jobs;
+    size_t njobs;
+    size_t nitems;
+    size_t *firstitem;   // firstitem[j] is the number of blocks in jobs before j
+    size_t nextitem;
+    PBKDF2_TABLES tab;
+} PBKDF2_BATCH;
+
+// What a lane is working on: block 'block' (1-based) of job 'job'.
+typedef struct {
+    PBKDF2_JOB *job;
+    uint32_t block;
+    uint32_t remaining;
+} PBKDF2_LANE;
+
+// Claim the next work item; returns 0 when the batch is exhausted.
+static int pbkdf2_claim(PBKDF2_BATCH *batch, PBKDF2_JOB **job, uint32_t *block) {
+    size_t item = __atomic_fetch_add(&batch->nextitem, 1, __ATOMIC_RELAXED);
+    if (item >= batch->nitems)
+        return 0;
+    // What was left in the queue when this item was taken.
+    STATS_ITEM(batch->nitems - item);
+    // Binary search for the job owning this item.
+    size_t lo = 0, hi = batch->njobs - 1;
+    while (lo < hi) {
+        size_t mid = (lo + hi + 1) / 2;
+        if (batch->firstitem[mid] <= item)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    *job = &batch->jobs[lo];
+    *block = (uint32_t) (item - batch->firstitem[lo]) + 1;
+    return 1;
+}
+
+static void pbkdf2_lane_put(LANEWORD *v, int l, const WORD *w) {
+    for (int i = 0; i < 8; i++)
+        v[i][l] = w[i];
+}
+
+// Start a lane on (job, block): prepare the key midstates and compute
+// U1 = HMAC(P, S || INT(block)), which has a variable length message.
+static void pbkdf2_lane_start(PBKDF2_LANE *lane, int l, PBKDF2_JOB *job, uint32_t block,
+                              LANEWORD *IS, LANEWORD *OS, LANEWORD *U, LANEWORD *T) {
+    HMAC_SHA256_KEY key;
+    SHA256_CTX ctx;
+    WORD H[8];
+    uint8_t be[4] = { (uint8_t) (block >> 24), (uint8_t) (block >> 16), (uint8_t) (block >> 8), (uint8_t) block };
+
+    hmac_sha256_key(&key, job->password, job->passlen);
+    sha256_init_midstate(&ctx, &key.inner);
+    sha256_update(&ctx, job->salt, job->saltlen);
+    sha256_update(&ctx, be, 4);
+    sha256_final(&ctx, H);
+    {
+        uint8_t tag[32];
+        hmac_sha256_outer(&key, H, tag);
+        for (int i = 0; i < 8; i++)
+            H[i] = ((WORD) tag[4*i] << 24) | ((WORD) tag[4*i+1] << 16) | ((WORD) tag[4*i+2] << 8) | tag[4*i+3];
+    }
+
+    pbkdf2_lane_put(IS, l, key.inner.H);
+    pbkdf2_lane_put(OS, l, key.outer.H);
+    pbkdf2_lane_put(U, l, H);
+    pbkdf2_lane_put(T, l, H);
+    lane->job = job;
+    lane->block = block;
+    lane->remaining = job->iterations - 1;
+}
+
+// Write lane l's T out as block 'block' of the derived key.
+static void pbkdf2_lane_finish(PBKDF2_LANE *lane, int l, const LANEWORD *T) {
+    uint8_t out[32];
+    WORD w[8];
+    for (int i = 0; i < 8; i++)
+        w[i] = T[i][l];
+    sha256_digest_bytes(w, out);
+
+    size_t off = 32 * (size_t) (lane->block - 1);
+    size_t n = lane->job->dklen - off < 32 ? lane->job->dklen - off : 32;
+    memcpy(lane->job->dk + off, out, n);
+}
+
+// Keep every lane busy until there is no more work.
+static void *pbkdf2_worker(void *arg) {
+
+    PBKDF2_BATCH *batch = (PBKDF2_BATCH *) arg;
+    PBKDF2_LANE lanes[SHA256_LANES];
+    LANEWORD IS[8], OS[8], U[8], T[8], inner[8];
+    unsigned mask = 0;
+    int l, i;
+    // Each iteration compresses two blocks per busy lane; charged once at the end.
+    uint64_t blocks = 0;
+    STATS_TIMER(t);
+
+    memset(IS, 0, sizeof(IS)); memset(OS, 0, sizeof(OS));
+    memset(U, 0, sizeof(U)); memset(T, 0, sizeof(T));
+
+    for (;;) {
+        // Fill idle lanes. A one-iteration job is already done after U1.
+        for (l = 0; l < SHA256_LANES; l++) {
+            while (!(mask & (1u << l))) {
+                PBKDF2_JOB *job;
+                uint32_t block;
+                if (!pbkdf2_claim(batch, &job, &block))
+                    break;
+                pbkdf2_lane_start(&lanes[l], l, job, block, IS, OS, U, T);
+                if (lanes[l].remaining == 0)
+                    pbkdf2_lane_finish(&lanes[l], l, T);
+                else
+                    mask |= 1u << l;
+            }
+        }
+        if (!mask)
+            break;
+
+        // Run until some lane finishes, then go back and refill it.
+        for (;;) {
+            pbkdf2_compress(&batch->tab, IS, U, inner);
+            pbkdf2_compress(&batch->tab, OS, inner, U);
+            for (i = 0; i < 8; i++)
+                T[i] ^= U[i];
+            blocks += 2 * (uint64_t) __builtin_popcount(mask);
+
+            unsigned done = 0;
+            for (l = 0; l < SHA256_LANES; l++)
+                if ((mask & (1u << l)) && --lanes[l].remaining == 0)
+                    done |= 1u << l;
+            if (done) {
+                for (l = 0; l < SHA256_LANES; l++)
+                    if (done & (1u << l))
+                        pbkdf2_lane_finish(&lanes[l], l, T);
+                mask &= ~done;
+                break;
+            }
+        }
+    }
+    // All of it was hashing. There is no input to read, so the blocks compressed
+    // are counted as the bytes, with no time charged to reading them.
+    STATS_HASH(t, blocks);
+    STATS_READ(t, 64 * blocks);
+    (void) blocks;
+    return NULL;
+}
+
+// Derive keys for every job, on nthreads threads (1 = the calling thread only).
+void pbkdf2_sha256_batch(PBKDF2_JOB *jobs, size_t n, int nthreads) {
+
+    if (n == 0)
+        return;
+
+    PBKDF2_BATCH batch;
+    batch.jobs = jobs;
+    batch.njobs = n;
+    batch.nextitem = 0;
+    batch.firstitem = malloc(n * sizeof(size_t));
+    batch.nitems = 0;
+    for (size_t j = 0; j < n; j++) {
+        batch.firstitem[j] = batch.nitems;
+        if (jobs[j].iterations == 0)
+            jobs[j].iterations = 1;
+        batch.nitems += (jobs[j].dklen + 31) / 32;
+    }
+    pbkdf2_tables(&batch.tab);
+
+#ifndef _WIN32
+    if (nthreads > 1) {
+        pthread_t *threads = malloc(nthreads * sizeof(pthread_t));
+        int started = 0;
+        for (int i = 1; i < nthreads; i++)
+            if (pthread_create(&threads[started], NULL, pbkdf2_worker, &batch) == 0)
+                started++;
+        // The calling thread is the last worker.
+        pbkdf2_worker(&batch);
+        for (int i = 0; i < started; i++)
+            pthread_join(threads[i], NULL);
+        free(threads);
+    } else
+#endif
+    {
+        (void) nthreads;
+        pbkdf2_worker(&batch);
+    }
+
+    free(batch.firstitem);
+}
+
+void pbkdf2_sha256(const uint8_t *password, size_t passlen, const uint8_t *salt, size_t saltlen,
+                   uint32_t iterations, uint8_t *dk, size_t dklen) {
+    PBKDF2_JOB job = { password, passlen, salt, saltlen, iterations, dk, dklen };
+    pbkdf2_sha256_batch(&job, 1, 1);
+}
@@ -0,0 +1,411 @@
+// https://nvlpubs.nist.gov/nistpubs/FIPS/NIST.FIPS.180-4.pdf
+// SHA-256 core: constants, compression, padding and the streaming/midstate API.
+
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+// Section 2.1
+#define WORD uint32_t
+
+// Section 4.2.2
+// Constants (Cubed root of the first 64 primes, first 32 bits after the decimal point to integer then hex)
+// Named K256 so the SHA-256 core can be built alongside MD5's K.
+const WORD K256[] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+        0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+        0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+        0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+        0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+        0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+        0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+        0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+        0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+// Section 4.1.2
+// Choose
+#define Ch(x, y, z) ((x & y) ^ (~x & z))
+// Majority
+#define Maj(x, y, z) ((x & y) ^ (x & z) ^ (y & z))
+// Shift Right
+#define SHR(x, n) (x >> n)
+// Rotate Right
+#define ROTR(x, n) ((x >> n) | (x << (32 - n)))
+// Big Sigma Zero
+#define Sig0(x) (ROTR(x,  2) ^ ROTR(x, 13) ^ ROTR(x, 22))
+// Big Sigma One
+#define Sig1(x) (ROTR(x,  6) ^ ROTR(x, 11) ^ ROTR(x, 25))
+// Small Sigma Zero
+#define sig0(x) (ROTR(x,  7) ^ ROTR(x, 18) ^ SHR(x, 3))
+// Small Sigma One
+#define sig1(x) (ROTR(x, 17) ^ ROTR(x, 19) ^ SHR(x, 10))
+
+// A block of memory, accessed with different types.
+// Represents the current block which has been read from the padded message
+// Can be read as an array of 64, 32 or 8 bit integers
+// BLOCK is the sixty-four byte SHA-256 block, BLOCK512 the one hundred and
+// twenty-eight byte block of the SHA-512 family.
+#define BLOCK_OF(bytes) union { \
+    uint64_t sixfour[(bytes) / 8]; \
+    uint32_t threetwo[(bytes) / 4]; \
+    uint8_t eight[bytes]; \
+}
+typedef BLOCK_OF(64) BLOCK;
+typedef BLOCK_OF(128) BLOCK512;
+
+// Flags represent the four different states that nextblock may encounter
+// (READ, PAD0, FINISH), shared with the MD5 padding.
+#include "../../Common/padflag.c"
+#include "../../Common/stats.c"
+#include "../../Common/iovec.c"
+#include "../../Common/stream.c"
+
+// Section 5.3.3 - initial hash value.
+const WORD H0[] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+// Streaming state for messages held in memory.
+// numbits counts every bit absorbed, including a midstate prefix, and buf holds
+// the bytes of a block that is not yet full.
+typedef struct {
+    WORD H[8];
+    uint64_t numbits;
+    BLOCK buf;
+    uint32_t buflen;
+} SHA256_CTX;
+
+// The hash value after a block-aligned prefix. Messages sharing that prefix
+// start from here instead of H0, so the prefix is only compressed once.
+typedef struct {
+    WORD H[8];
+    uint64_t numbits;
+} SHA256_MIDSTATE;
+
+// Custom endian swap
+uint64_t  swap_endian(uint64_t x){
+
+    uint64_t mask[8];
+    mask[0] = 0xff;
+    for (int i = 1; i < 8; i++) {
+        mask[i] = mask[0] << (8 * i);
+    }
+    uint64_t y =   ((x >> 56) & mask[0])
+                 ^ ((x >> 40) & mask[1])
+                 ^ ((x >> 24) & mask[2])
+                 ^ ((x >>  8) & mask[3])
+                 ^ ((x <<  8) & mask[4])
+                 ^ ((x << 24) & mask[5])
+                 ^ ((x << 40) & mask[6])
+                 ^ ((x << 56) & mask[7]);
+
+    return y;
+}
+
+// Custom endian swap of a single 32 bit word.
+uint32_t swap_endian32(uint32_t x){
+    return (x >> 24) | ((x >> 8) & 0x0000ff00) | ((x << 8) & 0x00ff0000) | (x << 24);
+}
+
+// Section 6.2.2
+// H Initialised in main - values for 'H' used in the algorithm (first 32 bits of the fractional parts of sqRoot of first 8 primes)
+void nexthash256(WORD *M, WORD *H) {
+
+    WORD W[64];
+    WORD a, b, c, d, e, f, g, h, T1, T2;
+    int t;
+
+    for (t = 0; t < 16; t++)
+        W[t] = M[t];
+
+    for (t = 16; t < 64; t++)
+        W[t] = sig1(W[t-2]) + W[t-7] + sig0(W[t-15]) + W[t-16];
+
+    a = H[0]; b = H[1]; c = H[2]; d = H[3];
+    e = H[4]; f = H[5]; g = H[6]; h = H[7];
+
+    for (t = 0; t < 64; t++) {
+        T1 = h + Sig1(e) + Ch(e, f, g) + K256[t] + W[t];
+        T2 = Sig0(a) + Maj(a, b, c);
+        h = g; g = f; f = e; e = d + T1;
+        d = c; c = b; b = a; a = T1 + T2;
+    }
+
+    H[0] += a; H[1] += b ; H[2] += c; H[3] += d;
+    H[4] += e; H[5] += f ; H[6] += g; H[7] += h;
+
+}
+
+// Add len bytes to a 128 bit bit count. SHA-256 keeps only the low half.
+void numbits_add(uint64_t *numbits, uint64_t *numbits_hi, uint64_t len) {
+    uint64_t add = len << 3;
+    *numbits_hi += len >> 61;
+    *numbits += add;
+    if (*numbits < add)
+        (*numbits_hi)++;
+}
+
+// Write the message length in bits, big endian, into the lenbytes (8 or 16)
+// that end at end.
+static void padlength(uint8_t *end, size_t lenbytes, uint64_t numbits_hi, uint64_t numbits) {
+    for (int i = 0; i < 8; i++) {
+        end[-1 - i] = (uint8_t) (numbits >> (8 * i));
+        if (lenbytes == 16)
+            end[-9 - i] = (uint8_t) (numbits_hi >> (8 * i));
+    }
+}
+
+// Section 5.1 - message input from infile, for either block size: blocks of
+// blocksize bytes (64, or 128 for the SHA-512 family) whose padding ends in a
+// length of lenbytes (8 or 16). M is left in message byte order.
+int nextblock_sized(uint8_t *M, size_t blocksize, size_t lenbytes, FILE *infile,
+                    uint64_t *numbits, uint64_t *numbits_hi, PADFLAG *status) {
+
+    size_t numbytesread, numzeros;
+
+    switch(*status){
+        case FINISH:
+            return 0;
+        case PAD0:
+            // We need an all-padding block without the 1 bit.
+            memset(M, 0, blocksize - lenbytes);
+            padlength(M + blocksize, lenbytes, *numbits_hi, *numbits);
+            *status = FINISH;
+            break;
+        default:
+            // Try to read a whole block from the file.
+            numbytesread = fread(M, 1, blocksize, infile);
+            numbits_add(numbits, numbits_hi, numbytesread);
+            if (numbytesread == blocksize)
+                break;
+
+            M[numbytesread] = 0x80;
+            numzeros = numzerobytes_block(8ULL * numbytesread, 8ULL * blocksize, 8ULL * lenbytes);
+            if (numbytesread + 1 + numzeros + lenbytes == blocksize) {
+                // We can put all padding in this block.
+                memset(M + numbytesread + 1, 0, numzeros);
+                padlength(M + blocksize, lenbytes, *numbits_hi, *numbits);
+                *status = FINISH;
+            } else {
+                // Otherwise the length goes in an extra block.
+                memset(M + numbytesread + 1, 0, blocksize - numbytesread - 1);
+                *status = PAD0;
+            }
+    }
+
+    return 1;
+
+}
+
+// Section 5.1.1 - message input from infile, converted to host endianess.
+int nextblock(BLOCK *M, FILE *infile, uint64_t *numbits, PADFLAG *status) {
+
+    uint64_t numbits_hi = 0;
+
+    if (!nextblock_sized(M->eight, 64, 8, infile, numbits, &numbits_hi, status))
+        return 0;
+
+    // Convert to host endianess, word-size-wise.
+    for (int i = 0; i < 16; i++)
+        M->threetwo[i] = swap_endian32(M->threetwo[i]);
+
+    return 1;
+
+}
+
+// Section 5.1 - pad a message tail of rem bytes held at the start of tail.
+// The same rule serves both block sizes: a 64 byte block ends in a 64 bit
+// length, a 128 byte block (the SHA-512 family, section 5.1.2) in a 128 bit
+// length. tail must have room for two blocks. Returns the number of blocks, 1 or 2.
+int padtail(uint8_t *tail, size_t rem, size_t blocksize, uint64_t numbits_hi, uint64_t numbits) {
+    size_t lenbytes = blocksize / 8;
+    size_t numzeros = numzerobytes_block(8ULL * rem, 8ULL * blocksize, 8ULL * lenbytes);
+    size_t end = rem + 1 + numzeros + lenbytes;
+
+    tail[rem] = 0x80;
+    memset(tail + rem + 1, 0, numzeros);
+    padlength(tail + end, lenbytes, numbits_hi, numbits);
+    return (int) (end / blocksize);
+}
+
+// Start a streaming hash from H0.
+void sha256_init(SHA256_CTX *ctx) {
+    for (int i = 0; i < 8; i++)
+        ctx->H[i] = H0[i];
+    ctx->numbits = 0;
+    ctx->buflen = 0;
+}
+
+// Start a streaming hash as if the midstate's prefix had already been absorbed.
+void sha256_init_midstate(SHA256_CTX *ctx, const SHA256_MIDSTATE *ms) {
+    for (int i = 0; i < 8; i++)
+        ctx->H[i] = ms->H[i];
+    ctx->numbits = ms->numbits;
+    ctx->buflen = 0;
+}
+
+// Compress n whole 64 byte blocks given in message (big endian) byte order,
+// straight from data, which needs no particular alignment.
+void sha256_blocks(WORD *H, const uint8_t *data, size_t n) {
+    BLOCK M;
+    int nta = stream_scan;
+    for (; n > 0; n--, data += 64) {
+        // --scan: fetch ahead without leaving the data in the shared cache.
+        if (nta)
+            stream_prefetch(data + STREAM_AHEAD);
+        memcpy(M.eight, data, 64);
+        for (int i = 0; i < 16; i++)
+            M.threetwo[i] = swap_endian32(M.threetwo[i]);
+        nexthash256(M.threetwo, H);
+    }
+}
+
+// Absorb len bytes. Full blocks are compressed straight away, any tail is buffered.
+void sha256_update(SHA256_CTX *ctx, const uint8_t *data, size_t len) {
+    ctx->numbits += 8ULL * (uint64_t) len;
+
+    if (ctx->buflen > 0) {
+        size_t take = 64 - ctx->buflen;
+        if (take > len)
+            take = len;
+        memcpy(ctx->buf.eight + ctx->buflen, data, take);
+        ctx->buflen += take; data += take; len -= take;
+        if (ctx->buflen < 64)
+            return;
+        sha256_blocks(ctx->H, ctx->buf.eight, 1);
+        ctx->buflen = 0;
+    }
+
+    sha256_blocks(ctx->H, data, len / 64);
+    data += len & ~(size_t) 63;
+    len &= 63;
+
+    memcpy(ctx->buf.eight, data, len);
+    ctx->buflen = len;
+}
+
+// Absorb a chain of segments as if they were one message, without gathering them.
+// A block that straddles segments is stitched together in ctx->buf; the whole
+// blocks inside each segment go to sha256_blocks in place.
+void sha256_update_iov(SHA256_CTX *ctx, const struct iovec *iov, size_t n) {
+    for (size_t i = 0; i < n; i++)
+        sha256_update(ctx, (const uint8_t *) iov[i].iov_base, iov[i].iov_len);
+}
+
+// Section 5.1.1 - pad the buffered tail the same way nextblock pads a file.
+void sha256_final(SHA256_CTX *ctx, WORD *H) {
+    uint32_t i, n = ctx->buflen;
+
+    ctx->buf.eight[n++] = 0x80;
+    if (n > 56) {
+        // No room for the length, it goes in an extra all-padding block.
+        for (i = n; i < 64; i++)
+            ctx->buf.eight[i] = 0x00;
+        sha256_blocks(ctx->H, ctx->buf.eight, 1);
+        n = 0;
+    }
+    for (i = n; i < 56; i++)
+        ctx->buf.eight[i] = 0x00;
+    ctx->buf.sixfour[7] = swap_endian(ctx->numbits);
+    sha256_blocks(ctx->H, ctx->buf.eight, 1);
+
+    for (i = 0; i < 8; i++)
+        H[i] = ctx->H[i];
+}
+
+// Export the state of a context that has absorbed a block-aligned prefix.
+// Returns 0 if the context is part way through a block.
+int sha256_export_midstate(const SHA256_CTX *ctx, SHA256_MIDSTATE *ms) {
+    if (ctx->buflen != 0)
+        return 0;
+    for (int i = 0; i < 8; i++)
+        ms->H[i] = ctx->H[i];
+    ms->numbits = ctx->numbits;
+    return 1;
+}
+
+// Midstate of a prefix in memory; len must be a multiple of 64.
+int sha256_midstate(const uint8_t *prefix, size_t len, SHA256_MIDSTATE *ms) {
+    SHA256_CTX ctx;
+    sha256_init(&ctx);
+    sha256_update(&ctx, prefix, len);
+    return sha256_export_midstate(&ctx, ms);
+}
+
+// Midstate of a prefix stored in a file (left open).
+int sha256_midstate_file(FILE *infile, SHA256_MIDSTATE *ms) {
+    SHA256_CTX ctx;
+    uint8_t chunk[4096];
+    size_t n;
+
+    sha256_init(&ctx);
+    while ((n = fread(chunk, 1, sizeof(chunk), infile)) > 0)
+        sha256_update(&ctx, chunk, n);
+    return sha256_export_midstate(&ctx, ms);
+}
+
+// Midstates travel as the eight hash words in hex, a colon, and the prefix length in bytes.
+void sha256_midstate_format(const SHA256_MIDSTATE *ms, char *out, size_t outlen) {
+    size_t n = 0;
+    for (int i = 0; i < 8 && n < outlen; i++)
+        n += snprintf(out + n, outlen - n, "%08" PRIx32, ms->H[i]);
+    if (n < outlen)
+        snprintf(out + n, outlen - n, ":%" PRIu64, ms->numbits / 8);
+}
+
+int sha256_midstate_parse(const char *c, SHA256_MIDSTATE *ms) {
+    uint64_t bytes;
+    if (strlen(c) < 66 || c[64] != ':')
+        return 0;
+    for (int i = 0; i < 8; i++)
+        if (sscanf(c + 8 * i, "%8" SCNx32, &ms->H[i]) != 1)
+            return 0;
+    if (sscanf(c + 65, "%" SCNu64, &bytes) != 1 || bytes % 64 != 0)
+        return 0;
+    ms->numbits = 8 * bytes;
+    return 1;
+}
+
+// Hash every padded block of infile into H (left open), starting from the
+// midstate ms, or from H0 if ms is NULL.
+void sha256_stream(FILE *infile, const SHA256_MIDSTATE *ms, WORD *H) {
+
+    for (int i = 0; i < 8; i++)
+        H[i] = ms ? ms->H[i] : H0[i];
+
+    // The current padded message block.
+    BLOCK M;
+    uint64_t numbits = ms ? ms->numbits : 0;
+    uint64_t numbits0 = numbits;
+    PADFLAG status = READ;
+    STATS_TIMER(t);
+
+    // Read through all of the padded message blocks.
+    while (nextblock(&M, infile, &numbits, &status)) {
+        STATS_READ(t, 0);
+        // Calculate the next hash value.
+        nexthash256(M.threetwo, H);
+        STATS_HASH(t, 1);
+    }
+    STATS_READ(t, (numbits - numbits0) / 8);
+    (void) numbits0;
+}
+
+// Section 6.2.2 step 4 - the digest is the hash words in big endian byte order.
+void sha256_digest_bytes(const WORD *H, uint8_t *out) {
+    for (int i = 0; i < 8; i++) {
+        out[4*i]   = (uint8_t) (H[i] >> 24);
+        out[4*i+1] = (uint8_t) (H[i] >> 16);
+        out[4*i+2] = (uint8_t) (H[i] >> 8);
+        out[4*i+3] = (uint8_t) H[i];
+    }
+}
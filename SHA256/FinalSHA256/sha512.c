@@ -0,0 +1,214 @@
+// https://nvlpubs.nist.gov/nistpubs/FIPS/NIST.FIPS.180-4.pdf
+// SHA-512, SHA-384 and SHA-512/256: the same construction as SHA-256 on
+// 64 bit words and 128 byte blocks, with 80 rounds. On a 64 bit host without
+// SHA instructions this moves twice the data per round, so it is the faster
+// choice of secure digest for bulk data. The three differ only in their
+// initial hash value and in how much of the final hash value is output.
+
+// Section 2.1 - the SHA-512 family works on 64 bit words.
+#define WORD64 uint64_t
+
+// Section 4.2.3
+// Constants (Cubed root of the first 80 primes, first 64 bits after the decimal point)
+const WORD64 K512[80] = {
+        0x428a2f98d728ae22ULL, 0x7137449123ef65cdULL, 0xb5c0fbcfec4d3b2fULL, 0xe9b5dba58189dbbcULL,
+        0x3956c25bf348b538ULL, 0x59f111f1b605d019ULL, 0x923f82a4af194f9bULL, 0xab1c5ed5da6d8118ULL,
+        0xd807aa98a3030242ULL, 0x12835b0145706fbeULL, 0x243185be4ee4b28cULL, 0x550c7dc3d5ffb4e2ULL,
+        0x72be5d74f27b896fULL, 0x80deb1fe3b1696b1ULL, 0x9bdc06a725c71235ULL, 0xc19bf174cf692694ULL,
+        0xe49b69c19ef14ad2ULL, 0xefbe4786384f25e3ULL, 0x0fc19dc68b8cd5b5ULL, 0x240ca1cc77ac9c65ULL,
+        0x2de92c6f592b0275ULL, 0x4a7484aa6ea6e483ULL, 0x5cb0a9dcbd41fbd4ULL, 0x76f988da831153b5ULL,
+        0x983e5152ee66dfabULL, 0xa831c66d2db43210ULL, 0xb00327c898fb213fULL, 0xbf597fc7beef0ee4ULL,
+        0xc6e00bf33da88fc2ULL, 0xd5a79147930aa725ULL, 0x06ca6351e003826fULL, 0x142929670a0e6e70ULL,
+        0x27b70a8546d22ffcULL, 0x2e1b21385c26c926ULL, 0x4d2c6dfc5ac42aedULL, 0x53380d139d95b3dfULL,
+        0x650a73548baf63deULL, 0x766a0abb3c77b2a8ULL, 0x81c2c92e47edaee6ULL, 0x92722c851482353bULL,
+        0xa2bfe8a14cf10364ULL, 0xa81a664bbc423001ULL, 0xc24b8b70d0f89791ULL, 0xc76c51a30654be30ULL,
+        0xd192e819d6ef5218ULL, 0xd69906245565a910ULL, 0xf40e35855771202aULL, 0x106aa07032bbd1b8ULL,
+        0x19a4c116b8d2d0c8ULL, 0x1e376c085141ab53ULL, 0x2748774cdf8eeb99ULL, 0x34b0bcb5e19b48a8ULL,
+        0x391c0cb3c5c95a63ULL, 0x4ed8aa4ae3418acbULL, 0x5b9cca4f7763e373ULL, 0x682e6ff3d6b2b8a3ULL,
+        0x748f82ee5defb2fcULL, 0x78a5636f43172f60ULL, 0x84c87814a1f0ab72ULL, 0x8cc702081a6439ecULL,
+        0x90befffa23631e28ULL, 0xa4506cebde82bde9ULL, 0xbef9a3f7b2c67915ULL, 0xc67178f2e372532bULL,
+        0xca273eceea26619cULL, 0xd186b8c721c0c207ULL, 0xeada7dd6cde0eb1eULL, 0xf57d4f7fee6ed178ULL,
+        0x06f067aa72176fbaULL, 0x0a637dc5a2c898a6ULL, 0x113f9804bef90daeULL, 0x1b710b35131c471bULL,
+        0x28db77f523047d84ULL, 0x32caab7b40c72493ULL, 0x3c9ebe0a15c9bebcULL, 0x431d67c49c100d4cULL,
+        0x4cc5d4becb3e42b6ULL, 0x597f299cfc657e2aULL, 0x5fcb6fab3ad6faecULL, 0x6c44198c4a475817ULL
+};
+
+// Section 4.1.3 - Ch, Maj and SHR from sha256.c work on any word size.
+// Rotate Right
+#define ROTR64(x, n) ((x >> n) | (x << (64 - n)))
+// Big Sigma Zero
+#define Sig0_512(x) (ROTR64(x, 28) ^ ROTR64(x, 34) ^ ROTR64(x, 39))
+// Big Sigma One
+#define Sig1_512(x) (ROTR64(x, 14) ^ ROTR64(x, 18) ^ ROTR64(x, 41))
+// Small Sigma Zero
+#define sig0_512(x) (ROTR64(x,  1) ^ ROTR64(x,  8) ^ SHR(x, 7))
+// Small Sigma One
+#define sig1_512(x) (ROTR64(x, 19) ^ ROTR64(x, 61) ^ SHR(x, 6))
+
+// Section 5.3.5 - SHA-512 initial hash value.
+const WORD64 H0_512[] = {
+        0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL, 0x3c6ef372fe94f82bULL, 0xa54ff53a5f1d36f1ULL,
+        0x510e527fade682d1ULL, 0x9b05688c2b3e6c1fULL, 0x1f83d9abfb41bd6bULL, 0x5be0cd19137e2179ULL
+};
+
+// Section 5.3.4 - SHA-384 initial hash value.
+const WORD64 H0_384[] = {
+        0xcbbb9d5dc1059ed8ULL, 0x629a292a367cd507ULL, 0x9159015a3070dd17ULL, 0x152fecd8f70e5939ULL,
+        0x67332667ffc00b31ULL, 0x8eb44a8768581511ULL, 0xdb0c2e0d64f98fa7ULL, 0x47b5481dbefa4fa4ULL
+};
+
+// Section 5.3.6.2 - SHA-512/256 initial hash value.
+const WORD64 H0_512_256[] = {
+        0x22312194fc2bf72cULL, 0x9f555fa3c84c64c2ULL, 0x2393b86b6f53b151ULL, 0x963877195940eabdULL,
+        0x96283ee2a88effe3ULL, 0xbe5e1e2553863992ULL, 0x2b0199fc2c85b8aaULL, 0x0eb72ddc81c52ca2ULL
+};
+
+// Streaming state. The message length is 128 bits, numbits_hi:numbits.
+typedef struct {
+    WORD64 H[8];
+    uint64_t numbits;
+    uint64_t numbits_hi;
+    BLOCK512 buf;
+    uint32_t buflen;
+    DIGESTALGO algo;
+} SHA512_CTX;
+
+// Initial hash value of one of ALGO_SHA512, ALGO_SHA384 or ALGO_SHA512_256.
+const WORD64 *sha512_iv(DIGESTALGO algo) {
+    if (algo == ALGO_SHA384)
+        return H0_384;
+    if (algo == ALGO_SHA512_256)
+        return H0_512_256;
+    return H0_512;
+}
+
+// Digest length in bytes (section 6.5 and 6.7 truncate the hash value).
+size_t sha512_digest_len(DIGESTALGO algo) {
+    if (algo == ALGO_SHA384)
+        return 48;
+    if (algo == ALGO_SHA512_256)
+        return 32;
+    return 64;
+}
+
+// Section 6.4.2 - the scalar kernel. M is the block in host order.
+void nexthash512(const WORD64 *M, WORD64 *H) {
+
+    WORD64 W[80];
+    WORD64 a, b, c, d, e, f, g, h, T1, T2;
+    int t;
+
+    for (t = 0; t < 16; t++)
+        W[t] = M[t];
+
+    for (t = 16; t < 80; t++)
+        W[t] = sig1_512(W[t-2]) + W[t-7] + sig0_512(W[t-15]) + W[t-16];
+
+    a = H[0]; b = H[1]; c = H[2]; d = H[3];
+    e = H[4]; f = H[5]; g = H[6]; h = H[7];
+
+    for (t = 0; t < 80; t++) {
+        T1 = h + Sig1_512(e) + Ch(e, f, g) + K512[t] + W[t];
+        T2 = Sig0_512(a) + Maj(a, b, c);
+        h = g; g = f; f = e; e = d + T1;
+        d = c; c = b; b = a; a = T1 + T2;
+    }
+
+    H[0] += a; H[1] += b; H[2] += c; H[3] += d;
+    H[4] += e; H[5] += f; H[6] += g; H[7] += h;
+}
+
+// Section 5.1.2 - the nextblock padding engine for 128 byte blocks, converted
+// to host endianess.
+int nextblock512(BLOCK512 *M, FILE *infile, uint64_t *numbits, uint64_t *numbits_hi, PADFLAG *status) {
+
+    if (!nextblock_sized(M->eight, 128, 16, infile, numbits, numbits_hi, status))
+        return 0;
+
+    for (int i = 0; i < 16; i++)
+        M->sixfour[i] = swap_endian(M->sixfour[i]);
+
+    return 1;
+}
+
+void sha512_init(SHA512_CTX *ctx, DIGESTALGO algo) {
+    memcpy(ctx->H, sha512_iv(algo), sizeof(ctx->H));
+    ctx->numbits = 0;
+    ctx->numbits_hi = 0;
+    ctx->buflen = 0;
+    ctx->algo = algo;
+}
+
+// Compress one 128 byte block given in message (big endian) byte order.
+static void sha512_block(WORD64 *H, const uint8_t *data) {
+    BLOCK512 M;
+    memcpy(M.eight, data, 128);
+    for (int i = 0; i < 16; i++)
+        M.sixfour[i] = swap_endian(M.sixfour[i]);
+    nexthash512(M.sixfour, H);
+}
+
+void sha512_update(SHA512_CTX *ctx, const uint8_t *data, size_t len) {
+    numbits_add(&ctx->numbits, &ctx->numbits_hi, len);
+
+    if (ctx->buflen > 0) {
+        size_t take = 128 - ctx->buflen;
+        if (take > len)
+            take = len;
+        memcpy(ctx->buf.eight + ctx->buflen, data, take);
+        ctx->buflen += take; data += take; len -= take;
+        if (ctx->buflen < 128)
+            return;
+        sha512_block(ctx->H, ctx->buf.eight);
+        ctx->buflen = 0;
+    }
+
+    int nta = stream_scan;
+    for (; len >= 128; data += 128, len -= 128) {
+        // --scan: a block is two lines, fetch both ahead.
+        if (nta) {
+            stream_prefetch(data + STREAM_AHEAD);
+            stream_prefetch(data + STREAM_AHEAD + 64);
+        }
+        sha512_block(ctx->H, data);
+    }
+
+    memcpy(ctx->buf.eight, data, len);
+    ctx->buflen = len;
+}
+
+// Section 6.4.2 step 4 - the hash value words in big endian byte order,
+// truncated to the algorithm's digest length.
+void sha512_digest_bytes(const WORD64 *H, DIGESTALGO algo, uint8_t *out) {
+    size_t n = sha512_digest_len(algo);
+    for (size_t i = 0; i < n; i++)
+        out[i] = (uint8_t) (H[i / 8] >> (56 - 8 * (i % 8)));
+}
+
+// Pad the buffered tail and write the digest, sha512_digest_len(ctx->algo) bytes.
+void sha512_final(SHA512_CTX *ctx, uint8_t *out) {
+    uint8_t tail[256];
+    memcpy(tail, ctx->buf.eight, ctx->buflen);
+    int nblocks = padtail(tail, ctx->buflen, 128, ctx->numbits_hi, ctx->numbits);
+    for (int i = 0; i < nblocks; i++)
+        sha512_block(ctx->H, tail + 128 * i);
+    sha512_digest_bytes(ctx->H, ctx->algo, out);
+}
+
+// Hash every padded block of infile (left open) into H.
+void sha512_stream(FILE *infile, DIGESTALGO algo, WORD64 *H) {
+
+    memcpy(H, sha512_iv(algo), 8 * sizeof(WORD64));
+
+    BLOCK512 M;
+    uint64_t numbits = 0, numbits_hi = 0;
+    PADFLAG status = READ;
+    STATS_TIMER(t);
+
+    while (nextblock512(&M, infile, &numbits, &numbits_hi, &status)) {
+        STATS_READ(t, 0);
+        nexthash512(M.sixfour, H);
+        STATS_HASH(t, 1);
+    }
+    STATS_READ(t, numbits / 8);
+}
@@ -4,6 +4,10 @@
 
 #include <stdio.h>
 #include <inttypes.h>
+#include <string.h>
+
+// numzerobytes_block, shared with the FinalSHA256 block reader.
+#include "../../Common/padflag.c"
 
 // Represents the currrent block which has been read from the padded message
 // Can be read as an array of 64, 32 or 8 bit integers
@@ -13,27 +17,21 @@ union block{
     uint8_t eight[64];
 };
 
-// nobits is the number of bits we read form the file (reading file in blocks of x size)
-// If numbits mod 512 (ULL = Unsingned long long) has a remainder, this is where we start padding.
+// SHA-256 padding: 512 bit blocks ending in a 64 bit length.
 // Hence the 512ULL minus the modulo of nobits to the 512.
 uint64_t  numzerobytes(uint64_t nobits){
-    uint64_t result = 512ULL - (nobits % 512ULL);
-
-    // Check the size of result to decide padding
-    // If there's not enough room in the last block to perform the padding, add another block.
-    if(result < 65){
-        result += 512;
-    }
-
-    // Make space for the 8 bits and the 64 bits which have to be included in the padding
-    result -= 72;
-
-    // Return the result as an 8bit ULL
-    return (result / 8ULL);
+    return numzerobytes_block(nobits, 512ULL, 64ULL);
 }
 
 int main(int argc, char *argv[]){
 
+    // --sha512 pads for SHA-384/512: 1024 bit blocks and a 128 bit length.
+    int sha512 = argc == 3 && strcmp(argv[1], "--sha512") == 0;
+    if (sha512){
+        argv++;
+        argc--;
+    }
+
     // If No filename specified show error
     if (argc != 2){
         printf("Error.. Single filename expected as an argument.");
@@ -65,10 +63,13 @@ int main(int argc, char *argv[]){
     printf("%08" PRIx8, 0x80);
 
     // Pad the input with zeros
-    for (uint64_t i = numzerobytes(_nobits); i > 0; i--) {
+    for (uint64_t i = sha512 ? numzerobytes_block(_nobits, 1024ULL, 128ULL) : numzerobytes(_nobits); i > 0; i--) {
         printf("%02" PRIx8, 0x00);
     }
-    // Pad the input with the final 64 bits
+    // Pad the input with the final 64 bits (128 for SHA-512, the top 64 are zero here)
+    if (sha512){
+        printf("%016" PRIx64, (uint64_t) 0);
+    }
     printf("%016" PRIx64, _nobits);
 
     // Formatting for easier readability.
@@ -0,0 +1,111 @@
+// libtoahash: the MD5 tool's sources (which bring SHA-256 along for the fused
+// kernel) and the SHA-256 lanes, built as one translation unit behind toahash.h.
+// David Gallagher.
+//
+// Everything but the toahash_ functions has hidden visibility, so the tools'
+// globals (K, H0, ...) and helper names stay out of the shared library's symbol
+// table and can't collide with the caller's. Visibility means nothing to a static
+// link, so the build makes the same names local in libtoahash.a with objcopy.
+
+#define TOAHASH_LIBRARY
+#include "toahash.h"
+#include "../MD5/main.c"
+
+// The SHA-256 lanes, renamed where they would meet the MD5 ones.
+#define LANEWORD SHA256_LANEWORD
+#define nexthash_lanes nexthash256_lanes
+#include "../SHA256/FinalSHA256/multibuffer.c"
+#undef nexthash_lanes
+#undef LANEWORD
+
+// The contexts must fit the public types.
+typedef char toahash_md5_ctx_fits[sizeof(MD5_CTX) <= sizeof(toahash_md5_ctx) ? 1 : -1];
+typedef char toahash_sha256_ctx_fits[sizeof(SHA256_CTX) <= sizeof(toahash_sha256_ctx) ? 1 : -1];
+
+#define TOAHASH_BATCH 64
+
+unsigned toahash_version(void){
+    return (TOAHASH_VERSION_MAJOR << 16) | TOAHASH_VERSION_MINOR;
+}
+
+void toahash_md5_init(toahash_md5_ctx *ctx){
+    md5_init((MD5_CTX *) ctx);
+}
+
+void toahash_md5_update(toahash_md5_ctx *ctx, const void *data, size_t len){
+    md5_update((MD5_CTX *) ctx, (const uint8_t *) data, len);
+}
+
+void toahash_md5_update_iov(toahash_md5_ctx *ctx, const struct iovec *iov, size_t n){
+    md5_update_iov((MD5_CTX *) ctx, iov, n);
+}
+
+void toahash_md5_final(toahash_md5_ctx *ctx, uint8_t digest[TOAHASH_MD5_DIGEST]){
+    WORD H[4];
+    md5_final((MD5_CTX *) ctx, H);
+    md5_digest_bytes(H, digest);
+}
+
+void toahash_md5(const void *data, size_t len, uint8_t digest[TOAHASH_MD5_DIGEST]){
+    MD5_CTX ctx;
+    WORD H[4];
+    md5_init(&ctx);
+    md5_update(&ctx, (const uint8_t *) data, len);
+    md5_final(&ctx, H);
+    md5_digest_bytes(H, digest);
+}
+
+void toahash_sha256_init(toahash_sha256_ctx *ctx){
+    sha256_init((SHA256_CTX *) ctx);
+}
+
+void toahash_sha256_update(toahash_sha256_ctx *ctx, const void *data, size_t len){
+    sha256_update((SHA256_CTX *) ctx, (const uint8_t *) data, len);
+}
+
+void toahash_sha256_update_iov(toahash_sha256_ctx *ctx, const struct iovec *iov, size_t n){
+    sha256_update_iov((SHA256_CTX *) ctx, iov, n);
+}
+
+void toahash_sha256_final(toahash_sha256_ctx *ctx, uint8_t digest[TOAHASH_SHA256_DIGEST]){
+    WORD H[8];
+    sha256_final((SHA256_CTX *) ctx, H);
+    sha256_digest_bytes(H, digest);
+}
+
+void toahash_sha256(const void *data, size_t len, uint8_t digest[TOAHASH_SHA256_DIGEST]){
+    SHA256_CTX ctx;
+    WORD H[8];
+    sha256_init(&ctx);
+    sha256_update(&ctx, (const uint8_t *) data, len);
+    sha256_final(&ctx, H);
+    sha256_digest_bytes(H, digest);
+}
+
+void toahash_md5_batch(const void *const *data, const size_t *len, size_t n, uint8_t *digests){
+    MD5_MBJOB jobs[TOAHASH_BATCH];
+    for (size_t done = 0; done < n; done += TOAHASH_BATCH){
+        size_t m = n - done < TOAHASH_BATCH ? n - done : TOAHASH_BATCH;
+        for (size_t i = 0; i < m; i++){
+            jobs[i].from = NULL;
+            jobs[i].data = (const uint8_t *) data[done + i];
+            jobs[i].len = len[done + i];
+        }
+        md5_mb_hash(jobs, m);
+        for (size_t i = 0; i < m; i++){ md5_digest_bytes(jobs[i].H, digests + 16 * (done + i)); }
+    }
+}
+
+void toahash_sha256_batch(const void *const *data, const size_t *len, size_t n, uint8_t *digests){
+    SHA256_MBJOB jobs[TOAHASH_BATCH];
+    for (size_t done = 0; done < n; done += TOAHASH_BATCH){
+        size_t m = n - done < TOAHASH_BATCH ? n - done : TOAHASH_BATCH;
+        for (size_t i = 0; i < m; i++){
+            jobs[i].from = NULL;
+            jobs[i].data = (const uint8_t *) data[done + i];
+            jobs[i].len = len[done + i];
+        }
+        sha256_mb_hash(jobs, m);
+        for (size_t i = 0; i < m; i++){ sha256_digest_bytes(jobs[i].H, digests + 32 * (done + i)); }
+    }
+}
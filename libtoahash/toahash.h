@@ -0,0 +1,78 @@
+/*
+ * libtoahash: MD5 and SHA-256 from the TheoryOfAlgorithms tools, as a library.
+ * David Gallagher.
+ *
+ * The ABI is stable within a major version: functions are only ever added, and the
+ * context types keep their size (they have room for the state to grow). Only the
+ * toahash_ names are exported from the shared library.
+ *
+ * Every function is thread safe as long as each context is used by one thread
+ * at a time.
+ */
+
+#ifndef TOAHASH_H
+#define TOAHASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(_WIN32) && defined(TOAHASH_SHARED)
+#  ifdef TOAHASH_BUILD
+#    define TOAHASH_API __declspec(dllexport)
+#  else
+#    define TOAHASH_API __declspec(dllimport)
+#  endif
+#elif defined(__GNUC__)
+#  define TOAHASH_API __attribute__ ((visibility ("default")))
+#else
+#  define TOAHASH_API
+#endif
+
+#define TOAHASH_VERSION_MAJOR 1
+#define TOAHASH_VERSION_MINOR 1
+
+#define TOAHASH_MD5_DIGEST      16
+#define TOAHASH_SHA256_DIGEST   32
+
+struct iovec;
+
+/* Streaming contexts. Opaque; allocate them anywhere. */
+typedef struct { uint64_t opaque[32]; } toahash_md5_ctx;
+typedef struct { uint64_t opaque[32]; } toahash_sha256_ctx;
+
+/* (major << 16) | minor of the library actually loaded. */
+TOAHASH_API unsigned toahash_version(void);
+
+/* One-shot. */
+TOAHASH_API void toahash_md5(const void *data, size_t len, uint8_t digest[TOAHASH_MD5_DIGEST]);
+TOAHASH_API void toahash_sha256(const void *data, size_t len, uint8_t digest[TOAHASH_SHA256_DIGEST]);
+
+/* Streaming: init, any number of updates, final. final leaves the context to be
+ * initialised again before reuse. */
+TOAHASH_API void toahash_md5_init(toahash_md5_ctx *ctx);
+TOAHASH_API void toahash_md5_update(toahash_md5_ctx *ctx, const void *data, size_t len);
+TOAHASH_API void toahash_md5_final(toahash_md5_ctx *ctx, uint8_t digest[TOAHASH_MD5_DIGEST]);
+
+/* Since 1.1. Feed a chain of segments (<sys/uio.h> struct iovec) in place, as if
+ * they were one contiguous update; no need to gather them first. */
+TOAHASH_API void toahash_md5_update_iov(toahash_md5_ctx *ctx, const struct iovec *iov, size_t n);
+
+TOAHASH_API void toahash_sha256_init(toahash_sha256_ctx *ctx);
+TOAHASH_API void toahash_sha256_update(toahash_sha256_ctx *ctx, const void *data, size_t len);
+TOAHASH_API void toahash_sha256_final(toahash_sha256_ctx *ctx, uint8_t digest[TOAHASH_SHA256_DIGEST]);
+TOAHASH_API void toahash_sha256_update_iov(toahash_sha256_ctx *ctx, const struct iovec *iov, size_t n);
+
+/* Batch: n independent messages through the multi-buffer lanes, digest i at
+ * digests + i * digest size. Fastest for many short messages. */
+TOAHASH_API void toahash_md5_batch(const void *const *data, const size_t *len, size_t n, uint8_t *digests);
+TOAHASH_API void toahash_sha256_batch(const void *const *data, const size_t *len, size_t n, uint8_t *digests);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,328 @@
+// libtoahash for C++17/20: Hasher<Algo> over the C library, and constexpr MD5 and
+// SHA-256 for digests of literals.
+// David Gallagher.
+//
+//     constexpr auto d = toahash::md5("abc");             // at compile time
+//     static_assert(toahash::equal(d, "900150983cd24fb0d6963f7d28e17f72"));
+//
+//     switch (toahash::sha256_id(name)){                  // runtime, library kernel
+//         case "get"_sha256id: ...
+//     }
+//
+//     toahash::Hasher<toahash::SHA256> h;
+//     h.update(chunk1).update(chunk2);
+//     auto digest = h.final();
+//
+// md5(), sha256() and the _id functions are constexpr: in a constant expression
+// they run the rounds below, at runtime they call the library, which picks the
+// fastest kernel. Only the constant-evaluated path is header-only; anything that
+// runs links against libtoahash. Compilers without __builtin_is_constant_evaluated
+// (or C++20) run the constexpr rounds at runtime too.
+
+#ifndef TOAHASH_HPP
+#define TOAHASH_HPP
+
+#include "toahash.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <type_traits>
+
+#if __cplusplus >= 202002L
+#  include <span>
+#  define TOAHASH_HAS_SPAN 1
+#endif
+
+#if defined(__cpp_lib_is_constant_evaluated)
+#  define TOAHASH_CONSTANT_EVALUATED() std::is_constant_evaluated()
+#elif defined(__has_builtin)
+#  if __has_builtin(__builtin_is_constant_evaluated)
+#    define TOAHASH_CONSTANT_EVALUATED() __builtin_is_constant_evaluated()
+#  endif
+#endif
+#ifndef TOAHASH_CONSTANT_EVALUATED
+#  define TOAHASH_CONSTANT_EVALUATED() true
+#endif
+
+namespace toahash {
+
+template <std::size_t N>
+using digest = std::array<std::uint8_t, N>;
+
+#ifdef TOAHASH_HAS_SPAN
+using bytes = std::span<const std::byte>;
+#else
+// What std::span<const std::byte> gives C++20: a pointer and a length.
+class bytes {
+public:
+    constexpr bytes() noexcept = default;
+    constexpr bytes(const std::byte *data, std::size_t size) noexcept : data_(data), size_(size) {}
+    constexpr const std::byte *data() const noexcept { return data_; }
+    constexpr std::size_t size() const noexcept { return size_; }
+private:
+    const std::byte *data_ = nullptr;
+    std::size_t size_ = 0;
+};
+#endif
+
+// The bytes of a string, for update() and hash().
+inline bytes as_bytes(std::string_view s) noexcept {
+    return bytes(reinterpret_cast<const std::byte *>(s.data()), s.size());
+}
+
+namespace detail {
+
+constexpr std::uint32_t rotl(std::uint32_t x, int n) { return (x << n) | (x >> (32 - n)); }
+constexpr std::uint32_t rotr(std::uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+// RFC 1321 section 3.4 - K[i] = floor(abs(sin(i + 1)) * 2^32), and the shifts.
+inline constexpr std::uint32_t md5_k[64] = {
+        0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+        0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+        0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+        0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+        0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+        0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+        0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+        0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391};
+inline constexpr int md5_s[16] = {7, 12, 17, 22, 5, 9, 14, 20, 4, 11, 16, 23, 6, 10, 15, 21};
+inline constexpr std::uint32_t md5_iv[4] = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476};
+
+// FIPS 180-4 section 4.2.2 and 5.3.3.
+inline constexpr std::uint32_t sha256_k[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+inline constexpr std::uint32_t sha256_iv[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+
+// MD5's nexthash: the four rounds of RFC 1321 section 3.4 as one loop.
+constexpr void md5_nexthash(const std::uint32_t *M, std::uint32_t *H) {
+    std::uint32_t a = H[0], b = H[1], c = H[2], d = H[3];
+    for (int i = 0; i < 64; i++){
+        std::uint32_t f = 0;
+        int g = 0;
+        switch (i >> 4){
+            case 0: f = (b & c) | (~b & d); g = i;               break;
+            case 1: f = (b & d) | (c & ~d); g = (5 * i + 1) & 15; break;
+            case 2: f = b ^ c ^ d;          g = (3 * i + 5) & 15; break;
+            default: f = c ^ (b | ~d);      g = (7 * i) & 15;     break;
+        }
+        std::uint32_t t = d;
+        d = c;
+        c = b;
+        b = b + rotl(a + f + md5_k[i] + M[g], md5_s[((i >> 4) << 2) | (i & 3)]);
+        a = t;
+    }
+    H[0] += a; H[1] += b; H[2] += c; H[3] += d;
+}
+
+// SHA-256's nexthash256: FIPS 180-4 section 6.2.2.
+constexpr void sha256_nexthash(const std::uint32_t *M, std::uint32_t *H) {
+    std::uint32_t W[64] = {};
+    for (int t = 0; t < 16; t++)
+        W[t] = M[t];
+    for (int t = 16; t < 64; t++)
+        W[t] = (rotr(W[t-2], 17) ^ rotr(W[t-2], 19) ^ (W[t-2] >> 10)) + W[t-7]
+             + (rotr(W[t-15], 7) ^ rotr(W[t-15], 18) ^ (W[t-15] >> 3)) + W[t-16];
+
+    std::uint32_t a = H[0], b = H[1], c = H[2], d = H[3], e = H[4], f = H[5], g = H[6], h = H[7];
+    for (int t = 0; t < 64; t++){
+        std::uint32_t T1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + sha256_k[t] + W[t];
+        std::uint32_t T2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g; g = f; f = e; e = d + T1;
+        d = c; c = b; b = a; a = T1 + T2;
+    }
+    H[0] += a; H[1] += b; H[2] += c; H[3] += d;
+    H[4] += e; H[5] += f; H[6] += g; H[7] += h;
+}
+
+// The shared padding (RFC 1321 sections 3.1-3.2, FIPS 180-4 section 5.1.1): the
+// message, a 1 bit, zeros to 56 mod 64 and the bit length, fed to nexthash a
+// block of words at a time. Only the byte order of the words and the length differ.
+template <std::size_t W, bool BigEndian, class Compress>
+constexpr std::array<std::uint32_t, W> padded_hash(std::string_view s, const std::uint32_t (&iv)[W], Compress nexthash) {
+    std::array<std::uint32_t, W> H = {};
+    for (std::size_t i = 0; i < W; i++)
+        H[i] = iv[i];
+
+    const std::uint64_t numbits = static_cast<std::uint64_t>(s.size()) * 8;
+    const std::size_t total = (s.size() + 8) / 64 * 64 + 64;
+    for (std::size_t base = 0; base < total; base += 64){
+        std::uint32_t M[16] = {};
+        for (std::size_t i = 0; i < 64; i++){
+            std::size_t at = base + i;
+            std::uint8_t byte = 0;
+            if (at < s.size())
+                byte = static_cast<std::uint8_t>(s[at]);
+            else if (at == s.size())
+                byte = 0x80;
+            else if (at >= total - 8){
+                std::size_t k = at - (total - 8);
+                byte = static_cast<std::uint8_t>(numbits >> (BigEndian ? 8 * (7 - k) : 8 * k));
+            }
+            int shift = BigEndian ? 8 * (3 - static_cast<int>(i & 3)) : 8 * static_cast<int>(i & 3);
+            M[i >> 2] |= static_cast<std::uint32_t>(byte) << shift;
+        }
+        nexthash(M, H.data());
+    }
+    return H;
+}
+
+template <std::size_t N, std::size_t W, bool BigEndian>
+constexpr digest<N> to_bytes(const std::array<std::uint32_t, W> &H) {
+    digest<N> out = {};
+    for (std::size_t i = 0; i < N; i++){
+        int shift = BigEndian ? 8 * (3 - static_cast<int>(i & 3)) : 8 * static_cast<int>(i & 3);
+        out[i] = static_cast<std::uint8_t>(H[i >> 2] >> shift);
+    }
+    return out;
+}
+
+constexpr digest<16> md5_constexpr(std::string_view s) {
+    return to_bytes<16, 4, false>(padded_hash<4, false>(s, md5_iv, md5_nexthash));
+}
+
+constexpr digest<32> sha256_constexpr(std::string_view s) {
+    return to_bytes<32, 8, true>(padded_hash<8, true>(s, sha256_iv, sha256_nexthash));
+}
+
+// The first eight digest bytes, big endian.
+template <std::size_t N>
+constexpr std::uint64_t id_of(const digest<N> &d) {
+    std::uint64_t id = 0;
+    for (std::size_t i = 0; i < 8; i++)
+        id = (id << 8) | d[i];
+    return id;
+}
+
+constexpr int hexval(char c) {
+    return c >= '0' && c <= '9' ? c - '0'
+         : c >= 'a' && c <= 'f' ? c - 'a' + 10
+         : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+}
+
+} // namespace detail
+
+constexpr digest<16> md5(std::string_view s) {
+    if (TOAHASH_CONSTANT_EVALUATED())
+        return detail::md5_constexpr(s);
+    digest<16> d = {};
+    toahash_md5(s.data(), s.size(), d.data());
+    return d;
+}
+
+constexpr digest<32> sha256(std::string_view s) {
+    if (TOAHASH_CONSTANT_EVALUATED())
+        return detail::sha256_constexpr(s);
+    digest<32> d = {};
+    toahash_sha256(s.data(), s.size(), d.data());
+    return d;
+}
+
+// 64-bit keys for switch and dispatch tables: the digest's first eight bytes.
+constexpr std::uint64_t md5_id(std::string_view s) { return detail::id_of(md5(s)); }
+constexpr std::uint64_t sha256_id(std::string_view s) { return detail::id_of(sha256(s)); }
+
+// A digest against its hex form; constexpr, so static_assert can use it (std::array's
+// operator== is only constexpr from C++20).
+template <std::size_t N>
+constexpr bool equal(const digest<N> &d, std::string_view hex) {
+    if (hex.size() != 2 * N)
+        return false;
+    for (std::size_t i = 0; i < N; i++){
+        int hi = detail::hexval(hex[2 * i]), lo = detail::hexval(hex[2 * i + 1]);
+        if (hi < 0 || lo < 0 || d[i] != ((hi << 4) | lo))
+            return false;
+    }
+    return true;
+}
+
+namespace literals {
+constexpr digest<16> operator""_md5(const char *s, std::size_t n) { return md5(std::string_view(s, n)); }
+constexpr digest<32> operator""_sha256(const char *s, std::size_t n) { return sha256(std::string_view(s, n)); }
+constexpr std::uint64_t operator""_md5id(const char *s, std::size_t n) { return md5_id(std::string_view(s, n)); }
+constexpr std::uint64_t operator""_sha256id(const char *s, std::size_t n) { return sha256_id(std::string_view(s, n)); }
+} // namespace literals
+
+// Algorithms for Hasher: the library's context and functions under one name.
+struct MD5 {
+    static constexpr std::size_t digest_size = TOAHASH_MD5_DIGEST;
+    using context = toahash_md5_ctx;
+    static void init(context *c) { toahash_md5_init(c); }
+    static void update(context *c, const void *p, std::size_t n) { toahash_md5_update(c, p, n); }
+    static void update_iov(context *c, const struct iovec *iov, std::size_t n) { toahash_md5_update_iov(c, iov, n); }
+    static void final(context *c, std::uint8_t *d) { toahash_md5_final(c, d); }
+    static void batch(const void *const *p, const std::size_t *n, std::size_t k, std::uint8_t *d) { toahash_md5_batch(p, n, k, d); }
+};
+
+struct SHA256 {
+    static constexpr std::size_t digest_size = TOAHASH_SHA256_DIGEST;
+    using context = toahash_sha256_ctx;
+    static void init(context *c) { toahash_sha256_init(c); }
+    static void update(context *c, const void *p, std::size_t n) { toahash_sha256_update(c, p, n); }
+    static void update_iov(context *c, const struct iovec *iov, std::size_t n) { toahash_sha256_update_iov(c, iov, n); }
+    static void final(context *c, std::uint8_t *d) { toahash_sha256_final(c, d); }
+    static void batch(const void *const *p, const std::size_t *n, std::size_t k, std::uint8_t *d) { toahash_sha256_batch(p, n, k, d); }
+};
+
+// Streaming hasher. final() returns the digest and starts a new message.
+template <class Algo>
+class Hasher {
+public:
+    using digest_type = digest<Algo::digest_size>;
+
+    Hasher() noexcept { Algo::init(&ctx_); }
+
+    Hasher &update(bytes b) noexcept {
+        Algo::update(&ctx_, b.data(), b.size());
+        return *this;
+    }
+
+    // A chain of segments, hashed in place as if contiguous.
+    Hasher &update(const struct iovec *iov, std::size_t n) noexcept {
+        Algo::update_iov(&ctx_, iov, n);
+        return *this;
+    }
+
+    digest_type final() noexcept {
+        digest_type d;
+        Algo::final(&ctx_, d.data());
+        Algo::init(&ctx_);
+        return d;
+    }
+
+    static digest_type hash(bytes b) noexcept {
+        return Hasher().update(b).final();
+    }
+
+    // n messages through the multi-buffer lanes, digest i into out[i].
+    static void batch(const bytes *msgs, std::size_t n, digest_type *out) noexcept {
+        constexpr std::size_t chunk = 64;
+        const void *p[chunk];
+        std::size_t len[chunk];
+        for (std::size_t done = 0; done < n; done += chunk){
+            std::size_t m = n - done < chunk ? n - done : chunk;
+            for (std::size_t i = 0; i < m; i++){
+                p[i] = msgs[done + i].data();
+                len[i] = msgs[done + i].size();
+            }
+            static_assert(sizeof(digest_type) == Algo::digest_size, "digests are packed");
+            Algo::batch(p, len, m, out[done].data());
+        }
+    }
+
+private:
+    typename Algo::context ctx_;
+};
+
+} // namespace toahash
+
+#endif